@@ -20,10 +20,26 @@ struct obj
     uint64_t oid;          /* identifier */
     unsigned int replication;  /* replication factor */
     uint64_t size;         /* size of object */
-    unsigned long server_idxs[CH_MAX_REPLICATION]; /* cached placement data */
+    unsigned long server_idxs[CH_STACK_REPLICATION]; /* cached placement data */
+    unsigned long *wide_server_idxs; /* cache used instead when replication
+                                      * is above CH_STACK_REPLICATION */
 };
 
-/* generates a random array of object IDs for testing/evaluation */
+/* returns the placement cache of an object, which holds replication
+ * entries
+ */
+static inline unsigned long* oid_server_idxs(struct obj *obj)
+{
+    if(obj->replication > CH_STACK_REPLICATION)
+        return(obj->wide_server_idxs);
+    return(obj->server_idxs);
+}
+
+/* generates a random array of object IDs for testing/evaluation.  For
+ * replication above CH_STACK_REPLICATION the wide placement caches are
+ * allocated in the same block as the array, so free(*total_objs) releases
+ * everything.
+ */
 void oid_gen(char* gen_name, 
     struct ch_placement_instance *instance,
     unsigned int max_objs, 
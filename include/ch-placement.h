@@ -13,24 +13,245 @@
 extern "C" {
 #endif
 
-/* maximum replication factor allowed by library */
-#define CH_MAX_REPLICATION 5
+/* replication factors up to this size are placed using only stack storage;
+ * wider layouts are supported, and some modules keep per-thread scratch
+ * space for them
+ */
+#define CH_STACK_REPLICATION 5
+
+/* kept for source compatibility; replication is no longer limited to this */
+#define CH_MAX_REPLICATION CH_STACK_REPLICATION
 
 struct ch_placement_instance;
 
+/* memory footprint and construction cost of an instance */
+struct ch_placement_stats
+{
+    unsigned long table_bytes;  /* bytes held by the placement table */
+    unsigned long index_bytes;  /* bytes held by optional lookup indexes */
+    double build_seconds;       /* time spent building the table */
+    double index_build_seconds; /* time spent building the lookup indexes */
+};
+
+/* a range of the oid space whose primary server changed after a membership
+ * change.  Covers the oids from start to end inclusive, wrapping around
+ * past UINT64_MAX if start > end, but only those with
+ * oid % n_rings == ring (n_rings is 1 for modules with a single ring).
+ */
+struct ch_placement_arc
+{
+    uint64_t start;
+    uint64_t end;
+    unsigned int n_rings;
+    unsigned int ring;
+    unsigned long old_svr;
+    unsigned long new_svr;
+};
+
 struct ch_placement_instance* ch_placement_initialize(const char* name, 
     int n_svrs, int virt_factor, int seed);
 
+/* same as ch_placement_initialize(), but also passes a comma delimited list
+ * of module specific parameters in the form "key:value,key:value".  Returns
+ * NULL if the module does not recognize one of the parameters.
+ */
+struct ch_placement_instance* ch_placement_initialize_params(const char* name,
+    int n_svrs, int virt_factor, int seed, const char* params);
+
+/* same as ch_placement_initialize_params() (params may be NULL), but gives
+ * each server a share of the virtual nodes proportional to weights[i], for
+ * example capacity times bandwidth.  virt_factor is the number of virtual
+ * nodes for a server of average weight; a server with a weight of zero gets
+ * none.  Equal weights place objects exactly like
+ * ch_placement_initialize_params().  Returns NULL if the module does not
+ * support weights or the weights are invalid.  Only "ring" and "straw2"
+ * support weights; "straw2" ignores virt_factor.
+ */
+struct ch_placement_instance* ch_placement_initialize_weighted(
+    const char* name, int n_svrs, int virt_factor, int seed,
+    const double *weights, const char* params);
+
 void ch_placement_finalize(struct ch_placement_instance *instance);
 
+/* fills server_idxs with the replication servers for obj, primary first.
+ * If fewer servers than that can hold objects (for example when the others
+ * have a weight of zero), the remaining slots are set to UINT64_MAX.
+ */
 void ch_placement_find_closest(
     struct ch_placement_instance *instance,
     uint64_t obj, 
     unsigned int replication, 
     unsigned long* server_idxs);
 
+/* places n_objs objects in one call.  server_idxs is a flat
+ * n_objs x replication matrix; the replicas for objs[i] are stored starting
+ * at server_idxs[i*replication].
+ */
+void ch_placement_find_closest_batch(
+    struct ch_placement_instance *instance,
+    const uint64_t *objs,
+    unsigned long n_objs,
+    unsigned int replication,
+    unsigned long* server_idxs);
+
+/* fills in stats for the instance; returns -1 if the module does not
+ * track them
+ */
+int ch_placement_get_stats(
+    struct ch_placement_instance *instance,
+    struct ch_placement_stats *stats);
+
+/* returned by ch_placement_add_server() and ch_placement_remove_server()
+ * when arcs were asked for but the module does not move objects in ranges
+ * of the oid space.  The membership change was made; *arcs is set to NULL
+ * and *n_arcs to 0.
+ */
+#define CH_PLACEMENT_NO_ARCS 1
+
+/* adds server svr_idx to the instance in place, positioning its virtual
+ * nodes exactly as ch_placement_initialize() would have.  If arcs is not
+ * NULL it is set to a malloc'd array of the *n_arcs ranges whose primary
+ * server changed, which the caller must free, or CH_PLACEMENT_NO_ARCS is
+ * returned.  Returns -1 if the module does not support membership changes
+ * or cannot add svr_idx (e.g. it is already a member, or memory ran out; see
+ * the module for which servers it can add), leaving the instance as it
+ * was.  On a weighted instance, the new server gets virt_factor virtual
+ * nodes.
+ */
+int ch_placement_add_server(
+    struct ch_placement_instance *instance,
+    unsigned long svr_idx,
+    struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+
+/* removes server svr_idx from the instance in place; see
+ * ch_placement_add_server().  Returns -1 if the module does not support
+ * membership changes, svr_idx is not a member, or it is the last member.
+ */
+int ch_placement_remove_server(
+    struct ch_placement_instance *instance,
+    unsigned long svr_idx,
+    struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+
+/* sets the current load (e.g. the number of objects or open sessions) of
+ * server svr_idx.  With the "bounded_load:<c>" parameter, "ring" forwards
+ * an object whose server is at or above its capacity clockwise to the
+ * next server below its own, so no server ends up with more than that.
+ * A server's capacity is c times its share of the total load, rounded up;
+ * the share follows its weight on a weighted instance (a server added
+ * later has the average weight).  Loads start at zero, and the caller
+ * updates them as objects are placed and removed; removing a server drops
+ * its load.  Since placement depends on the loads, such an instance
+ * cannot be saved with ch_placement_save().  Returns -1 if the instance
+ * does not place with bounded loads or svr_idx is not a member.
+ */
+int ch_placement_set_load(
+    struct ch_placement_instance *instance,
+    unsigned long svr_idx,
+    unsigned long load);
+
+/* reads back the current load of server svr_idx; see
+ * ch_placement_set_load()
+ */
+int ch_placement_get_load(
+    struct ch_placement_instance *instance,
+    unsigned long svr_idx,
+    unsigned long *load);
+
+/* saves the built placement table to path, including any lookup indexes,
+ * in a versioned and checksummed format.  The file is replaced atomically,
+ * so processes that have the old one mapped are not affected.  Returns -1
+ * if the module does not support snapshots ("ring", "multiring" and
+ * "partition" do) or the file cannot be written.
+ */
+int ch_placement_save(
+    struct ch_placement_instance *instance,
+    const char *path);
+
+/* creates an instance from a file written by ch_placement_save().  The
+ * file is mapped read-only and lookups use it in place, so processes that
+ * load the same file share one copy in the page cache.  The instance
+ * places objects exactly like the one that was saved, but does not support
+ * ch_placement_add_server() or ch_placement_remove_server().  Returns NULL
+ * if the file is missing, from another version or architecture, or fails
+ * its checksum.
+ */
+struct ch_placement_instance* ch_placement_load_mmap(const char *path);
+
+/* a handle through which many threads can look up objects while other
+ * threads replace the instance behind it, e.g. after a membership change.
+ * Lookups take no locks; ch_placement_handle_publish() swaps in the new
+ * instance atomically and finalizes the old one once every lookup that
+ * could still be using it has finished.
+ */
+struct ch_placement_handle;
+
+/* creates a handle that serves lookups from instance.  The handle takes
+ * ownership of the instance.  Returns NULL on allocation failure.
+ */
+struct ch_placement_handle* ch_placement_handle_create(
+    struct ch_placement_instance *instance);
+
+/* finalizes the handle and its current instance.  No other thread may be
+ * using the handle.
+ */
+void ch_placement_handle_destroy(struct ch_placement_handle *handle);
+
+/* replaces the current instance with instance, taking ownership of it, and
+ * returns once the previous instance has been finalized.  Lookups that
+ * start after the swap use the new instance; lookups already in progress
+ * finish on the old one.  Concurrent publishers are serialized.
+ */
+void ch_placement_handle_publish(
+    struct ch_placement_handle *handle,
+    struct ch_placement_instance *instance);
+
+/* begins a read-side critical section and returns the current instance,
+ * which stays valid until the matching ch_placement_handle_release().  The
+ * token must be passed to ch_placement_handle_release().  Critical sections
+ * should be short, since publishers wait for them; they may not publish.
+ */
+struct ch_placement_instance* ch_placement_handle_acquire(
+    struct ch_placement_handle *handle,
+    unsigned int *token);
+
+void ch_placement_handle_release(
+    struct ch_placement_handle *handle,
+    unsigned int token);
+
+/* same as ch_placement_find_closest() and
+ * ch_placement_find_closest_batch(), using the handle's current instance
+ */
+void ch_placement_handle_find_closest(
+    struct ch_placement_handle *handle,
+    uint64_t obj,
+    unsigned int replication,
+    unsigned long* server_idxs);
+
+void ch_placement_handle_find_closest_batch(
+    struct ch_placement_handle *handle,
+    const uint64_t *objs,
+    unsigned long n_objs,
+    unsigned int replication,
+    unsigned long* server_idxs);
+
+/* random 64 bit value from the global random() state */
 uint64_t ch_placement_random_u64(void);
 
+/* random 64 bit value from the caller's state, which is advanced.  Any
+ * value (e.g. a seed or file id) is a valid state; threads with their own
+ * states do not contend with each other.
+ */
+uint64_t ch_placement_random_u64_r(uint64_t *state);
+
+/* picks the objects (ids and sizes) of a new file striped over up to
+ * max_stripe_width objects of strip_size bytes.  Modules that can (e.g.
+ * "multiring") choose the ids so that the stripe is declustered across
+ * servers; the others use random ids.  Randomness comes from random(), so
+ * the layout depends on the order of calls and calls are serialized on
+ * libc's lock.
+ */
 void ch_placement_create_striped(
     struct ch_placement_instance *instance,
     unsigned long file_size, 
@@ -41,6 +262,23 @@ void ch_placement_create_striped(
     uint64_t *oids, 
     unsigned long *sizes);
 
+/* same as ch_placement_create_striped(), drawing randomness from
+ * *rng_state with ch_placement_random_u64_r() instead.  Setting the state
+ * to a seed such as the file id makes the layout a function of that seed
+ * alone.  Concurrent calls on one instance are safe as long as each uses
+ * its own state and no membership change runs at the same time.
+ */
+void ch_placement_create_striped_r(
+    struct ch_placement_instance *instance,
+    uint64_t *rng_state,
+    unsigned long file_size, 
+    unsigned int replication, 
+    unsigned int max_stripe_width, 
+    unsigned int strip_size,
+    unsigned int* num_objects,
+    uint64_t *oids, 
+    unsigned long *sizes);
+
 #ifdef __cplusplus
 }
 #endif
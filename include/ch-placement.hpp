@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef CH_PLACEMENT_HPP
+#define CH_PLACEMENT_HPP
+
+/* Header-only C++ versions of the "ring", "multiring", "hash_lookup3" and
+ * "hash_spooky" placement modules.  The replication factor, hash and server
+ * index type are template parameters, so lookups are inlined at the call
+ * site and the replica walk is unrolled.  Each engine builds the same table
+ * as the corresponding C module and places every object on exactly the same
+ * servers, given the same n_svrs, virt_factor and seed:
+ *
+ *   ch::Ring<ch::Lookup3, R>       "ring"
+ *   ch::MultiRing<ch::Lookup3, R>  "multiring"
+ *   ch::Hrw<ch::Lookup3, R>        "hash_lookup3"
+ *   ch::Hrw<ch::Spooky, R>         "hash_spooky"
+ *
+ * The hash functions themselves come from libch-placement.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+extern "C" {
+void ch_bj_hashlittle2(const void *key, size_t length, uint32_t *pc,
+    uint32_t *pb);
+uint64_t spooky_hash64(const void *message, size_t length, uint64_t seed);
+}
+
+namespace ch
+{
+
+/* A hash policy provides:
+ *
+ *   vnode_id(svr_idx, vnode, seed): position of a server's virtual node
+ *   distance(a, b): commutative distance used by the Hrw engine
+ *
+ * Every C module positions virtual nodes with lookup3, so both built-in
+ * policies do as well; they differ only in the Hrw distance.
+ */
+struct Lookup3
+{
+    static inline uint64_t vnode_id(uint64_t svr_idx, uint32_t vnode,
+        uint32_t seed)
+    {
+        uint32_t h1 = vnode;
+        uint32_t h2 = seed;
+
+        ch_bj_hashlittle2(&svr_idx, sizeof(svr_idx), &h1, &h2);
+        return(h1 + (((uint64_t)h2)<<32));
+    }
+
+    static inline uint64_t distance(uint64_t a, uint64_t b)
+    {
+        uint64_t higher = a > b ? a : b;
+        uint64_t lower = a > b ? b : a;
+        uint32_t h1 = higher & 0xFFFFFFFF;
+        uint32_t h2 = (higher >> 32) & 0xFFFFFFFF;
+
+        ch_bj_hashlittle2(&lower, sizeof(lower), &h1, &h2);
+        return(h1 + (((uint64_t)h2)<<32));
+    }
+};
+
+struct Spooky
+{
+    static inline uint64_t vnode_id(uint64_t svr_idx, uint32_t vnode,
+        uint32_t seed)
+    {
+        return(Lookup3::vnode_id(svr_idx, vnode, seed));
+    }
+
+    static inline uint64_t distance(uint64_t a, uint64_t b)
+    {
+        uint64_t higher = a > b ? a : b;
+        uint64_t lower = a > b ? b : a;
+
+        return(spooky_hash64(&lower, sizeof(lower), higher));
+    }
+};
+
+namespace detail
+{
+
+struct vnode
+{
+    uint64_t id;
+    uint64_t svr_idx;
+
+    /* equal ids are ordered by server, as in the C modules */
+    bool operator<(const vnode &other) const
+    {
+        return(id < other.id || (id == other.id && svr_idx < other.svr_idx));
+    }
+};
+
+/* number of ids in keys[0..n) that are <= key, without branching on the
+ * comparisons
+ */
+static inline size_t upper_bound(const uint64_t *keys, size_t n, uint64_t key)
+{
+    const uint64_t *base = keys;
+    size_t half;
+
+    if(n == 0)
+        return(0);
+    while(n > 1)
+    {
+        half = n / 2;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    return((base - keys) + (*base <= key));
+}
+
+/* builds one sorted ring, in the same order as the C modules */
+template <class Index>
+void build_ring(std::vector<vnode> &table, uint64_t *ids, Index *svrs)
+{
+    std::sort(table.begin(), table.end());
+    for(size_t i=0; i<table.size(); i++)
+    {
+        ids[i] = table[i].id;
+        svrs[i] = (Index)table[i].svr_idx;
+    }
+}
+
+} /* namespace detail */
+
+/* consistent hashing ring; same placement as the "ring" module */
+template <class Hash = Lookup3, unsigned int R = 3, class Index = uint32_t>
+class Ring
+{
+public:
+    typedef Index index_type;
+    static const unsigned int replication = R;
+
+    Ring(unsigned int n_svrs, unsigned int virt_factor, uint32_t seed = 0)
+        : n_vnodes_((size_t)n_svrs * virt_factor),
+          ids_(n_vnodes_), svrs_(n_vnodes_)
+    {
+        std::vector<detail::vnode> table(n_vnodes_);
+
+        /* the replica walk never finishes without R distinct servers */
+        if(n_svrs < R || virt_factor == 0)
+            throw std::invalid_argument("ch::Ring needs at least R servers");
+
+        for(uint64_t i=0; i<n_svrs; i++)
+        {
+            for(uint32_t j=0; j<virt_factor; j++)
+            {
+                table[(size_t)j*n_svrs+i].id = Hash::vnode_id(i, j, seed);
+                table[(size_t)j*n_svrs+i].svr_idx = i;
+            }
+        }
+        detail::build_ring(table, ids_.data(), svrs_.data());
+    }
+
+    /* fills server_idxs[0..R) with the servers for obj */
+    inline void find_closest(uint64_t obj, Index *server_idxs) const
+    {
+        size_t pos = detail::upper_bound(ids_.data(), n_vnodes_, obj);
+        Index svr;
+        unsigned int i, j;
+
+        /* the oid belongs to the vnode with the greatest id <= oid,
+         * wrapping around to the last vnode
+         */
+        pos = (pos == 0) ? n_vnodes_-1 : pos-1;
+
+        /* walk clockwise, skipping servers we already have */
+        for(i=0; i<R; i++)
+        {
+            for(;;)
+            {
+                svr = svrs_[pos];
+                for(j=0; j<i && server_idxs[j] != svr; j++);
+                if(++pos == n_vnodes_)
+                    pos = 0;
+                if(j == i)
+                    break;
+            }
+            server_idxs[i] = svr;
+        }
+    }
+
+    /* server_idxs is a flat n_objs x R matrix, as in
+     * ch_placement_find_closest_batch()
+     */
+    void find_closest_batch(const uint64_t *objs, size_t n_objs,
+        Index *server_idxs) const
+    {
+        for(size_t i=0; i<n_objs; i++)
+            find_closest(objs[i], &server_idxs[i*R]);
+    }
+
+private:
+    size_t n_vnodes_;
+    std::vector<uint64_t> ids_;
+    std::vector<Index> svrs_;
+};
+
+/* one ring per virtual node, chosen by oid; same placement as the
+ * "multiring" module
+ */
+template <class Hash = Lookup3, unsigned int R = 3, class Index = uint32_t>
+class MultiRing
+{
+public:
+    typedef Index index_type;
+    static const unsigned int replication = R;
+
+    MultiRing(unsigned int n_svrs, unsigned int virt_factor, uint32_t seed = 0)
+        : n_svrs_(n_svrs), virt_factor_(virt_factor),
+          ids_((size_t)n_svrs * virt_factor),
+          svrs_((size_t)n_svrs * virt_factor)
+    {
+        std::vector<detail::vnode> table(n_svrs);
+
+        if(n_svrs == 0 || virt_factor == 0)
+            throw std::invalid_argument("ch::MultiRing needs at least one server and ring");
+
+        for(uint32_t j=0; j<virt_factor; j++)
+        {
+            for(uint64_t i=0; i<n_svrs; i++)
+            {
+                table[i].id = Hash::vnode_id(i, j, seed);
+                table[i].svr_idx = i;
+            }
+            detail::build_ring(table, &ids_[(size_t)j*n_svrs],
+                &svrs_[(size_t)j*n_svrs]);
+        }
+    }
+
+    inline void find_closest(uint64_t obj, Index *server_idxs) const
+    {
+        size_t ring = (size_t)(obj % virt_factor_) * n_svrs_;
+        size_t pos = detail::upper_bound(&ids_[ring], n_svrs_, obj);
+        unsigned int i;
+
+        pos = (pos == 0) ? n_svrs_-1 : pos-1;
+
+        /* there are no duplicates on a given ring */
+        for(i=0; i<R; i++)
+        {
+            server_idxs[i] = svrs_[ring+pos];
+            if(++pos == n_svrs_)
+                pos = 0;
+        }
+    }
+
+    void find_closest_batch(const uint64_t *objs, size_t n_objs,
+        Index *server_idxs) const
+    {
+        for(size_t i=0; i<n_objs; i++)
+            find_closest(objs[i], &server_idxs[i*R]);
+    }
+
+private:
+    size_t n_svrs_;
+    uint64_t virt_factor_;
+    std::vector<uint64_t> ids_;
+    std::vector<Index> svrs_;
+};
+
+/* highest random weight: scores every virtual node against the oid and
+ * keeps the R closest; same placement as "hash_lookup3" or "hash_spooky"
+ * depending on Hash
+ */
+template <class Hash = Lookup3, unsigned int R = 3, class Index = uint32_t>
+class Hrw
+{
+public:
+    typedef Index index_type;
+    static const unsigned int replication = R;
+
+    Hrw(unsigned int n_svrs, unsigned int virt_factor, uint32_t seed = 0)
+        : ids_((size_t)n_svrs * virt_factor),
+          svrs_((size_t)n_svrs * virt_factor)
+    {
+        if((size_t)n_svrs * virt_factor < R)
+            throw std::invalid_argument("ch::Hrw needs at least R virtual nodes");
+
+        for(uint64_t i=0; i<n_svrs; i++)
+        {
+            for(uint32_t j=0; j<virt_factor; j++)
+            {
+                ids_[(size_t)j*n_svrs+i] = Hash::vnode_id(i, j, seed);
+                svrs_[(size_t)j*n_svrs+i] = (Index)i;
+            }
+        }
+    }
+
+    inline void find_closest(uint64_t obj, Index *server_idxs) const
+    {
+        uint64_t dist[R];
+        uint64_t d;
+        Index svr;
+        unsigned int filled = 0;
+        unsigned int j;
+
+        for(size_t i=0; i<ids_.size(); i++)
+        {
+            d = Hash::distance(obj, ids_[i]);
+            if(filled == R && d >= dist[R-1])
+                continue;
+
+            /* insert into the sorted list; ties keep the earlier vnode */
+            svr = svrs_[i];
+            for(j=0; j<R; j++)
+            {
+                if(j == filled)
+                {
+                    dist[j] = d;
+                    server_idxs[j] = svr;
+                    filled++;
+                    break;
+                }
+                if(d < dist[j])
+                {
+                    std::swap(d, dist[j]);
+                    std::swap(svr, server_idxs[j]);
+                }
+            }
+        }
+    }
+
+    void find_closest_batch(const uint64_t *objs, size_t n_objs,
+        Index *server_idxs) const
+    {
+        for(size_t i=0; i<n_objs; i++)
+            find_closest(objs[i], &server_idxs[i*R]);
+    }
+
+private:
+    std::vector<uint64_t> ids_;
+    std::vector<Index> svrs_;
+};
+
+} /* namespace ch */
+
+#endif /* CH_PLACEMENT_HPP */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=cpp ts=8 sts=4 sw=4 expandtab
+ */
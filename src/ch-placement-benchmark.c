@@ -33,11 +33,14 @@ struct options
     unsigned int num_objs;
     unsigned int replication;
     char *placement;
+    char *device_placement;
     unsigned int virt_factor;
     unsigned block_size;
     unsigned int sector_size;
     unsigned int threads;
     unsigned int algm;
+    int lookup_only;
+    int build_only;
 };
 
 struct comb_stats
@@ -105,6 +108,9 @@ const struct device_type DEVICE[3] = {
 static int comb_cmp(const void *a, const void *b);
 static int usage(char *exename);
 static struct options *parse_args(int argc, char *argv[]);
+static int time_lookups(struct ch_placement_instance *instance,
+    struct obj *objs, unsigned int num_objs, unsigned int replication);
+static int time_builds(struct options *ig_opts);
 
 
 #ifdef CH_ENABLE_CRUSH
@@ -405,8 +411,8 @@ int main(
     struct comb_stats *cs;                  
     
     uint64_t num_combs;
-    unsigned long comb_tmp[CH_MAX_REPLICATION];
-    unsigned long server_index[CH_MAX_REPLICATION];
+    unsigned long *comb_tmp;
+    unsigned long *server_index;
     unsigned long device_index_temp[1];
     unsigned long device_index;
     int ret;
@@ -426,7 +432,6 @@ int main(
 #endif
 
     ig_opts = parse_args(argc, argv);         // input
-    ig_opts->placement = "ring";              //we use ring hashing
     if (!ig_opts)
     {
         usage(argv[0]);
@@ -435,6 +440,9 @@ int main(
 
 
 
+    if (ig_opts->build_only)
+        return (time_builds(ig_opts));
+
     if (strcmp(ig_opts->placement, "crush") == 0 ||
         strcmp(ig_opts->placement, "crush-vring") == 0)
     {
@@ -449,6 +457,7 @@ int main(
         instance = ch_placement_initialize_crush(map, weight, n_weight);
 #else
         fprintf(stderr, "Error: not compiled with CRUSH support.\n");
+        return (-1);
 #endif
     }
     else
@@ -458,6 +467,11 @@ int main(
                                            ig_opts->virt_factor,
                                            0);
     }
+    if (!instance)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", ig_opts->placement);
+        return (-1);
+    }
 
     /* generate random set of objects for testing */
     printf("# Generating random object IDs...\n");
@@ -466,6 +480,19 @@ int main(
             NULL,
             &total_byte_count, &total_obj_count, &total_objs); 
 
+    if (ig_opts->lookup_only)
+    {
+        ret = time_lookups(instance, total_objs, total_obj_count,
+                           ig_opts->replication);
+        free(total_objs);
+        ch_placement_finalize(instance);
+        return (ret);
+    }
+
+    comb_tmp = malloc(ig_opts->replication * sizeof(*comb_tmp));
+    server_index = malloc(ig_opts->replication * sizeof(*server_index));
+    assert(comb_tmp && server_index);
+
 
 
 
@@ -510,8 +537,8 @@ int main(
 {
     for (i = 0; i < ig_opts->num_objs; i++)
     {
-        ch_placement_find_closest(instance, total_objs[i].oid, ig_opts->replication, total_objs[i].server_idxs);   //hashing
-            memcpy(comb_tmp, total_objs[i].server_idxs,           //hashing result, saved in comb_tmp
+        ch_placement_find_closest(instance, total_objs[i].oid, ig_opts->replication, oid_server_idxs(&total_objs[i]));   //hashing
+            memcpy(comb_tmp, oid_server_idxs(&total_objs[i]),           //hashing result, saved in comb_tmp
                    ig_opts->replication * sizeof(*comb_tmp));
             
 /*  hashing   */   
@@ -537,11 +564,12 @@ int main(
             server[server_index[j]].remain = server[server_index[j]].remain - block;
             server[server_index[j]].workload = server[server_index[j]].workload + block/10000;     
             
-            instance2 = ch_placement_initialize(ig_opts->placement,
+            instance2 = ch_placement_initialize(ig_opts->device_placement,
                                                 server[server_index[j]].num_device,
                                                 ig_opts->virt_factor,
                                                 0);                                        
             ch_placement_find_closest(instance2, total_objs[i].oid, 1, device_index_temp);//hashing  
+            ch_placement_finalize(instance2);
             switch(ig_opts->algm)
             {
                 case 1:
@@ -650,6 +678,8 @@ for(i = 0;i<ig_opts->num_servers;i++){
 
     /* we don't need the global list any more */
     free(total_objs);
+    free(comb_tmp);
+    free(server_index);
     total_obj_count = 0;
     total_byte_count = 0;
 
@@ -668,7 +698,11 @@ static int usage(char *exename)
     fprintf(stderr, "    -b <size of block (KB)>\n");
     fprintf(stderr, "    -e <size of sector>\n");
     fprintf(stderr, "    -t <number of threads>\n");
+    fprintf(stderr, "    -p <placement module (default ring)>\n");
+    fprintf(stderr, "    -D <placement module for devices within a server (default same as -p)>\n");
     fprintf(stderr, "    -a <placement algorithm(1=TACH 2=Capacity-based 3=Performance-based 4=CH)>\n");
+    fprintf(stderr, "    -l (only time placement lookups; -s, -o, -r and -v are required)\n");
+    fprintf(stderr, "    -c (only time serial and parallel table construction; -s, -o, -r and -v are required, -t is optional)\n");
     exit(1);
 }
 
@@ -683,7 +717,7 @@ static struct options *parse_args(int argc, char *argv[])
         return (NULL);
     memset(opts, 0, sizeof(*opts));
 
-    while ((one_opt = getopt(argc, argv, "s:d:o:r:hv:b:e:t:a:")) != EOF)
+    while ((one_opt = getopt(argc, argv, "s:d:o:r:hv:b:e:t:a:lcp:D:")) != EOF)
     {
         switch (one_opt)
         {
@@ -733,13 +767,22 @@ static struct options *parse_args(int argc, char *argv[])
             if (ret != 1)
                 return (NULL);
             break;   
-            /*              
+        case 'l':
+            opts->lookup_only = 1;
+            break;
+        case 'c':
+            opts->build_only = 1;
+            break;
         case 'p':
             opts->placement = strdup(optarg);
             if (!opts->placement)
                 return (NULL);
             break;
-            */
+        case 'D':
+            opts->device_placement = strdup(optarg);
+            if (!opts->device_placement)
+                return (NULL);
+            break;
         case '?':
             usage(argv[0]);
             exit(1);
@@ -749,20 +792,24 @@ static struct options *parse_args(int argc, char *argv[])
         }
     }
 
+    /* ring hashing unless another placement module is requested */
+    if (!opts->placement)
+        opts->placement = "ring";
+    if (!opts->device_placement)
+        opts->device_placement = opts->placement;
     if (opts->replication < 2)
         return (NULL);
     if (opts->num_servers < (opts->replication + 1))
         return (NULL);
-    if (opts->num_devices < 1)
-        return (NULL);
     if (opts->num_objs < 1)
         return (NULL);
     if (opts->virt_factor < 1)
         return (NULL);
-        /*
-    if (!opts->placement)
+    /* the device simulation parameters are not needed to time lookups */
+    if (opts->lookup_only || opts->build_only)
+        return (opts);
+    if (opts->num_devices < 1)
         return (NULL);
-        */
     if (opts->num_devices<1)
         return (NULL);
     if (opts->sector_size<3)
@@ -772,11 +819,118 @@ static struct options *parse_args(int argc, char *argv[])
     if (opts->algm!=1 && opts->algm!=2 && opts->algm!=3 && opts->algm!=4)
         return (NULL);                    
 
-    assert(opts->replication <= CH_MAX_REPLICATION);
-
     return (opts);
 }
 
+/* times placement of every object, one at a time and then in a single
+ * batch, and reports the average cost per object
+ */
+static int time_lookups(struct ch_placement_instance *instance,
+    struct obj *objs, unsigned int num_objs, unsigned int replication)
+{
+    struct timespec start, end;
+    double single_ns, batch_ns;
+    uint64_t *oids;
+    unsigned long *server_idxs;
+    unsigned int i;
+
+    oids = malloc(num_objs * sizeof(*oids));
+    server_idxs = malloc((unsigned long)num_objs * replication * sizeof(*server_idxs));
+    if (!oids || !server_idxs)
+    {
+        perror("malloc");
+        free(oids);
+        free(server_idxs);
+        return (-1);
+    }
+    for (i = 0; i < num_objs; i++)
+        oids[i] = objs[i].oid;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_objs; i++)
+        ch_placement_find_closest(instance, objs[i].oid, replication,
+                                  oid_server_idxs(&objs[i]));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    single_ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+                 (end.tv_nsec - start.tv_nsec)) / num_objs;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ch_placement_find_closest_batch(instance, oids, num_objs, replication,
+                                    server_idxs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    batch_ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+                (end.tv_nsec - start.tv_nsec)) / num_objs;
+
+    printf("# <objects> <replication> <ns/object single> <ns/object batch>\n");
+    printf("%u\t%u\t%.1f\t%.1f\n", num_objs, replication, single_ns, batch_ns);
+
+    free(oids);
+    free(server_idxs);
+    return (0);
+}
+
+/* builds the placement table serially and in parallel, reports the time
+ * each took, and checks that both place num_objs random objects on the
+ * same servers
+ */
+static int time_builds(struct options *ig_opts)
+{
+    struct ch_placement_instance *serial, *parallel;
+    struct timespec start, end;
+    double serial_s, parallel_s;
+    char params[64];
+    unsigned long serial_idxs[ig_opts->replication];
+    unsigned long parallel_idxs[ig_opts->replication];
+    unsigned long mismatches = 0;
+    uint64_t oid;
+    unsigned int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    serial = ch_placement_initialize_params(ig_opts->placement,
+        ig_opts->num_servers, ig_opts->virt_factor, 0, "build:serial");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    serial_s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    sprintf(params, "build:parallel,build_threads:%u", ig_opts->threads);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    parallel = ch_placement_initialize_params(ig_opts->placement,
+        ig_opts->num_servers, ig_opts->virt_factor, 0, params);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    parallel_s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (!serial || !parallel)
+    {
+        fprintf(stderr, "Error: %s does not support parallel builds\n",
+            ig_opts->placement);
+        if (serial)
+            ch_placement_finalize(serial);
+        if (parallel)
+            ch_placement_finalize(parallel);
+        return (-1);
+    }
+
+    srandom(8675309);
+    for (i = 0; i < ig_opts->num_objs; i++)
+    {
+        oid = ch_placement_random_u64();
+        ch_placement_find_closest(serial, oid, ig_opts->replication,
+                                  serial_idxs);
+        ch_placement_find_closest(parallel, oid, ig_opts->replication,
+                                  parallel_idxs);
+        if (memcmp(serial_idxs, parallel_idxs, sizeof(serial_idxs)) != 0)
+            mismatches++;
+    }
+
+    printf("# <vnodes> <serial build s> <parallel build s> <mismatches>\n");
+    printf("%lu\t%f\t%f\t%lu\n",
+           (unsigned long)ig_opts->num_servers * ig_opts->virt_factor,
+           serial_s, parallel_s, mismatches);
+
+    ch_placement_finalize(serial);
+    ch_placement_finalize(parallel);
+    return (mismatches ? -1 : 0);
+}
+
 static int comb_cmp(const void *a, const void *b)
 {
     unsigned long au = ((struct comb_stats *)a)->count;
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+void check_usage(const char *exename, const char *extra)
+{
+    fprintf(stderr, "Usage: %s <module> <n_svrs> <virt_factor> <n_objs> <replication_factor>%s%s\n",
+        exename, extra[0] ? " " : "", extra);
+    return;
+}
+
+int check_parse_args(int argc, char **argv, const char *extra,
+    int min_extra, int max_extra, struct check_args *args)
+{
+    if(argc < 6 + min_extra || argc > 6 + max_extra ||
+        sscanf(argv[2], "%u", &args->n_svrs) != 1 ||
+        sscanf(argv[3], "%u", &args->virt_factor) != 1 ||
+        sscanf(argv[4], "%lu", &args->n_objs) != 1 ||
+        sscanf(argv[5], "%u", &args->replication) != 1)
+    {
+        check_usage(argv[0], extra);
+        return(-1);
+    }
+    args->module = argv[1];
+    args->extra = &argv[6];
+    args->n_extra = argc - 6;
+
+    return(0);
+}
+
+double check_wtime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec/1000000000.0);
+}
+
+uint64_t* check_random_oids(unsigned long n_objs)
+{
+    uint64_t *oids;
+    unsigned long i;
+
+    oids = malloc(n_objs*sizeof(*oids));
+    if(!oids)
+        return(NULL);
+
+    srandom(8675309);
+    for(i=0; i<n_objs; i++)
+        oids[i] = ch_placement_random_u64();
+
+    return(oids);
+}
+
+unsigned long check_batch(struct ch_placement_instance *inst,
+    const uint64_t *oids, unsigned long n_objs, unsigned int replication,
+    unsigned long *idxs)
+{
+    unsigned long single_idxs[CHECK_REPLICATION_MAX];
+    unsigned long mismatches = 0;
+    unsigned long i;
+
+    ch_placement_find_closest_batch(inst, oids, n_objs, replication, idxs);
+    for(i=0; i<n_objs; i++)
+    {
+        ch_placement_find_closest(inst, oids[i], replication, single_idxs);
+        if(memcmp(single_idxs, &idxs[i*replication],
+            replication*sizeof(*single_idxs)) != 0)
+        {
+            fprintf(stderr, "Error: batched placement of oid %lu differs\n",
+                (unsigned long)oids[i]);
+            mismatches++;
+        }
+    }
+
+    return(mismatches);
+}
+
+unsigned long check_compare(const char *what, const uint64_t *oids,
+    unsigned long n_objs, unsigned int replication,
+    const unsigned long *a_idxs, const unsigned long *b_idxs)
+{
+    unsigned long i;
+    unsigned long mismatches = 0;
+
+    for(i=0; i<n_objs; i++)
+    {
+        if(memcmp(&a_idxs[i*replication], &b_idxs[i*replication],
+            replication*sizeof(*a_idxs)) != 0)
+        {
+            fprintf(stderr, "Error: %s placement of oid %lu differs\n",
+                what, (unsigned long)oids[i]);
+            mismatches++;
+        }
+    }
+
+    return(mismatches);
+}
+
+struct ch_placement_arc* check_find_arc(struct ch_placement_arc *arcs,
+    unsigned long n_arcs, uint64_t oid)
+{
+    unsigned long i;
+    struct ch_placement_arc *arc;
+
+    for(i=0; i<n_arcs; i++)
+    {
+        arc = &arcs[i];
+        if(oid % arc->n_rings != arc->ring)
+            continue;
+        if(arc->start <= arc->end)
+        {
+            if(oid >= arc->start && oid <= arc->end)
+                return(arc);
+        }
+        else if(oid >= arc->start || oid <= arc->end)
+            return(arc);
+    }
+
+    return(NULL);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef CH_PLACEMENT_CHECK_H
+#define CH_PLACEMENT_CHECK_H
+
+/* helpers shared by the ch-placement-*-check programs that "make check"
+ * runs; not part of the library
+ */
+
+#include <stdint.h>
+
+#include "ch-placement.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* widest replication the check programs keep on the stack */
+#define CHECK_REPLICATION_MAX 16
+
+/* the arguments every check program starts with:
+ * <module> <n_svrs> <virt_factor> <n_objs> <replication_factor>
+ */
+struct check_args
+{
+    const char *module;
+    unsigned int n_svrs;
+    unsigned int virt_factor;
+    unsigned long n_objs;
+    unsigned int replication;
+    char **extra;   /* the program's own arguments that follow */
+    int n_extra;
+};
+
+/* prints the usage line, with the program's own arguments in extra */
+void check_usage(const char *exename, const char *extra);
+
+/* parses the shared arguments, which must be followed by between
+ * min_extra and max_extra more; prints the usage line and returns -1 if
+ * they are not valid
+ */
+int check_parse_args(int argc, char **argv, const char *extra,
+    int min_extra, int max_extra, struct check_args *args);
+
+/* monotonic wall clock time in seconds */
+double check_wtime(void);
+
+/* n_objs random oids from random() with a fixed seed, so that every run
+ * checks the same objects; returns NULL if they cannot be allocated
+ */
+uint64_t* check_random_oids(unsigned long n_objs);
+
+/* places the oids with one batched lookup into idxs (a flat
+ * n_objs x replication matrix) and compares every row with a single
+ * lookup, for replication up to CHECK_REPLICATION_MAX; returns the number
+ * of objects that differ
+ */
+unsigned long check_batch(struct ch_placement_instance *inst,
+    const uint64_t *oids, unsigned long n_objs, unsigned int replication,
+    unsigned long *idxs);
+
+/* compares two placement matrices; returns the number of objects that
+ * differ, reporting each one under what
+ */
+unsigned long check_compare(const char *what, const uint64_t *oids,
+    unsigned long n_objs, unsigned int replication,
+    const unsigned long *a_idxs, const unsigned long *b_idxs);
+
+/* returns the arc covering oid, or NULL */
+struct ch_placement_arc* check_find_arc(struct ch_placement_arc *arcs,
+    unsigned long n_arcs, uint64_t oid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CH_PLACEMENT_CHECK_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
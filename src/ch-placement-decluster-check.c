@@ -80,19 +80,20 @@ int main(
 #pragma omp parallel for
     for(i=0; i<ig_opts->num_objs; i++)
     {
-        ch_placement_find_closest(instance, total_objs[i].oid, ig_opts->replication+1, total_objs[i].server_idxs);
+        ch_placement_find_closest(instance, total_objs[i].oid, ig_opts->replication+1, oid_server_idxs(&total_objs[i]));
     }
     printf("# Done.\n");
 
 #pragma omp parallel for
     for(i=0; i<ig_opts->num_objs; i++)
     {
+        unsigned long *server_idxs = oid_server_idxs(&total_objs[i]);
         int j;
         for(j=0; j<ig_opts->replication; j++)
         {
-            if(total_objs[i].server_idxs[j] == ig_opts->kill_svr)
+            if(server_idxs[j] == ig_opts->kill_svr)
             {
-                replica_targets[total_objs[i].server_idxs[ig_opts->replication]]++;
+                replica_targets[server_idxs[ig_opts->replication]]++;
                 break;
             }
         }
@@ -198,8 +199,6 @@ static struct options *parse_args(int argc, char *argv[])
     if(opts->kill_svr >= opts->num_servers)
         return(NULL);
 
-    assert((opts->replication+1) <= CH_MAX_REPLICATION);
-
     return(opts);
 }
 
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This checks that removing a server disrupts placement minimally, for
+ * modules that support ch_placement_remove_server().  For a
+ * set of random object ids it removes a few servers one at a time and
+ * verifies that:
+ * - objects that did not use the removed server keep all of their replicas,
+ * - objects that did keep the rest of their replicas in the same order,
+ *   followed by one new server, and
+ * - adding the server back restores the original placement, and reports
+ *   arcs or CH_PLACEMENT_NO_ARCS with an empty list.
+ * It also reports how evenly the primary replicas are spread.
+ *
+ * Modules that only bound the disruption (like maglev) can be checked by
+ * also giving max_extra, the fraction of the objects that may move even
+ * though the removed server did not hold any of their replicas.  Moved
+ * objects then only need distinct replicas that avoid the removed server.
+ */
+
+/* ch-placement-disruption-check <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> [params [max_extra]]
+ */
+
+#define EXTRA_USAGE "[params [max_extra]]"
+
+/* checks one object's replicas after victim was removed.  If bounded is
+ * set, the surviving replicas may also move.
+ */
+static int check_object(const unsigned long *before, const unsigned long *after,
+    unsigned int replication, unsigned long victim, int bounded)
+{
+    unsigned int i, j;
+
+    for(i=0, j=0; i<replication; i++)
+    {
+        if(before[i] == victim)
+            continue;
+        if(!bounded && after[j++] != before[i])
+            return(-1);
+    }
+    /* anything left over is new */
+    for(; j<replication; j++)
+    {
+        if(after[j] == victim)
+            return(-1);
+        for(i=0; i<replication; i++)
+            if(i != j && after[i] == after[j])
+                return(-1);
+    }
+
+    return(0);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    struct check_args args;
+    struct ch_placement_instance *inst;
+    char *params = NULL;
+    uint64_t *oids;
+    unsigned long *idxs;
+    unsigned long *after_idxs;
+    unsigned long *loads;
+    unsigned long victims[3];
+    unsigned long i, max_load;
+    unsigned long moved, extra;
+    struct ch_placement_arc *arcs;
+    unsigned long n_arcs;
+    unsigned long mismatches = 0;
+    double max_extra = -1;
+    unsigned int v;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 0, 2, &args) < 0)
+        return(-1);
+    if(args.n_extra >= 1)
+        params = args.extra[0];
+    if(args.n_extra == 2)
+    {
+        ret = sscanf(args.extra[1], "%lf", &max_extra);
+        if(ret != 1 || max_extra < 0)
+        {
+            check_usage(argv[0], EXTRA_USAGE);
+            return(-1);
+        }
+    }
+    if(args.replication > CHECK_REPLICATION_MAX ||
+        args.replication + 1 > args.n_svrs)
+    {
+        fprintf(stderr, "Error: replication level must be at most %d and less than the number of servers\n",
+            CHECK_REPLICATION_MAX);
+        return(-1);
+    }
+
+    /**************************/
+
+    inst = ch_placement_initialize_params(args.module, args.n_svrs,
+        args.virt_factor, 0, params);
+    if(!inst)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+        return(-1);
+    }
+
+    oids = check_random_oids(args.n_objs);
+    idxs = malloc(args.n_objs*args.replication*sizeof(*idxs));
+    after_idxs = malloc(args.n_objs*args.replication*sizeof(*after_idxs));
+    loads = calloc(args.n_svrs, sizeof(*loads));
+    if(!oids || !idxs || !after_idxs || !loads)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    mismatches += check_batch(inst, oids, args.n_objs, args.replication, idxs);
+
+    max_load = 0;
+    for(i=0; i<args.n_objs; i++)
+    {
+        loads[idxs[i*args.replication]]++;
+        if(loads[idxs[i*args.replication]] > max_load)
+            max_load = loads[idxs[i*args.replication]];
+    }
+    printf("# primary load: max %lu, mean %f\n", max_load,
+        (double)args.n_objs / args.n_svrs);
+
+    victims[0] = 0;
+    victims[1] = args.n_svrs / 2;
+    victims[2] = args.n_svrs - 1;
+    for(v=0; v<3; v++)
+    {
+        if(ch_placement_remove_server(inst, victims[v], NULL, NULL) < 0)
+        {
+            fprintf(stderr, "Error: %s does not support removing servers\n",
+                args.module);
+            return(-1);
+        }
+        mismatches += check_batch(inst, oids, args.n_objs, args.replication,
+            after_idxs);
+        moved = 0;
+        extra = 0;
+        for(i=0; i<args.n_objs; i++)
+        {
+            if(after_idxs[i*args.replication] != idxs[i*args.replication])
+            {
+                moved++;
+                if(idxs[i*args.replication] != victims[v])
+                    extra++;
+            }
+            if(check_object(&idxs[i*args.replication],
+                &after_idxs[i*args.replication], args.replication,
+                victims[v], max_extra >= 0) < 0)
+            {
+                fprintf(stderr, "Error: oid %lu moved more than necessary after removing server %lu\n",
+                    (unsigned long)oids[i], victims[v]);
+                mismatches++;
+            }
+        }
+        printf("# remove server %lu: %lu of %lu primaries moved (server held %lu)\n",
+            victims[v], moved, args.n_objs, loads[victims[v]]);
+        if(max_extra >= 0)
+        {
+            if(extra > max_extra * args.n_objs)
+            {
+                fprintf(stderr, "Error: %lu primaries moved that were not on server %lu\n",
+                    extra, victims[v]);
+                mismatches++;
+            }
+        }
+        else if(moved != loads[victims[v]])
+        {
+            fprintf(stderr, "Error: primaries moved that were not on server %lu\n",
+                victims[v]);
+            mismatches++;
+        }
+
+        /* set to garbage, to see that the module clears them */
+        arcs = (void*)loads;
+        n_arcs = 1;
+        ret = ch_placement_add_server(inst, victims[v], &arcs, &n_arcs);
+        if(ret < 0)
+        {
+            fprintf(stderr, "Error: failed to add server %lu back\n",
+                victims[v]);
+            return(-1);
+        }
+        if(ret == CH_PLACEMENT_NO_ARCS && (arcs || n_arcs))
+        {
+            fprintf(stderr, "Error: adding server %lu back left arcs set without reporting any\n",
+                victims[v]);
+            mismatches++;
+        }
+        else if(ret != CH_PLACEMENT_NO_ARCS)
+            free(arcs);
+        mismatches += check_batch(inst, oids, args.n_objs, args.replication,
+            after_idxs);
+        if(memcmp(idxs, after_idxs,
+            args.n_objs*args.replication*sizeof(*idxs)) != 0)
+        {
+            fprintf(stderr, "Error: adding server %lu back did not restore the placement\n",
+                victims[v]);
+            mismatches++;
+        }
+    }
+
+    printf("# %lu mismatches\n", mismatches);
+
+    ch_placement_finalize(inst);
+    free(oids);
+    free(idxs);
+    free(after_idxs);
+    free(loads);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This checks placement handles.  Reader threads look up a set of random
+ * object ids through a handle while a writer thread repeatedly publishes
+ * new instances that alternate between <n_svrs> and <n_svrs>-1 servers.
+ * It verifies that every batch of lookups places all of its objects
+ * exactly like one of the two memberships (a batch never sees a mix of
+ * instances or a finalized one), and reports the lookup latency with and
+ * without publishes going on.
+ */
+
+/* ch-placement-handle-check <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> <n_publishes> [params]
+ */
+
+#define EXTRA_USAGE "<n_publishes> [params]"
+#define N_THREADS 4
+#define BATCH 64
+
+/* looks up every oid through the handle once, a batch at a time; returns
+ * the number of lookups that match neither membership
+ */
+static unsigned long lookup_round(struct ch_placement_handle *handle,
+    uint64_t *oids, unsigned long n_objs, unsigned int replication,
+    unsigned long *ref_idxs[2], unsigned long *idxs)
+{
+    unsigned long single_idxs[CHECK_REPLICATION_MAX];
+    unsigned long mismatches = 0;
+    unsigned long i, n;
+    size_t len;
+
+    for(i=0; i<n_objs; i+=BATCH)
+    {
+        n = n_objs - i < BATCH ? n_objs - i : BATCH;
+        len = n*replication*sizeof(*idxs);
+        ch_placement_handle_find_closest_batch(handle, &oids[i], n,
+            replication, idxs);
+        if(memcmp(idxs, &ref_idxs[0][i*replication], len) != 0 &&
+            memcmp(idxs, &ref_idxs[1][i*replication], len) != 0)
+        {
+            fprintf(stderr, "Error: batch at oid %lu matches neither membership\n",
+                (unsigned long)oids[i]);
+            mismatches++;
+        }
+
+        ch_placement_handle_find_closest(handle, oids[i], replication,
+            single_idxs);
+        if(memcmp(single_idxs, &ref_idxs[0][i*replication],
+            replication*sizeof(*idxs)) != 0 &&
+            memcmp(single_idxs, &ref_idxs[1][i*replication],
+            replication*sizeof(*idxs)) != 0)
+        {
+            fprintf(stderr, "Error: oid %lu matches neither membership\n",
+                (unsigned long)oids[i]);
+            mismatches++;
+        }
+    }
+
+    return(mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    struct check_args args;
+    unsigned n_publishes;
+    struct ch_placement_instance *inst;
+    struct ch_placement_handle *handle = NULL;
+    char *params = NULL;
+    uint64_t *oids;
+    unsigned long *ref_idxs[2];
+    unsigned long *idxs;
+    unsigned long i;
+    unsigned long mismatches = 0;
+    unsigned long rounds = 0;
+    int done = 0;
+    int failed = 0;
+    double quiet_time, churn_time;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 1, 2, &args) < 0)
+        return(-1);
+    ret = sscanf(args.extra[0], "%u", &n_publishes);
+    if(ret != 1)
+    {
+        check_usage(argv[0], EXTRA_USAGE);
+        return(-1);
+    }
+    if(args.n_extra == 2)
+        params = args.extra[1];
+    if(args.replication > CHECK_REPLICATION_MAX ||
+        args.replication + 1 > args.n_svrs)
+    {
+        fprintf(stderr, "Error: replication level must be at most %d and less than the number of servers\n",
+            CHECK_REPLICATION_MAX);
+        return(-1);
+    }
+
+    /**************************/
+
+    oids = check_random_oids(args.n_objs);
+    ref_idxs[0] = malloc(args.n_objs*args.replication*sizeof(*ref_idxs[0]));
+    ref_idxs[1] = malloc(args.n_objs*args.replication*sizeof(*ref_idxs[1]));
+    idxs = malloc(BATCH*args.replication*sizeof(*idxs));
+    if(!oids || !ref_idxs[0] || !ref_idxs[1] || !idxs)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    /* placements for both memberships */
+    for(i=0; i<2; i++)
+    {
+        inst = ch_placement_initialize_params(args.module, args.n_svrs-i,
+            args.virt_factor, 0, params);
+        if(!inst)
+        {
+            fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+            return(-1);
+        }
+        ch_placement_find_closest_batch(inst, oids, args.n_objs,
+            args.replication, ref_idxs[i]);
+        if(i == 0)
+            handle = ch_placement_handle_create(inst);
+        else
+            ch_placement_finalize(inst);
+    }
+    if(!handle)
+    {
+        fprintf(stderr, "Error: failed to create handle\n");
+        return(-1);
+    }
+
+    quiet_time = check_wtime();
+    mismatches += lookup_round(handle, oids, args.n_objs, args.replication,
+        ref_idxs, idxs);
+    quiet_time = check_wtime() - quiet_time;
+
+    /* thread 0 publishes while the others look up; without OpenMP the one
+     * thread alternates between the two
+     */
+    churn_time = check_wtime();
+#pragma omp parallel num_threads(N_THREADS) reduction(+:mismatches,rounds)
+    {
+        unsigned long *my_idxs;
+        struct ch_placement_instance *next;
+        int t = 0, nt = 1;
+        unsigned int k;
+
+#ifdef _OPENMP
+        t = omp_get_thread_num();
+        nt = omp_get_num_threads();
+#endif
+        my_idxs = malloc(BATCH*args.replication*sizeof(*my_idxs));
+        if(!my_idxs)
+            __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+
+        if(t == 0)
+        {
+            for(k=0; k<n_publishes && my_idxs; k++)
+            {
+                next = ch_placement_initialize_params(args.module,
+                    args.n_svrs - (k+1)%2, args.virt_factor, 0, params);
+                if(!next)
+                {
+                    __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+                    break;
+                }
+                ch_placement_handle_publish(handle, next);
+                if(nt == 1)
+                {
+                    mismatches += lookup_round(handle, oids, args.n_objs,
+                        args.replication, ref_idxs, my_idxs);
+                    rounds++;
+                }
+            }
+            __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            do
+            {
+                if(!my_idxs)
+                    break;
+                mismatches += lookup_round(handle, oids, args.n_objs,
+                    args.replication, ref_idxs, my_idxs);
+                rounds++;
+            } while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE));
+        }
+        free(my_idxs);
+    }
+    churn_time = check_wtime() - churn_time;
+
+    if(failed)
+    {
+        fprintf(stderr, "Error: failed to build an instance to publish\n");
+        return(-1);
+    }
+
+    printf("# %u publishes, %lu lookup rounds of %lu objects\n",
+        n_publishes, rounds, args.n_objs);
+    printf("# without publishes: %f us/object\n",
+        quiet_time * 1000000.0 / args.n_objs);
+    if(rounds)
+        printf("# during publishes: %f us/object\n",
+            churn_time * 1000000.0 / args.n_objs / rounds);
+    printf("# %lu mismatches\n", mismatches);
+
+    ch_placement_handle_destroy(handle);
+    free(oids);
+    free(ref_idxs[0]);
+    free(ref_idxs[1]);
+    free(idxs);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "ch-placement.h"
+
+/* Handles use a read-copy-update scheme.  Readers announce themselves by
+ * incrementing a counter for the parity of the current epoch, then load
+ * the instance pointer; nothing on the read side blocks.  A publisher swaps
+ * the pointer, advances the epoch so that new readers count under the
+ * other parity, and waits for the counters of the old parity to drain
+ * before finalizing the old instance.
+ *
+ * A reader that loaded the epoch just before a publisher advanced it could
+ * increment the old parity after the publisher has already looked at it,
+ * so readers check the epoch again after incrementing and retry if it
+ * moved; a reader that passes that check was counted before the publisher
+ * started waiting.  Publishers are serialized, so only two parities are
+ * ever in use.
+ *
+ * The counters are spread over cache line sized slots, one per thread
+ * (modulo HANDLE_SLOTS), so that readers on different cores do not bounce
+ * a shared line on every lookup.
+ */
+
+#define HANDLE_SLOTS 64
+#define HANDLE_LINE 64
+
+struct handle_slot
+{
+    unsigned long readers[2];
+    char pad[HANDLE_LINE - 2*sizeof(unsigned long)];
+};
+
+struct ch_placement_handle
+{
+    struct handle_slot slots[HANDLE_SLOTS];
+    struct ch_placement_instance *current;
+    uint64_t epoch;
+    char publishing;
+};
+
+static unsigned int next_slot = 0;
+static __thread int my_slot = -1;
+
+static unsigned int handle_slot(void)
+{
+    if(my_slot < 0)
+        my_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) %
+            HANDLE_SLOTS;
+    return(my_slot);
+}
+
+struct ch_placement_handle* ch_placement_handle_create(
+    struct ch_placement_instance *instance)
+{
+    struct ch_placement_handle *handle;
+    void *mem;
+
+    if(posix_memalign(&mem, HANDLE_LINE, sizeof(*handle)) != 0)
+        return(NULL);
+    handle = mem;
+    memset(handle, 0, sizeof(*handle));
+    handle->current = instance;
+
+    return(handle);
+}
+
+void ch_placement_handle_destroy(struct ch_placement_handle *handle)
+{
+    ch_placement_finalize(handle->current);
+    free(handle);
+    return;
+}
+
+struct ch_placement_instance* ch_placement_handle_acquire(
+    struct ch_placement_handle *handle,
+    unsigned int *token)
+{
+    unsigned int slot = handle_slot();
+    unsigned long *readers;
+    uint64_t epoch;
+
+    for(;;)
+    {
+        epoch = __atomic_load_n(&handle->epoch, __ATOMIC_SEQ_CST);
+        readers = &handle->slots[slot].readers[epoch & 1];
+        __atomic_fetch_add(readers, 1, __ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&handle->epoch, __ATOMIC_SEQ_CST) == epoch)
+            break;
+        /* a publisher advanced the epoch in between; it may not have seen
+         * this reader, so count under the new parity instead
+         */
+        __atomic_fetch_sub(readers, 1, __ATOMIC_RELEASE);
+    }
+
+    *token = slot*2 + (epoch & 1);
+    return(__atomic_load_n(&handle->current, __ATOMIC_SEQ_CST));
+}
+
+void ch_placement_handle_release(
+    struct ch_placement_handle *handle,
+    unsigned int token)
+{
+    __atomic_fetch_sub(&handle->slots[token/2].readers[token%2], 1,
+        __ATOMIC_RELEASE);
+    return;
+}
+
+void ch_placement_handle_publish(
+    struct ch_placement_handle *handle,
+    struct ch_placement_instance *instance)
+{
+    struct ch_placement_instance *old;
+    unsigned int parity;
+    unsigned int i;
+
+    while(__atomic_test_and_set(&handle->publishing, __ATOMIC_ACQUIRE))
+        sched_yield();
+
+    old = __atomic_exchange_n(&handle->current, instance, __ATOMIC_SEQ_CST);
+    parity = handle->epoch & 1;
+    __atomic_store_n(&handle->epoch, handle->epoch + 1, __ATOMIC_SEQ_CST);
+
+    /* grace period: every reader that may hold old is counted under the
+     * old parity
+     */
+    for(i=0; i<HANDLE_SLOTS; i++)
+    {
+        while(__atomic_load_n(&handle->slots[i].readers[parity],
+            __ATOMIC_ACQUIRE) != 0)
+            sched_yield();
+    }
+
+    __atomic_clear(&handle->publishing, __ATOMIC_RELEASE);
+
+    ch_placement_finalize(old);
+    return;
+}
+
+void ch_placement_handle_find_closest(
+    struct ch_placement_handle *handle,
+    uint64_t obj,
+    unsigned int replication,
+    unsigned long* server_idxs)
+{
+    struct ch_placement_instance *instance;
+    unsigned int token;
+
+    instance = ch_placement_handle_acquire(handle, &token);
+    ch_placement_find_closest(instance, obj, replication, server_idxs);
+    ch_placement_handle_release(handle, token);
+
+    return;
+}
+
+void ch_placement_handle_find_closest_batch(
+    struct ch_placement_handle *handle,
+    const uint64_t *objs,
+    unsigned long n_objs,
+    unsigned int replication,
+    unsigned long* server_idxs)
+{
+    struct ch_placement_instance *instance;
+    unsigned int token;
+
+    instance = ch_placement_handle_acquire(handle, &token);
+    ch_placement_find_closest_batch(instance, objs, n_objs, replication,
+        server_idxs);
+    ch_placement_handle_release(handle, token);
+
+    return;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This checks placement with bounded loads.  It places a set of random
+ * object ids one at a time, adding one to the load of each replica's
+ * server as it goes, and verifies that:
+ * - an object stays on its usual primary server whenever that server is
+ *   below its capacity,
+ * - no server ends up above load_factor times its weighted share of the
+ *   total load (rounded up),
+ * - batched lookups match single lookups under the same loads, and
+ * - a removed server gets nothing more, and its load cannot be set.
+ * It also reports the maximum load without the bound for comparison.
+ * weights, if given, is a colon separated list (e.g. "4:1:1:1") that is
+ * repeated across the servers; otherwise all servers weigh the same.
+ */
+
+/* ch-placement-load-check <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> <load_factor> [params [weights]]
+ */
+
+#define EXTRA_USAGE "<load_factor> [params [weights]]"
+/* batched lookups are compared with single ones for this many objects */
+#define BATCH_CHECK_OBJS 1000
+
+/* fills in the weight of each server from a list like "4:1:1:1"; returns
+ * -1 if the list is malformed
+ */
+static int parse_weights(const char *list, double *weights, unsigned int n_svrs)
+{
+    double classes[64];
+    unsigned int n_classes = 0;
+    unsigned int i;
+    int len;
+
+    while(n_classes < 64 && sscanf(list, "%lf%n", &classes[n_classes], &len) == 1)
+    {
+        if(!(classes[n_classes] >= 0))
+            return(-1);
+        n_classes++;
+        list += len;
+        if(*list != ':')
+            break;
+        list++;
+    }
+    if(n_classes == 0 || *list != '\0')
+        return(-1);
+
+    for(i=0; i<n_svrs; i++)
+        weights[i] = classes[i % n_classes];
+
+    return(0);
+}
+
+/* capacity of server svr, counting the object about to be placed.  The
+ * weighted share is rounded in floating point, so this gives the benefit
+ * of the doubt to a capacity that lands on a whole number.
+ */
+static unsigned long capacity(double load_factor, unsigned long total_load,
+    const double *weights, double total_weight, unsigned long svr)
+{
+    return(ceil(load_factor * (total_load + 1) / total_weight * weights[svr] *
+        (1 - 1e-9)));
+}
+
+/* places the oids one at a time, updating the loads; returns the number of
+ * errors
+ */
+static unsigned long place(struct ch_placement_instance *inst,
+    struct ch_placement_instance *plain, uint64_t *oids, unsigned long n_objs,
+    unsigned int replication, double load_factor, const double *weights,
+    double total_weight, unsigned long *total_load,
+    unsigned long *plain_loads, long removed)
+{
+    unsigned long idxs[CHECK_REPLICATION_MAX];
+    unsigned long plain_idxs[CHECK_REPLICATION_MAX];
+    unsigned long errors = 0;
+    unsigned long load;
+    unsigned long i;
+    unsigned int j;
+
+    for(i=0; i<n_objs; i++)
+    {
+        ch_placement_find_closest(inst, oids[i], replication, idxs);
+        ch_placement_find_closest(plain, oids[i], 1, plain_idxs);
+        ch_placement_get_load(inst, plain_idxs[0], &load);
+        if(load < capacity(load_factor, *total_load, weights, total_weight,
+            plain_idxs[0]) && idxs[0] != plain_idxs[0])
+        {
+            fprintf(stderr, "Error: oid %lu moved off server %lu, which was below capacity\n",
+                (unsigned long)oids[i], plain_idxs[0]);
+            errors++;
+        }
+        plain_loads[plain_idxs[0]]++;
+
+        for(j=0; j<replication; j++)
+        {
+            if((long)idxs[j] == removed)
+            {
+                fprintf(stderr, "Error: oid %lu placed on removed server %ld\n",
+                    (unsigned long)oids[i], removed);
+                errors++;
+                continue;
+            }
+            if(ch_placement_get_load(inst, idxs[j], &load) < 0 ||
+                ch_placement_set_load(inst, idxs[j], load + 1) < 0)
+            {
+                fprintf(stderr, "Error: failed to update the load of server %lu\n",
+                    idxs[j]);
+                return(errors + 1);
+            }
+            (*total_load)++;
+        }
+    }
+
+    return(errors);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    struct check_args args;
+    double load_factor;
+    struct ch_placement_instance *inst, *plain;
+    char *params = NULL;
+    char *bounded_params;
+    double *weights;
+    double total_weight = 0;
+    uint64_t *oids;
+    unsigned long *idxs;
+    unsigned long *plain_loads;
+    unsigned long *plain_idxs;
+    unsigned long i, load, max_plain, bound;
+    unsigned long n_batch;
+    double max_ratio;
+    unsigned long total_load = 0;
+    unsigned long mismatches = 0;
+    unsigned long removed;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 1, 3, &args) < 0)
+        return(-1);
+    ret = sscanf(args.extra[0], "%lf", &load_factor);
+    if(ret != 1)
+    {
+        check_usage(argv[0], EXTRA_USAGE);
+        return(-1);
+    }
+    if(args.n_extra >= 2 && args.extra[1][0] != '\0')
+        params = args.extra[1];
+    if(args.replication > CHECK_REPLICATION_MAX ||
+        args.replication + 1 > args.n_svrs)
+    {
+        fprintf(stderr, "Error: replication level must be at most %d and less than the number of servers\n",
+            CHECK_REPLICATION_MAX);
+        return(-1);
+    }
+
+    weights = malloc(args.n_svrs*sizeof(*weights));
+    if(!weights)
+    {
+        perror("malloc");
+        return(-1);
+    }
+    if(parse_weights(args.n_extra == 3 ? args.extra[2] : "1", weights,
+        args.n_svrs) < 0)
+    {
+        check_usage(argv[0], EXTRA_USAGE);
+        return(-1);
+    }
+    for(i=0; i<args.n_svrs; i++)
+        total_weight += weights[i];
+
+    /**************************/
+
+    bounded_params = malloc(64 + (params ? strlen(params) : 0));
+    if(!bounded_params)
+    {
+        perror("malloc");
+        return(-1);
+    }
+    sprintf(bounded_params, "bounded_load:%f%s%s", load_factor,
+        params ? "," : "", params ? params : "");
+
+    inst = ch_placement_initialize_weighted(args.module, args.n_svrs,
+        args.virt_factor, 0, weights, bounded_params);
+    plain = ch_placement_initialize_weighted(args.module, args.n_svrs,
+        args.virt_factor, 0, weights, params);
+    if(!inst || !plain)
+    {
+        fprintf(stderr, "Error: failed to initialize %s with %s\n", args.module,
+            bounded_params);
+        return(-1);
+    }
+
+    oids = check_random_oids(args.n_objs);
+    idxs = malloc(args.n_objs*args.replication*sizeof(*idxs));
+    plain_idxs = malloc(args.n_objs*args.replication*sizeof(*plain_idxs));
+    plain_loads = calloc(args.n_svrs, sizeof(*plain_loads));
+    if(!oids || !idxs || !plain_idxs || !plain_loads)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    /* with no load anywhere the bound changes nothing */
+    n_batch = args.n_objs < BATCH_CHECK_OBJS ? args.n_objs : BATCH_CHECK_OBJS;
+    mismatches += check_batch(inst, oids, n_batch, args.replication, idxs);
+    check_batch(plain, oids, n_batch, args.replication, plain_idxs);
+    if(memcmp(idxs, plain_idxs,
+        n_batch*args.replication*sizeof(*idxs)) != 0)
+    {
+        fprintf(stderr, "Error: placement with no load differs from %s\n",
+            args.module);
+        mismatches++;
+    }
+
+    /* fill the servers up */
+    mismatches += place(inst, plain, oids, args.n_objs/2, args.replication,
+        load_factor, weights, total_weight, &total_load, plain_loads, -1);
+    mismatches += check_batch(inst, oids, n_batch, args.replication, idxs);
+
+    /* loads relative to each server's weighted share */
+    max_ratio = 0;
+    max_plain = 0;
+    for(i=0; i<args.n_svrs; i++)
+    {
+        ch_placement_get_load(inst, i, &load);
+        if(weights[i] == 0)
+        {
+            if(load != 0)
+            {
+                fprintf(stderr, "Error: server %lu without weight has load %lu\n",
+                    i, load);
+                mismatches++;
+            }
+            continue;
+        }
+        bound = ceil(load_factor * total_load / total_weight * weights[i] *
+            (1 + 1e-9));
+        if(load > bound)
+        {
+            fprintf(stderr, "Error: server %lu load %lu is above its bound %lu\n",
+                i, load, bound);
+            mismatches++;
+        }
+        if(load / (total_load / total_weight * weights[i]) > max_ratio)
+            max_ratio = load / (total_load / total_weight * weights[i]);
+        if(plain_loads[i] > max_plain)
+            max_plain = plain_loads[i];
+    }
+    printf("# %lu replicas: max load %f times the server's share (bound %f); primaries without the bound: max %lu, mean %f\n",
+        total_load, max_ratio, load_factor, max_plain,
+        (double)(args.n_objs/2) / args.n_svrs);
+
+    /* the rest of the objects avoid a removed server */
+    for(removed = args.n_svrs / 2; weights[removed] == 0; removed++);
+    ch_placement_get_load(inst, removed, &load);
+    total_load -= load;
+    if(ch_placement_remove_server(inst, removed, NULL, NULL) < 0 ||
+        ch_placement_remove_server(plain, removed, NULL, NULL) < 0)
+    {
+        fprintf(stderr, "Error: failed to remove server %lu\n", removed);
+        return(-1);
+    }
+    ch_placement_get_load(inst, removed, &load);
+    if(load != 0)
+    {
+        fprintf(stderr, "Error: removed server %lu still has load %lu\n",
+            removed, load);
+        mismatches++;
+    }
+    if(ch_placement_set_load(inst, removed, 1) == 0)
+    {
+        fprintf(stderr, "Error: the load of removed server %lu was set\n",
+            removed);
+        mismatches++;
+    }
+    total_weight -= weights[removed];
+    weights[removed] = 0;
+    mismatches += place(inst, plain, &oids[args.n_objs/2],
+        args.n_objs - args.n_objs/2, args.replication, load_factor, weights,
+        total_weight, &total_load, plain_loads, removed);
+    mismatches += check_batch(inst, oids, n_batch, args.replication, idxs);
+
+    printf("# %lu mismatches\n", mismatches);
+
+    ch_placement_finalize(inst);
+    ch_placement_finalize(plain);
+    free(bounded_params);
+    free(weights);
+    free(oids);
+    free(idxs);
+    free(plain_idxs);
+    free(plain_loads);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -28,7 +28,7 @@ int main(int argc, char **argv)
     uint64_t oid;
     unsigned replication_factor;
     struct ch_placement_instance *inst;
-    unsigned long server_idxs[CH_MAX_REPLICATION];
+    unsigned long *server_idxs;
     int i;
 
     /* argument parsing */
@@ -65,9 +65,9 @@ int main(int argc, char **argv)
         return(-1);
     }
 
-    if(replication_factor > CH_MAX_REPLICATION)
+    if(replication_factor > n_svrs)
     {
-        fprintf(stderr, "Error: max replication level is %u\n", CH_MAX_REPLICATION);
+        fprintf(stderr, "Error: replication level exceeds number of servers\n");
         return(-1);
     }
 
@@ -81,6 +81,13 @@ int main(int argc, char **argv)
         return(-1);
     }
 
+    server_idxs = malloc(replication_factor*sizeof(*server_idxs));
+    if(!server_idxs)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
     ch_placement_find_closest(inst, oid, replication_factor, server_idxs);
     printf("<replica> <server index>\n========================\n");
     for(i=0; i<replication_factor; i++)
@@ -88,6 +95,7 @@ int main(int argc, char **argv)
         printf("%d\t%lu\n", i, server_idxs[i]);
     }
 
+    free(server_idxs);
     ch_placement_finalize(inst);
 
     return(0);
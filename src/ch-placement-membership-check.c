@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This checks incremental membership changes.  It removes and re-adds
+ * servers in place and verifies, for a set of random object ids, that:
+ * - the instance places every object exactly like a freshly built instance
+ *   with the same membership, and
+ * - an object is covered by one of the reported arcs (with the right old
+ *   and new server) exactly when its primary server changed.
+ * If module parameters are given, the instance being changed uses them and
+ * the fresh instances do not.  It also reports how long each in place
+ * change took compared to building a new instance.
+ */
+
+/* ch-placement-membership-check <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> [params]
+ */
+
+#define EXTRA_USAGE "[params]"
+
+/* checks the instance against a fresh instance built with the same
+ * membership, and the arcs against the placements from before the change;
+ * returns the number of objects that are wrong
+ */
+static unsigned long check(const char* what, struct ch_placement_instance *inst,
+    struct ch_placement_instance *ref_inst, uint64_t *oids,
+    unsigned long n_objs, unsigned int replication,
+    unsigned long *before_idxs, unsigned long *after_idxs,
+    struct ch_placement_arc *arcs, unsigned long n_arcs)
+{
+    unsigned long ref_idxs[CHECK_REPLICATION_MAX];
+    struct ch_placement_arc *arc;
+    unsigned long mismatches = 0;
+    unsigned long moved = 0;
+    unsigned long i;
+
+    ch_placement_find_closest_batch(inst, oids, n_objs, replication,
+        after_idxs);
+
+    for(i=0; i<n_objs; i++)
+    {
+        ch_placement_find_closest(ref_inst, oids[i], replication, ref_idxs);
+        if(memcmp(ref_idxs, &after_idxs[i*replication],
+            replication*sizeof(*ref_idxs)) != 0)
+        {
+            fprintf(stderr, "Error: %s placement of oid %lu differs from a new instance\n",
+                what, (unsigned long)oids[i]);
+            mismatches++;
+            continue;
+        }
+
+        arc = check_find_arc(arcs, n_arcs, oids[i]);
+        if(before_idxs[i*replication] == after_idxs[i*replication])
+        {
+            if(arc)
+            {
+                fprintf(stderr, "Error: %s oid %lu did not move but is in an arc\n",
+                    what, (unsigned long)oids[i]);
+                mismatches++;
+            }
+            continue;
+        }
+        moved++;
+        if(!arc || arc->old_svr != before_idxs[i*replication] ||
+            arc->new_svr != after_idxs[i*replication])
+        {
+            fprintf(stderr, "Error: %s oid %lu moved but is not in a matching arc\n",
+                what, (unsigned long)oids[i]);
+            mismatches++;
+        }
+    }
+
+    printf("# %s: %lu arcs, %lu of %lu objects moved, %lu mismatches\n",
+        what, n_arcs, moved, n_objs, mismatches);
+
+    return(mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    struct check_args args;
+    struct ch_placement_instance *inst;
+    struct ch_placement_instance *ref_inst;
+    struct ch_placement_arc *arcs;
+    unsigned long n_arcs;
+    char *params = NULL;
+    uint64_t *oids;
+    unsigned long *before_idxs;
+    unsigned long *after_idxs;
+    unsigned long *tmp_idxs;
+    unsigned long i;
+    unsigned long mismatches = 0;
+    double change_time, build_time;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 0, 1, &args) < 0)
+        return(-1);
+    if(args.n_extra == 1)
+        params = args.extra[0];
+    if(args.replication > CHECK_REPLICATION_MAX ||
+        args.replication + 1 > args.n_svrs)
+    {
+        fprintf(stderr, "Error: replication level must be at most %d and less than the number of servers\n",
+            CHECK_REPLICATION_MAX);
+        return(-1);
+    }
+
+    /**************************/
+
+    inst = ch_placement_initialize_params(args.module, args.n_svrs,
+        args.virt_factor, 0, params);
+    if(!inst)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+        return(-1);
+    }
+
+    oids = check_random_oids(args.n_objs);
+    before_idxs = malloc(args.n_objs*args.replication*sizeof(*before_idxs));
+    after_idxs = malloc(args.n_objs*args.replication*sizeof(*after_idxs));
+    if(!oids || !before_idxs || !after_idxs)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    ch_placement_find_closest_batch(inst, oids, args.n_objs, args.replication,
+        before_idxs);
+
+    /* remove the last server; same membership as an instance with one
+     * fewer server
+     */
+    change_time = check_wtime();
+    ret = ch_placement_remove_server(inst, args.n_svrs-1, &arcs, &n_arcs);
+    change_time = check_wtime() - change_time;
+    if(ret < 0)
+    {
+        fprintf(stderr, "Error: %s does not support removing servers\n", args.module);
+        return(-1);
+    }
+    build_time = check_wtime();
+    ref_inst = ch_placement_initialize(args.module, args.n_svrs-1,
+        args.virt_factor, 0);
+    build_time = check_wtime() - build_time;
+    printf("# remove: %f s in place, %f s to build a new instance\n",
+        change_time, build_time);
+    mismatches += check("remove", inst, ref_inst, oids, args.n_objs,
+        args.replication, before_idxs, after_idxs, arcs, n_arcs);
+    ch_placement_finalize(ref_inst);
+    free(arcs);
+    tmp_idxs = before_idxs;
+    before_idxs = after_idxs;
+    after_idxs = tmp_idxs;
+
+    /* add it back */
+    change_time = check_wtime();
+    ret = ch_placement_add_server(inst, args.n_svrs-1, &arcs, &n_arcs);
+    change_time = check_wtime() - change_time;
+    if(ret < 0)
+    {
+        fprintf(stderr, "Error: %s does not support adding servers\n", args.module);
+        return(-1);
+    }
+    build_time = check_wtime();
+    ref_inst = ch_placement_initialize(args.module, args.n_svrs,
+        args.virt_factor, 0);
+    build_time = check_wtime() - build_time;
+    printf("# add: %f s in place, %f s to build a new instance\n",
+        change_time, build_time);
+    mismatches += check("add", inst, ref_inst, oids, args.n_objs,
+        args.replication, before_idxs, after_idxs, arcs, n_arcs);
+    free(arcs);
+    tmp_idxs = before_idxs;
+    before_idxs = after_idxs;
+    after_idxs = tmp_idxs;
+
+    /* a server in the middle leaves and comes back; membership is back to
+     * the original afterwards
+     */
+    ret = ch_placement_remove_server(inst, 0, &arcs, &n_arcs);
+    if(ret < 0)
+    {
+        fprintf(stderr, "Error: failed to remove server 0\n");
+        return(-1);
+    }
+    free(arcs);
+    ch_placement_find_closest_batch(inst, oids, args.n_objs, args.replication,
+        before_idxs);
+    ret = ch_placement_add_server(inst, 0, &arcs, &n_arcs);
+    if(ret < 0)
+    {
+        fprintf(stderr, "Error: failed to add server 0\n");
+        return(-1);
+    }
+    mismatches += check("readd", inst, ref_inst, oids, args.n_objs,
+        args.replication, before_idxs, after_idxs, arcs, n_arcs);
+    free(arcs);
+
+    /* invalid changes are refused */
+    if(ch_placement_add_server(inst, 0, NULL, NULL) == 0)
+    {
+        fprintf(stderr, "Error: adding an existing server succeeded\n");
+        mismatches++;
+    }
+    if(ch_placement_remove_server(inst, args.n_svrs, NULL, NULL) == 0)
+    {
+        fprintf(stderr, "Error: removing a missing server succeeded\n");
+        mismatches++;
+    }
+
+    ch_placement_finalize(ref_inst);
+    ch_placement_finalize(inst);
+    free(oids);
+    free(before_idxs);
+    free(after_idxs);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This checks a module meant to take over from the ring with a table that
+ * only changes by rewriting entries (like "partition" with "from:ring").
+ * For a set of random object ids it verifies that:
+ * - at most <max_moved> (a fraction) of the objects are placed differently
+ *   than by the ring with the same servers, virt_factor and seed,
+ * - removing a server only moves the primaries it held, and adding a new
+ *   server only moves primaries onto it, and
+ * - an object is covered by one of the reported arcs (with the right old
+ *   and new server) exactly when its primary server changed.
+ * It also reports how evenly the primary replicas are spread.
+ */
+
+/* ch-placement-migration-check <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> <max_moved> [params]
+ */
+
+#define EXTRA_USAGE "<max_moved> [params]"
+
+/* checks the primaries after a membership change of svr_idx against the
+ * arcs and the placements from before; returns the number of objects that
+ * are wrong
+ */
+static unsigned long check(const char* what, struct ch_placement_instance *inst,
+    uint64_t *oids, unsigned long n_objs, unsigned int replication,
+    unsigned long *before_idxs, unsigned long *after_idxs,
+    struct ch_placement_arc *arcs, unsigned long n_arcs,
+    unsigned long svr_idx, int adding)
+{
+    struct ch_placement_arc *arc;
+    unsigned long mismatches = 0;
+    unsigned long moved = 0;
+    unsigned long before, after;
+    unsigned long i;
+
+    ch_placement_find_closest_batch(inst, oids, n_objs, replication,
+        after_idxs);
+
+    for(i=0; i<n_objs; i++)
+    {
+        before = before_idxs[i*replication];
+        after = after_idxs[i*replication];
+        arc = check_find_arc(arcs, n_arcs, oids[i]);
+        if(before == after)
+        {
+            if(arc)
+            {
+                fprintf(stderr, "Error: %s oid %lu did not move but is in an arc\n",
+                    what, (unsigned long)oids[i]);
+                mismatches++;
+            }
+            continue;
+        }
+        moved++;
+        if((adding && after != svr_idx) || (!adding && before != svr_idx))
+        {
+            fprintf(stderr, "Error: %s oid %lu moved from server %lu to %lu\n",
+                what, (unsigned long)oids[i], before, after);
+            mismatches++;
+        }
+        if(!arc || arc->old_svr != before || arc->new_svr != after)
+        {
+            fprintf(stderr, "Error: %s oid %lu moved but is not in a matching arc\n",
+                what, (unsigned long)oids[i]);
+            mismatches++;
+        }
+    }
+
+    printf("# %s server %lu: %lu arcs, %lu of %lu objects moved, %lu mismatches\n",
+        what, svr_idx, n_arcs, moved, n_objs, mismatches);
+
+    return(mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    struct check_args args;
+    double max_moved;
+    struct ch_placement_instance *inst;
+    struct ch_placement_instance *ring;
+    struct ch_placement_arc *arcs;
+    unsigned long n_arcs;
+    char *params = NULL;
+    uint64_t *oids;
+    unsigned long *before_idxs;
+    unsigned long *after_idxs;
+    unsigned long *loads;
+    unsigned long i, max_load, differ;
+    unsigned long mismatches = 0;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 1, 2, &args) < 0)
+        return(-1);
+    ret = sscanf(args.extra[0], "%lf", &max_moved);
+    if(ret != 1)
+    {
+        check_usage(argv[0], EXTRA_USAGE);
+        return(-1);
+    }
+    if(args.n_extra == 2)
+        params = args.extra[1];
+    if(args.replication > CHECK_REPLICATION_MAX ||
+        args.replication + 1 > args.n_svrs)
+    {
+        fprintf(stderr, "Error: replication level must be at most %d and less than the number of servers\n",
+            CHECK_REPLICATION_MAX);
+        return(-1);
+    }
+
+    /**************************/
+
+    inst = ch_placement_initialize_params(args.module, args.n_svrs,
+        args.virt_factor, 0, params);
+    ring = ch_placement_initialize("ring", args.n_svrs, args.virt_factor, 0);
+    if(!inst || !ring)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+        return(-1);
+    }
+
+    oids = check_random_oids(args.n_objs);
+    before_idxs = malloc(args.n_objs*args.replication*sizeof(*before_idxs));
+    after_idxs = malloc(args.n_objs*args.replication*sizeof(*after_idxs));
+    loads = calloc(args.n_svrs + 1, sizeof(*loads));
+    if(!oids || !before_idxs || !after_idxs || !loads)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    /* compare with the ring */
+    ch_placement_find_closest_batch(inst, oids, args.n_objs, args.replication,
+        before_idxs);
+    ch_placement_find_closest_batch(ring, oids, args.n_objs, args.replication,
+        after_idxs);
+    differ = 0;
+    max_load = 0;
+    for(i=0; i<args.n_objs; i++)
+    {
+        if(memcmp(&before_idxs[i*args.replication],
+            &after_idxs[i*args.replication],
+            args.replication*sizeof(*before_idxs)) != 0)
+            differ++;
+        loads[before_idxs[i*args.replication]]++;
+        if(loads[before_idxs[i*args.replication]] > max_load)
+            max_load = loads[before_idxs[i*args.replication]];
+    }
+    printf("# %lu of %lu objects placed differently than by the ring\n",
+        differ, args.n_objs);
+    printf("# primary load: max %lu, mean %f\n", max_load,
+        (double)args.n_objs / args.n_svrs);
+    if(differ > max_moved * args.n_objs)
+    {
+        fprintf(stderr, "Error: more than %f of the objects differ from the ring\n",
+            max_moved);
+        mismatches++;
+    }
+    ch_placement_finalize(ring);
+
+    /* a server in the middle leaves */
+    if(ch_placement_remove_server(inst, args.n_svrs/2, &arcs, &n_arcs) < 0)
+    {
+        fprintf(stderr, "Error: %s does not support removing servers\n", args.module);
+        return(-1);
+    }
+    mismatches += check("remove", inst, oids, args.n_objs, args.replication,
+        before_idxs, after_idxs, arcs, n_arcs, args.n_svrs/2, 0);
+    free(arcs);
+    memcpy(before_idxs, after_idxs,
+        args.n_objs*args.replication*sizeof(*before_idxs));
+
+    /* a new server joins */
+    if(ch_placement_add_server(inst, args.n_svrs, &arcs, &n_arcs) < 0)
+    {
+        fprintf(stderr, "Error: %s does not support adding servers\n", args.module);
+        return(-1);
+    }
+    mismatches += check("add", inst, oids, args.n_objs, args.replication,
+        before_idxs, after_idxs, arcs, n_arcs, args.n_svrs, 1);
+    free(arcs);
+
+    printf("# %lu mismatches\n", mismatches);
+
+    ch_placement_finalize(inst);
+    free(oids);
+    free(before_idxs);
+    free(after_idxs);
+    free(loads);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
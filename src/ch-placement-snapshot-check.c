@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This checks placement snapshots.  It builds an instance, saves it to
+ * <path>, maps it back with ch_placement_load_mmap(), and verifies that the
+ * loaded instance places a set of random object ids exactly like the
+ * original (with both single and batched lookups).  It then verifies that
+ * damaged copies of the file (one flipped payload byte, and a truncated
+ * file) are refused, and reports how long building and loading took.
+ */
+
+/* ch-placement-snapshot-check <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> <path> [params]
+ */
+
+#define EXTRA_USAGE "<path> [params]"
+
+/* copies src to dst, keeping the first len bytes (all if len is 0) and
+ * flipping the byte at flip if flip is not 0
+ */
+static int copy_damaged(const char *src, const char *dst, long len, long flip)
+{
+    FILE *in, *out;
+    long pos = 0;
+    int c;
+
+    in = fopen(src, "r");
+    out = fopen(dst, "w");
+    if(!in || !out)
+    {
+        perror("fopen");
+        return(-1);
+    }
+    while((c = fgetc(in)) != EOF && (len == 0 || pos < len))
+    {
+        if(flip && pos == flip)
+            c ^= 0x01;
+        fputc(c, out);
+        pos++;
+    }
+    fclose(in);
+    fclose(out);
+
+    return(0);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    struct check_args args;
+    char *path;
+    char *damaged_path;
+    struct ch_placement_instance *inst;
+    struct ch_placement_instance *loaded;
+    struct ch_placement_stats stats;
+    char *params = NULL;
+    uint64_t *oids;
+    unsigned long *idxs;
+    unsigned long *loaded_idxs;
+    unsigned long mismatches = 0;
+    double build_time, save_time, load_time;
+    FILE *f;
+    long size;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 1, 2, &args) < 0)
+        return(-1);
+    path = args.extra[0];
+    if(args.n_extra == 2)
+        params = args.extra[1];
+    if(args.replication > CHECK_REPLICATION_MAX ||
+        args.replication > args.n_svrs)
+    {
+        fprintf(stderr, "Error: replication level must be at most %d and at most the number of servers\n",
+            CHECK_REPLICATION_MAX);
+        return(-1);
+    }
+
+    /**************************/
+
+    build_time = check_wtime();
+    inst = ch_placement_initialize_params(args.module, args.n_svrs,
+        args.virt_factor, 0, params);
+    build_time = check_wtime() - build_time;
+    if(!inst)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+        return(-1);
+    }
+
+    save_time = check_wtime();
+    ret = ch_placement_save(inst, path);
+    save_time = check_wtime() - save_time;
+    if(ret < 0)
+    {
+        fprintf(stderr, "Error: failed to save %s to %s\n", args.module, path);
+        return(-1);
+    }
+
+    load_time = check_wtime();
+    loaded = ch_placement_load_mmap(path);
+    load_time = check_wtime() - load_time;
+    if(!loaded)
+    {
+        fprintf(stderr, "Error: failed to load %s\n", path);
+        return(-1);
+    }
+
+    printf("# build: %f s, save: %f s, load: %f s\n", build_time, save_time,
+        load_time);
+    ret = ch_placement_get_stats(loaded, &stats);
+    if(ret == 0)
+        printf("# table: %lu bytes, index: %lu bytes\n", stats.table_bytes,
+            stats.index_bytes);
+
+    oids = check_random_oids(args.n_objs);
+    idxs = malloc(args.n_objs*args.replication*sizeof(*idxs));
+    loaded_idxs = malloc(args.n_objs*args.replication*sizeof(*loaded_idxs));
+    damaged_path = malloc(strlen(path) + 16);
+    if(!oids || !idxs || !loaded_idxs || !damaged_path)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    ch_placement_find_closest_batch(inst, oids, args.n_objs,
+        args.replication, idxs);
+    mismatches += check_batch(loaded, oids, args.n_objs, args.replication,
+        loaded_idxs);
+    mismatches += check_compare("loaded", oids, args.n_objs,
+        args.replication, idxs, loaded_idxs);
+
+    /* a loaded instance is read-only */
+    if(ch_placement_remove_server(loaded, 0, NULL, NULL) == 0)
+    {
+        fprintf(stderr, "Error: removing a server from a loaded instance succeeded\n");
+        mismatches++;
+    }
+
+    /* a loaded instance can be saved again */
+    sprintf(damaged_path, "%s.resave", path);
+    if(ch_placement_save(loaded, damaged_path) < 0)
+    {
+        fprintf(stderr, "Error: failed to save a loaded instance\n");
+        mismatches++;
+    }
+    remove(damaged_path);
+
+    ch_placement_finalize(loaded);
+    ch_placement_finalize(inst);
+
+    /* damaged files are refused */
+    f = fopen(path, "r");
+    if(!f || fseek(f, 0, SEEK_END) != 0)
+    {
+        perror(path);
+        return(-1);
+    }
+    size = ftell(f);
+    fclose(f);
+
+    sprintf(damaged_path, "%s.damaged", path);
+    copy_damaged(path, damaged_path, 0, size - 1);
+    loaded = ch_placement_load_mmap(damaged_path);
+    if(loaded)
+    {
+        fprintf(stderr, "Error: a snapshot with a flipped byte was loaded\n");
+        ch_placement_finalize(loaded);
+        mismatches++;
+    }
+    copy_damaged(path, damaged_path, size / 2, 0);
+    loaded = ch_placement_load_mmap(damaged_path);
+    if(loaded)
+    {
+        fprintf(stderr, "Error: a truncated snapshot was loaded\n");
+        ch_placement_finalize(loaded);
+        mismatches++;
+    }
+    remove(damaged_path);
+
+    printf("# %lu objects, %lu mismatches\n", args.n_objs, mismatches);
+
+    free(oids);
+    free(idxs);
+    free(loaded_idxs);
+    free(damaged_path);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This checks seeded striped file layouts.  It lays out <n_objs> files,
+ * seeding each one with its file id, once in order on one thread and once
+ * in parallel in a different order, and verifies that:
+ * - every file gets the same objects and sizes both times (the layout
+ *   depends only on the seed, not on the order of calls or threads),
+ * - the object sizes add up to the file size and no object is empty, and
+ * - the objects of a file have distinct ids.
+ * It also reports how many files have two objects with the same primary
+ * server, and the layout rate with random() and with seeded states.
+ */
+
+/* ch-placement-stripe-check <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> [params]
+ */
+
+#define EXTRA_USAGE "[params]"
+#define N_THREADS 4
+#define STRIP_SIZE 1048576UL
+
+/* size of file f: anywhere from one byte to twice the widest stripe */
+static unsigned long file_size(unsigned long f, unsigned int width)
+{
+    uint64_t state = ~(uint64_t)f;
+
+    return(ch_placement_random_u64_r(&state) %
+        (2*width*STRIP_SIZE) + 1);
+}
+
+int main(int argc, char **argv)
+{
+    struct check_args args;
+    unsigned int width;
+    struct ch_placement_instance *inst;
+    char *params = NULL;
+    uint64_t *oids, *par_oids;
+    unsigned long *sizes, *par_sizes;
+    unsigned int *file_objs, *par_file_objs;
+    unsigned long *server_idxs;
+    unsigned long f, total;
+    unsigned int i, j;
+    int dup;
+    unsigned long mismatches = 0;
+    unsigned long shared = 0;
+    double serial_time, parallel_time, global_time;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 0, 1, &args) < 0)
+        return(-1);
+    if(args.n_extra == 1)
+        params = args.extra[0];
+    if(args.replication == 0 || args.replication > args.n_svrs)
+    {
+        fprintf(stderr, "Error: replication level must be between 1 and the number of servers\n");
+        return(-1);
+    }
+
+    /**************************/
+
+    inst = ch_placement_initialize_params(args.module, args.n_svrs,
+        args.virt_factor, 0, params);
+    if(!inst)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+        return(-1);
+    }
+
+    width = args.n_svrs/args.replication;
+    oids = malloc(args.n_objs*width*sizeof(*oids));
+    par_oids = malloc(args.n_objs*width*sizeof(*par_oids));
+    sizes = malloc(args.n_objs*width*sizeof(*sizes));
+    par_sizes = malloc(args.n_objs*width*sizeof(*par_sizes));
+    file_objs = malloc(args.n_objs*sizeof(*file_objs));
+    par_file_objs = malloc(args.n_objs*sizeof(*par_file_objs));
+    server_idxs = malloc(width*args.replication*sizeof(*server_idxs));
+    if(!oids || !par_oids || !sizes || !par_sizes || !file_objs ||
+        !par_file_objs || !server_idxs)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    /* the same files through random(), for comparison */
+    srandom(8675309);
+    global_time = check_wtime();
+    for(f=0; f<args.n_objs; f++)
+        ch_placement_create_striped(inst, file_size(f, width),
+            args.replication, width, STRIP_SIZE, &file_objs[f],
+            &oids[f*width], &sizes[f*width]);
+    global_time = check_wtime() - global_time;
+
+    /* in order on one thread */
+    serial_time = check_wtime();
+    for(f=0; f<args.n_objs; f++)
+    {
+        uint64_t state = f;
+
+        ch_placement_create_striped_r(inst, &state, file_size(f, width),
+            args.replication, width, STRIP_SIZE, &file_objs[f],
+            &oids[f*width], &sizes[f*width]);
+    }
+    serial_time = check_wtime() - serial_time;
+
+    /* backwards, spread over threads */
+    parallel_time = check_wtime();
+#pragma omp parallel for schedule(dynamic, 16) num_threads(N_THREADS)
+    for(f=0; f<args.n_objs; f++)
+    {
+        unsigned long g = args.n_objs - 1 - f;
+        uint64_t state = g;
+
+        ch_placement_create_striped_r(inst, &state, file_size(g, width),
+            args.replication, width, STRIP_SIZE, &par_file_objs[g],
+            &par_oids[g*width], &par_sizes[g*width]);
+    }
+    parallel_time = check_wtime() - parallel_time;
+
+    for(f=0; f<args.n_objs; f++)
+    {
+        if(file_objs[f] != par_file_objs[f] ||
+            memcmp(&oids[f*width], &par_oids[f*width],
+                file_objs[f]*sizeof(*oids)) != 0 ||
+            memcmp(&sizes[f*width], &par_sizes[f*width],
+                file_objs[f]*sizeof(*sizes)) != 0)
+        {
+            fprintf(stderr, "Error: file %lu laid out differently in parallel\n",
+                f);
+            mismatches++;
+            continue;
+        }
+        if(file_objs[f] == 0 || file_objs[f] > width)
+        {
+            fprintf(stderr, "Error: file %lu has %u objects\n", f, file_objs[f]);
+            mismatches++;
+            continue;
+        }
+
+        total = 0;
+        for(i=0; i<file_objs[f]; i++)
+        {
+            if(sizes[f*width+i] == 0)
+            {
+                fprintf(stderr, "Error: file %lu object %u is empty\n", f, i);
+                mismatches++;
+            }
+            total += sizes[f*width+i];
+            for(j=0; j<i; j++)
+            {
+                if(oids[f*width+i] == oids[f*width+j])
+                {
+                    fprintf(stderr, "Error: file %lu objects %u and %u have the same id\n",
+                        f, j, i);
+                    mismatches++;
+                }
+            }
+        }
+        if(total != file_size(f, width))
+        {
+            fprintf(stderr, "Error: file %lu sizes add up to %lu, not %lu\n",
+                f, total, file_size(f, width));
+            mismatches++;
+        }
+
+        /* do any two objects share a primary server? */
+        ch_placement_find_closest_batch(inst, &oids[f*width], file_objs[f],
+            args.replication, server_idxs);
+        dup = 0;
+        for(i=0; i<file_objs[f] && !dup; i++)
+            for(j=0; j<i && !dup; j++)
+                if(server_idxs[i*args.replication] ==
+                    server_idxs[j*args.replication])
+                    dup = 1;
+        shared += dup;
+    }
+
+    printf("# %lu files: random() %f files/s, seeded %f files/s, seeded on %d threads %f files/s\n",
+        args.n_objs, args.n_objs/global_time, args.n_objs/serial_time,
+            N_THREADS,
+        args.n_objs/parallel_time);
+    printf("# %lu files have objects sharing a primary server\n", shared);
+    printf("# %lu mismatches\n", mismatches);
+
+    ch_placement_finalize(inst);
+    free(oids);
+    free(par_oids);
+    free(sizes);
+    free(par_sizes);
+    free(file_objs);
+    free(par_file_objs);
+    free(server_idxs);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -27,7 +27,7 @@ int main(int argc, char **argv)
     unsigned virt_factor;
     unsigned replication_factor;
     struct ch_placement_instance *inst;
-    unsigned long server_idxs[CH_MAX_REPLICATION];
+    unsigned long *server_idxs;
     int i,j;
     unsigned long file_size = 1099511627776UL; /* 1 TB */
     unsigned int max_stripe_width = 0;
@@ -63,9 +63,9 @@ int main(int argc, char **argv)
         return(-1);
     }
 
-    if(replication_factor > CH_MAX_REPLICATION)
+    if(replication_factor > n_svrs)
     {
-        fprintf(stderr, "Error: max replication level is %u\n", CH_MAX_REPLICATION);
+        fprintf(stderr, "Error: replication level exceeds number of servers\n");
         return(-1);
     }
 
@@ -92,6 +92,12 @@ int main(int argc, char **argv)
         perror("malloc");
         return(-1);
     }
+    server_idxs = malloc(replication_factor*sizeof(*server_idxs));
+    if(!server_idxs)
+    {
+        perror("malloc");
+        return(-1);
+    }
 
     ch_placement_create_striped(inst, file_size, replication_factor,
         max_stripe_width, strip_size, &num_objs, oids, sizes);
@@ -109,6 +115,7 @@ int main(int argc, char **argv)
 
     free(oids);
     free(sizes);
+    free(server_idxs);
 
     ch_placement_finalize(inst);
 
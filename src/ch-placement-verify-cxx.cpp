@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "ch-placement.h"
+#include "ch-placement.hpp"
+#include "ch-placement-check.h"
+
+/* Checks that the header-only C++ engines in ch-placement.hpp place a set of
+ * random objects exactly like the corresponding C modules, and reports the
+ * lookup time of each.
+ */
+
+/* ch-placement-verify-cxx <n_svrs> <virt_factor> <n_objs>
+ */
+
+static void usage(char *exename)
+{
+    fprintf(stderr, "Usage: %s <n_svrs> <virt_factor> <n_objs>\n", exename);
+    return;
+}
+
+/* places every oid with both the C module and the C++ engine; returns the
+ * number of objects that differ
+ */
+template <class Engine>
+static unsigned long verify(const char *module, unsigned int n_svrs,
+    unsigned int virt_factor, const std::vector<uint64_t> &oids)
+{
+    const unsigned int r = Engine::replication;
+    struct ch_placement_instance *inst;
+    std::vector<unsigned long> c_idxs(oids.size()*r);
+    std::vector<typename Engine::index_type> cxx_idxs(oids.size()*r);
+    unsigned long mismatches = 0;
+    double c_time, cxx_time;
+    unsigned long i;
+    unsigned int j;
+
+    inst = ch_placement_initialize(module, n_svrs, virt_factor, 0);
+    if(!inst)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", module);
+        return(oids.size());
+    }
+    Engine engine(n_svrs, virt_factor, 0);
+
+    c_time = check_wtime();
+    ch_placement_find_closest_batch(inst, oids.data(), oids.size(), r,
+        c_idxs.data());
+    c_time = check_wtime() - c_time;
+
+    cxx_time = check_wtime();
+    engine.find_closest_batch(oids.data(), oids.size(), cxx_idxs.data());
+    cxx_time = check_wtime() - cxx_time;
+
+    for(i=0; i<oids.size(); i++)
+    {
+        for(j=0; j<r; j++)
+        {
+            if(c_idxs[i*r+j] != cxx_idxs[i*r+j])
+            {
+                fprintf(stderr, "Error: %s placement of oid %lu differs\n",
+                    module, (unsigned long)oids[i]);
+                mismatches++;
+                break;
+            }
+        }
+    }
+
+    printf("# %s r=%u: %lu objects, %lu mismatches, C %f s, C++ %f s\n",
+        module, r, (unsigned long)oids.size(), mismatches, c_time, cxx_time);
+
+    ch_placement_finalize(inst);
+    return(mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    unsigned int n_svrs;
+    unsigned int virt_factor;
+    unsigned long n_objs;
+    unsigned long i;
+    unsigned long mismatches = 0;
+
+    if(argc != 4)
+    {
+        usage(argv[0]);
+        return(-1);
+    }
+    ret = sscanf(argv[1], "%u", &n_svrs);
+    if(ret != 1)
+    {
+        usage(argv[0]);
+        return(-1);
+    }
+    ret = sscanf(argv[2], "%u", &virt_factor);
+    if(ret != 1)
+    {
+        usage(argv[0]);
+        return(-1);
+    }
+    ret = sscanf(argv[3], "%lu", &n_objs);
+    if(ret != 1)
+    {
+        usage(argv[0]);
+        return(-1);
+    }
+    if(n_svrs < 12)
+    {
+        fprintf(stderr, "Error: need at least 12 servers\n");
+        return(-1);
+    }
+
+    std::vector<uint64_t> oids(n_objs);
+    srandom(8675309);
+    for(i=0; i<n_objs; i++)
+        oids[i] = ch_placement_random_u64();
+
+    mismatches += verify<ch::Ring<ch::Lookup3, 3> >("ring", n_svrs,
+        virt_factor, oids);
+    mismatches += verify<ch::Ring<ch::Lookup3, 1, unsigned long> >("ring",
+        n_svrs, virt_factor, oids);
+    mismatches += verify<ch::Ring<ch::Lookup3, 5> >("ring", n_svrs,
+        virt_factor, oids);
+    mismatches += verify<ch::Ring<ch::Lookup3, 12> >("ring", n_svrs,
+        virt_factor, oids);
+    mismatches += verify<ch::MultiRing<ch::Lookup3, 3> >("multiring", n_svrs,
+        virt_factor, oids);
+    mismatches += verify<ch::MultiRing<ch::Lookup3, 2, uint64_t> >(
+        "multiring", n_svrs, virt_factor, oids);
+    mismatches += verify<ch::Hrw<ch::Lookup3, 3> >("hash_lookup3", n_svrs,
+        virt_factor, oids);
+    mismatches += verify<ch::Hrw<ch::Spooky, 3> >("hash_spooky", n_svrs,
+        virt_factor, oids);
+    mismatches += verify<ch::Hrw<ch::Lookup3, 12> >("hash_lookup3", n_svrs,
+        virt_factor, oids);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=cpp ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This is a simple consistency check for placement algorithms.  Given a
+ * placement algorithm and system parameters, it generates a set of random
+ * object ids and verifies that the batched lookup path produces exactly the
+ * same placement as one-at-a-time lookups.  If a module parameter list is
+ * given as well, it also verifies that an instance built with those
+ * parameters places every object exactly like the default instance.
+ */
+
+/* ch-placement-verify <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> [params]
+ */
+
+#define EXTRA_USAGE "[params]"
+
+int main(int argc, char **argv)
+{
+    struct check_args args;
+    struct ch_placement_instance *inst;
+    struct ch_placement_instance *ref_inst = NULL;
+    char *params = NULL;
+    uint64_t *oids;
+    unsigned long *single_idxs;
+    unsigned long *batch_idxs;
+    unsigned long *ref_idxs;
+    unsigned long i;
+    unsigned long mismatches = 0;
+    struct ch_placement_stats stats;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 0, 1, &args) < 0)
+        return(-1);
+    if(args.n_extra == 1)
+        params = args.extra[0];
+
+    if(args.replication > args.n_svrs)
+    {
+        fprintf(stderr, "Error: replication level exceeds number of servers\n");
+        return(-1);
+    }
+
+    /**************************/
+
+    inst = ch_placement_initialize_params(args.module, args.n_svrs,
+        args.virt_factor, 0, params);
+    if(!inst)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+        return(-1);
+    }
+    if(params)
+    {
+        ref_inst = ch_placement_initialize(args.module, args.n_svrs,
+            args.virt_factor, 0);
+        if(!ref_inst)
+        {
+            fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+            return(-1);
+        }
+    }
+
+    oids = check_random_oids(args.n_objs);
+    single_idxs = malloc(args.n_objs*args.replication*sizeof(*single_idxs));
+    batch_idxs = malloc(args.n_objs*args.replication*sizeof(*batch_idxs));
+    ref_idxs = malloc(args.n_objs*args.replication*sizeof(*ref_idxs));
+    if(!oids || !single_idxs || !batch_idxs || !ref_idxs)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    for(i=0; i<args.n_objs; i++)
+        ch_placement_find_closest(inst, oids[i], args.replication,
+            &single_idxs[i*args.replication]);
+
+    ch_placement_find_closest_batch(inst, oids, args.n_objs, args.replication,
+        batch_idxs);
+
+    mismatches += check_compare("batch", oids, args.n_objs, args.replication,
+        single_idxs, batch_idxs);
+
+    if(ref_inst)
+    {
+        for(i=0; i<args.n_objs; i++)
+            ch_placement_find_closest(ref_inst, oids[i], args.replication,
+                &ref_idxs[i*args.replication]);
+
+        mismatches += check_compare(params, oids, args.n_objs, args.replication,
+            ref_idxs, single_idxs);
+        ch_placement_finalize(ref_inst);
+    }
+
+    printf("# %s%s%s: %lu objects, %lu mismatches\n", args.module,
+        params ? " " : "", params ? params : "", args.n_objs, mismatches);
+    if(ch_placement_get_stats(inst, &stats) == 0)
+        printf("# table: %lu bytes, %f s; index: %lu bytes, %f s\n",
+            stats.table_bytes, stats.build_seconds, stats.index_bytes,
+            stats.index_build_seconds);
+
+    free(oids);
+    free(single_idxs);
+    free(batch_idxs);
+    free(ref_idxs);
+    ch_placement_finalize(inst);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "ch-placement-check.h"
+
+/* This checks weighted initialization.  Servers are given weights from a
+ * small set of classes (like a mix of disk and flash nodes), and for a set
+ * of random object ids it verifies that:
+ * - each class receives a share of the primary replicas within
+ *   <tolerance> (relative) of its share of the total weight,
+ * - servers with a weight of zero receive nothing, even when every server
+ *   is asked for (the slots past the weighted servers are UINT64_MAX),
+ * - batched and single lookups agree, and
+ * - equal weights place every object exactly like an unweighted instance.
+ */
+
+/* ch-placement-weight-check <module> <n_svrs> <virt_factor> <n_objs> <replication_factor> <tolerance> [params]
+ */
+
+#define EXTRA_USAGE "<tolerance> [params]"
+
+/* objects placed on every server at once */
+#define ALL_SVRS_OBJS 1000
+
+/* relative weight of each class; server i is in class i % N_CLASSES */
+#define N_CLASSES 5
+static const double class_weights[N_CLASSES] = {1, 2, 4, 8, 0};
+
+/* asks for as many replicas as there are servers; every weighted server
+ * must come back once, followed by UINT64_MAX for the servers without
+ * weight.  Returns the number of objects placed wrong.
+ */
+static unsigned long place_all_servers(struct ch_placement_instance *inst,
+    uint64_t *oids, unsigned long n_objs, unsigned int n_svrs,
+    const double *weights)
+{
+    unsigned long *idxs;
+    char *seen;
+    unsigned long mismatches = 0;
+    unsigned int n_weighted = 0;
+    unsigned long i;
+    unsigned int j;
+    int bad;
+
+    idxs = malloc(n_svrs*sizeof(*idxs));
+    seen = malloc(n_svrs);
+    if(!idxs || !seen)
+    {
+        perror("malloc");
+        exit(-1);
+    }
+    for(j=0; j<n_svrs; j++)
+        if(weights[j] > 0)
+            n_weighted++;
+
+    for(i=0; i<n_objs && i<ALL_SVRS_OBJS; i++)
+    {
+        ch_placement_find_closest(inst, oids[i], n_svrs, idxs);
+        memset(seen, 0, n_svrs);
+        bad = 0;
+        for(j=0; j<n_weighted; j++)
+        {
+            if(idxs[j] >= n_svrs || weights[idxs[j]] == 0 || seen[idxs[j]])
+                bad = 1;
+            else
+                seen[idxs[j]] = 1;
+        }
+        for(; j<n_svrs; j++)
+            if(idxs[j] != UINT64_MAX)
+                bad = 1;
+        if(bad)
+        {
+            fprintf(stderr, "Error: oid %lu is not on every weighted server once\n",
+                (unsigned long)oids[i]);
+            mismatches++;
+        }
+    }
+
+    free(idxs);
+    free(seen);
+
+    return(mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    struct check_args args;
+    double tolerance;
+    struct ch_placement_instance *inst;
+    struct ch_placement_instance *ref_inst;
+    char *params = NULL;
+    double *weights;
+    uint64_t *oids;
+    unsigned long *idxs;
+    unsigned long *ref_idxs;
+    unsigned long class_objs[N_CLASSES];
+    double class_total[N_CLASSES];
+    double total = 0;
+    double expected, observed;
+    unsigned long i;
+    unsigned int c;
+    unsigned long mismatches = 0;
+
+    /* argument parsing */
+    /**************************/
+
+    if(check_parse_args(argc, argv, EXTRA_USAGE, 1, 2, &args) < 0)
+        return(-1);
+    ret = sscanf(args.extra[0], "%lf", &tolerance);
+    if(ret != 1)
+    {
+        check_usage(argv[0], EXTRA_USAGE);
+        return(-1);
+    }
+    if(args.n_extra == 2)
+        params = args.extra[1];
+    if(args.replication > CHECK_REPLICATION_MAX ||
+        args.replication > args.n_svrs - args.n_svrs/N_CLASSES)
+    {
+        fprintf(stderr, "Error: replication level must be at most %d and at most the number of weighted servers\n",
+            CHECK_REPLICATION_MAX);
+        return(-1);
+    }
+
+    /**************************/
+
+    weights = malloc(args.n_svrs*sizeof(*weights));
+    oids = check_random_oids(args.n_objs);
+    idxs = malloc(args.n_objs*args.replication*sizeof(*idxs));
+    ref_idxs = malloc(args.n_objs*args.replication*sizeof(*ref_idxs));
+    if(!weights || !oids || !idxs || !ref_idxs)
+    {
+        perror("malloc");
+        return(-1);
+    }
+
+    /* weighted placement follows the weights */
+    memset(class_objs, 0, sizeof(class_objs));
+    memset(class_total, 0, sizeof(class_total));
+    for(i=0; i<args.n_svrs; i++)
+    {
+        weights[i] = class_weights[i % N_CLASSES];
+        class_total[i % N_CLASSES] += weights[i];
+        total += weights[i];
+    }
+
+    inst = ch_placement_initialize_weighted(args.module, args.n_svrs,
+        args.virt_factor, 0, weights, params);
+    if(!inst)
+    {
+        fprintf(stderr, "Error: failed to initialize weighted %s\n", args.module);
+        return(-1);
+    }
+    mismatches += check_batch(inst, oids, args.n_objs, args.replication, idxs);
+    for(i=0; i<args.n_objs; i++)
+    {
+        class_objs[idxs[i*args.replication] % N_CLASSES]++;
+        /* no replica may land on a server without weight */
+        for(c=0; c<args.replication; c++)
+        {
+            if(weights[idxs[i*args.replication+c]] == 0)
+            {
+                fprintf(stderr, "Error: oid %lu placed on server %lu with zero weight\n",
+                    (unsigned long)oids[i], idxs[i*args.replication+c]);
+                mismatches++;
+            }
+        }
+    }
+    for(c=0; c<N_CLASSES; c++)
+    {
+        expected = class_total[c] / total;
+        observed = (double)class_objs[c] / args.n_objs;
+        printf("# weight %g: expected share %f, observed share %f\n",
+            class_weights[c], expected, observed);
+        if(observed < expected*(1.0-tolerance) ||
+            observed > expected*(1.0+tolerance))
+        {
+            fprintf(stderr, "Error: share of weight %g servers is off by more than %g\n",
+                class_weights[c], tolerance);
+            mismatches++;
+        }
+    }
+    mismatches += place_all_servers(inst, oids, args.n_objs, args.n_svrs,
+        weights);
+    ch_placement_finalize(inst);
+
+    /* equal weights match an unweighted instance */
+    for(i=0; i<args.n_svrs; i++)
+        weights[i] = 3.5;
+    inst = ch_placement_initialize_weighted(args.module, args.n_svrs,
+        args.virt_factor, 0, weights, params);
+    ref_inst = ch_placement_initialize(args.module, args.n_svrs,
+        args.virt_factor, 0);
+    if(!inst || !ref_inst)
+    {
+        fprintf(stderr, "Error: failed to initialize %s\n", args.module);
+        return(-1);
+    }
+    mismatches += check_batch(inst, oids, args.n_objs, args.replication, idxs);
+    ch_placement_find_closest_batch(ref_inst, oids, args.n_objs,
+        args.replication, ref_idxs);
+    for(i=0; i<args.n_objs; i++)
+    {
+        if(memcmp(&idxs[i*args.replication], &ref_idxs[i*args.replication],
+            args.replication*sizeof(*idxs)) != 0)
+        {
+            fprintf(stderr, "Error: equally weighted placement of oid %lu differs\n",
+                (unsigned long)oids[i]);
+            mismatches++;
+        }
+    }
+    ch_placement_finalize(inst);
+    ch_placement_finalize(ref_inst);
+
+    /* weights must not all be zero */
+    for(i=0; i<args.n_svrs; i++)
+        weights[i] = 0;
+    inst = ch_placement_initialize_weighted(args.module, args.n_svrs,
+        args.virt_factor, 0, weights, params);
+    if(inst)
+    {
+        fprintf(stderr, "Error: all zero weights were accepted\n");
+        ch_placement_finalize(inst);
+        mismatches++;
+    }
+
+    printf("# %lu mismatches\n", mismatches);
+
+    free(weights);
+    free(oids);
+    free(idxs);
+    free(ref_idxs);
+
+    return(mismatches ? -1 : 0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
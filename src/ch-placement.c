@@ -8,9 +8,12 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
 
 #include "ch-placement.h"
 #include "src/modules/placement-mod.h"
+#include "src/modules/placement-snapshot.h"
 
 /* externs pointing to api for each module */
 extern struct placement_mod_map xor_mod_map;
@@ -20,6 +23,13 @@ extern struct placement_mod_map hash_lookup3_mod_map;
 extern struct placement_mod_map hash_spooky_mod_map;
 extern struct placement_mod_map two_d_mod_map;
 extern struct placement_mod_map static_modulo_mod_map;
+extern struct placement_mod_map skeleton_mod_map;
+extern struct placement_mod_map maglev_mod_map;
+extern struct placement_mod_map jump_mod_map;
+extern struct placement_mod_map anchor_mod_map;
+extern struct placement_mod_map multiprobe_mod_map;
+extern struct placement_mod_map straw2_mod_map;
+extern struct placement_mod_map partition_mod_map;
 
 /* table of available modules */
 static struct placement_mod_map *table[] = 
@@ -31,12 +41,22 @@ static struct placement_mod_map *table[] =
     &hash_spooky_mod_map,
     &two_d_mod_map,
     &static_modulo_mod_map,
+    &skeleton_mod_map,
+    &maglev_mod_map,
+    &jump_mod_map,
+    &anchor_mod_map,
+    &multiprobe_mod_map,
+    &straw2_mod_map,
+    &partition_mod_map,
     NULL,
 };
 
 struct ch_placement_instance
 {
     struct placement_mod *mod;
+    const char *type;  /* module name */
+    void *map;         /* snapshot the instance was loaded from, if any */
+    size_t map_size;
 };
 
 #ifdef CH_ENABLE_CRUSH
@@ -47,9 +67,10 @@ struct ch_placement_instance* ch_placement_initialize_crush(struct crush_map *ma
 {
     struct ch_placement_instance *instance = NULL;
 
-    instance = malloc(sizeof(*instance));
+    instance = calloc(1, sizeof(*instance));
     if(instance)
     {
+        instance->type = "crush";
         instance->mod = placement_mod_crush(map, weight, n_weight);
         if(!instance->mod)
         {
@@ -65,6 +86,13 @@ struct ch_placement_instance* ch_placement_initialize_crush(struct crush_map *ma
 
 struct ch_placement_instance* ch_placement_initialize(const char* name,
     int n_svrs, int virt_factor, int seed)
+{
+    return(ch_placement_initialize_params(name, n_svrs, virt_factor, seed,
+        NULL));
+}
+
+struct ch_placement_instance* ch_placement_initialize_params(const char* name,
+    int n_svrs, int virt_factor, int seed, const char* params)
 {
     struct ch_placement_instance *instance = NULL;
     int i;
@@ -73,10 +101,23 @@ struct ch_placement_instance* ch_placement_initialize(const char* name,
     {
         if(strcmp(name, table[i]->type) == 0)
         {
-            instance = malloc(sizeof(*instance));
+            /* modules without a parameter list cannot honor one */
+            if(params && !table[i]->initiate_params)
+            {
+                fprintf(stderr, "Error: %s does not accept parameters\n",
+                    name);
+                break;
+            }
+            instance = calloc(1, sizeof(*instance));
             if(instance)
             {
-                instance->mod = table[i]->initiate(n_svrs, virt_factor, seed);
+                instance->type = table[i]->type;
+                if(table[i]->initiate_params)
+                    instance->mod = table[i]->initiate_params(n_svrs,
+                        virt_factor, seed, params);
+                else
+                    instance->mod = table[i]->initiate(n_svrs, virt_factor,
+                        seed);
                 if(!instance->mod)
                 {
                     free(instance);
@@ -90,7 +131,43 @@ struct ch_placement_instance* ch_placement_initialize(const char* name,
     return(instance);
 }
 
-void placement_create_striped_random(struct placement_mod *mod, 
+struct ch_placement_instance* ch_placement_initialize_weighted(
+    const char* name, int n_svrs, int virt_factor, int seed,
+    const double *weights, const char* params)
+{
+    struct ch_placement_instance *instance = NULL;
+    int i;
+
+    for(i=0; table[i]!= NULL; i++)
+    {
+        if(strcmp(name, table[i]->type) == 0)
+        {
+            if(!table[i]->initiate_weighted)
+            {
+                fprintf(stderr, "Error: %s does not support weights\n",
+                    name);
+                break;
+            }
+            instance = calloc(1, sizeof(*instance));
+            if(instance)
+            {
+                instance->type = table[i]->type;
+                instance->mod = table[i]->initiate_weighted(n_svrs,
+                    virt_factor, seed, weights, params);
+                if(!instance->mod)
+                {
+                    free(instance);
+                    instance = NULL;
+                }
+            }
+            break;
+        }
+    }
+
+    return(instance);
+}
+
+void placement_create_striped_random(struct placement_mod *mod, uint64_t *rng,
     unsigned long file_size, 
   unsigned int replication, unsigned int max_stripe_width, 
   unsigned int strip_size,
@@ -136,12 +213,34 @@ void placement_create_striped_random(struct placement_mod *mod,
     /* oid of each object */
     for(i=0; i<stripe_width; i++)
     {
-        oids[i] = ch_placement_random_u64();
+        oids[i] = placement_random_u64(rng);
     }
 
     return;
 }
 
+void placement_find_closest_batch_generic(struct placement_mod *mod,
+  const uint64_t *objs, unsigned long n_objs,
+  unsigned int replication, unsigned long *server_idxs)
+{
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        mod->find_closest(mod, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
+double placement_wtime(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+
+    return((double)tp.tv_sec + (double)tp.tv_nsec / 1.0e9);
+}
+
 /* TODO: optimize this */
 uint64_t ch_placement_random_u64(void)
 {
@@ -159,13 +258,122 @@ uint64_t ch_placement_random_u64(void)
     return(bigr);
 }
 
+/* splitmix64: the state is a plain counter, so any seed (including 0)
+ * gives a full-period stream and the caller can keep it anywhere
+ */
+uint64_t ch_placement_random_u64_r(uint64_t *state)
+{
+    uint64_t z;
+
+    *state += 0x9e3779b97f4a7c15ULL;
+    z = *state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return(z ^ (z >> 31));
+}
+
+static __thread void *scratch;
+static __thread size_t scratch_size;
+
+void* placement_scratch(size_t size)
+{
+    void *buf;
+
+    if(size > scratch_size)
+    {
+        buf = realloc(scratch, size);
+        if(!buf)
+        {
+            fprintf(stderr, "Error: failed to allocate %lu bytes of lookup scratch space\n",
+                (unsigned long)size);
+            abort();
+        }
+        scratch = buf;
+        scratch_size = size;
+    }
+
+    return(scratch);
+}
+
+uint64_t placement_random_u64(uint64_t *rng)
+{
+    if(rng)
+        return(ch_placement_random_u64_r(rng));
+    return(ch_placement_random_u64());
+}
+
 void ch_placement_finalize(struct ch_placement_instance *instance)
 {
     instance->mod->finalize(instance->mod);
+    if(instance->map)
+        munmap(instance->map, instance->map_size);
     free(instance);
     return;
 }
 
+int ch_placement_save(
+    struct ch_placement_instance *instance,
+    const char *path)
+{
+    struct placement_snapshot snap;
+    int ret;
+
+    if(!instance->mod->save)
+        return(-1);
+
+    ret = placement_snapshot_create(&snap, path);
+    if(ret < 0)
+        return(-1);
+    instance->mod->save(instance->mod, &snap);
+
+    return(placement_snapshot_finish(&snap, path, instance->type));
+}
+
+struct ch_placement_instance* ch_placement_load_mmap(const char *path)
+{
+    struct ch_placement_instance *instance = NULL;
+    struct placement_snapshot snap;
+    char type[PLACEMENT_SNAPSHOT_TYPE_MAX];
+    void *map;
+    size_t map_size;
+    int ret;
+    int i;
+
+    ret = placement_snapshot_map(path, &snap, type, &map, &map_size);
+    if(ret < 0)
+        return(NULL);
+
+    for(i=0; table[i]!= NULL; i++)
+    {
+        if(strcmp(type, table[i]->type) == 0 && table[i]->load)
+        {
+            instance = calloc(1, sizeof(*instance));
+            if(instance)
+            {
+                instance->type = table[i]->type;
+                instance->map = map;
+                instance->map_size = map_size;
+                instance->mod = table[i]->load(&snap);
+                if(!instance->mod)
+                {
+                    free(instance);
+                    instance = NULL;
+                }
+            }
+            break;
+        }
+    }
+
+    if(!instance)
+    {
+        fprintf(stderr, "Error: failed to load %s snapshot %s\n", type, path);
+        munmap(map, map_size);
+    }
+
+    return(instance);
+}
+
 void ch_placement_find_closest(
     struct ch_placement_instance *instance,
     uint64_t obj, 
@@ -176,6 +384,149 @@ void ch_placement_find_closest(
     return;
 }
 
+void ch_placement_find_closest_batch(
+    struct ch_placement_instance *instance,
+    const uint64_t *objs,
+    unsigned long n_objs,
+    unsigned int replication,
+    unsigned long* server_idxs)
+{
+    instance->mod->find_closest_batch(instance->mod, objs, n_objs,
+        replication, server_idxs);
+    return;
+}
+
+int ch_placement_get_stats(
+    struct ch_placement_instance *instance,
+    struct ch_placement_stats *stats)
+{
+    if(!instance->mod->get_stats)
+        return(-1);
+
+    return(instance->mod->get_stats(instance->mod, stats));
+}
+
+int ch_placement_add_server(
+    struct ch_placement_instance *instance,
+    unsigned long svr_idx,
+    struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    if(!instance->mod->add_server)
+        return(-1);
+
+    return(instance->mod->add_server(instance->mod, svr_idx, arcs, n_arcs));
+}
+
+int ch_placement_remove_server(
+    struct ch_placement_instance *instance,
+    unsigned long svr_idx,
+    struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    if(!instance->mod->remove_server)
+        return(-1);
+
+    return(instance->mod->remove_server(instance->mod, svr_idx, arcs,
+        n_arcs));
+}
+
+int ch_placement_set_load(
+    struct ch_placement_instance *instance,
+    unsigned long svr_idx,
+    unsigned long load)
+{
+    if(!instance->mod->set_load)
+        return(-1);
+
+    return(instance->mod->set_load(instance->mod, svr_idx, load));
+}
+
+int ch_placement_get_load(
+    struct ch_placement_instance *instance,
+    unsigned long svr_idx,
+    unsigned long *load)
+{
+    if(!instance->mod->get_load)
+        return(-1);
+
+    return(instance->mod->get_load(instance->mod, svr_idx, load));
+}
+
+int placement_parse_params(const char *name, const char *params,
+    placement_param_fn handler, void *state)
+{
+    char* dup_params;
+    char* param;
+    char* saveptr = NULL;
+    int ret = 0;
+
+    if(!params)
+        return(0);
+
+    dup_params = strdup(params);
+    if(!dup_params)
+        return(-1);
+
+    /* look through comma delimited list of parameters */
+    param = strtok_r(dup_params, ",", &saveptr);
+    while(param)
+    {
+        ret = handler(state, param);
+        if(ret == PLACEMENT_PARAM_UNKNOWN)
+        {
+            fprintf(stderr, "Error: unknown %s parameter \"%s\"\n", name,
+                param);
+            ret = -1;
+        }
+        if(ret < 0)
+            break;
+
+        param = strtok_r(NULL, ",", &saveptr);
+    }
+    free(dup_params);
+
+    return(ret);
+}
+
+int placement_no_arcs(struct ch_placement_arc **arcs, unsigned long *n_arcs)
+{
+    if(!arcs)
+        return(0);
+
+    *arcs = NULL;
+    *n_arcs = 0;
+
+    return(CH_PLACEMENT_NO_ARCS);
+}
+
+int placement_arc_append(struct placement_arc_list *list, uint64_t start,
+    uint64_t end, unsigned int n_rings, unsigned int ring,
+    unsigned long old_svr, unsigned long new_svr)
+{
+    struct ch_placement_arc *arcs;
+    struct ch_placement_arc *arc;
+
+    if(list->n_arcs == list->size)
+    {
+        arcs = realloc(list->arcs, sizeof(*arcs)*(list->size ? list->size*2 : 16));
+        if(!arcs)
+            return(-1);
+        list->arcs = arcs;
+        list->size = list->size ? list->size*2 : 16;
+    }
+
+    arc = &list->arcs[list->n_arcs++];
+    arc->start = start;
+    arc->end = end;
+    arc->n_rings = n_rings;
+    arc->ring = ring;
+    arc->old_svr = old_svr;
+    arc->new_svr = new_svr;
+
+    return(0);
+}
+
 void ch_placement_create_striped(
     struct ch_placement_instance *instance,
     unsigned long file_size, 
@@ -186,7 +537,24 @@ void ch_placement_create_striped(
     uint64_t *oids, 
     unsigned long *sizes)
 {
-    instance->mod->create_striped(instance->mod, file_size,
+    instance->mod->create_striped(instance->mod, NULL, file_size,
+        replication, max_stripe_width, strip_size, num_objects, oids,
+        sizes);
+    return;
+}
+
+void ch_placement_create_striped_r(
+    struct ch_placement_instance *instance,
+    uint64_t *rng_state,
+    unsigned long file_size, 
+    unsigned int replication, 
+    unsigned int max_stripe_width, 
+    unsigned int strip_size,
+    unsigned int* num_objects,
+    uint64_t *oids, 
+    unsigned long *sizes)
+{
+    instance->mod->create_striped(instance->mod, rng_state, file_size,
         replication, max_stripe_width, strip_size, num_objects, oids,
         sizes);
     return;
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* AnchorHash (Mendelson et al.).  The servers are buckets in a fixed
+ * anchor of "capacity" buckets, of which the first n_svrs start out
+ * working.  An object hashes to a bucket in the anchor; if that bucket
+ * was removed, it rehashes among the buckets that were still working at
+ * the time, following the chain of replacements kept for each removed
+ * bucket.  Lookups take O(1) expected steps (about ln(capacity/working)).
+ *
+ * Removing a bucket only moves the objects it held, and is an O(1) update
+ * of four arrays.  Buckets come back in the reverse order of their
+ * removal, which restores the placement exactly; servers past n_svrs
+ * (up to the capacity) can be added the same way.
+ *
+ * Further replicas repeat the lookup with the object id hashed under a new
+ * salt, skipping servers already chosen.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "src/modules/placement-mod.h"
+#include "src/lookup3.h"
+
+static struct placement_mod* placement_mod_anchor(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_anchor_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
+static void placement_find_closest_anchor(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_find_closest_batch_anchor(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_finalize_anchor(struct placement_mod *mod);
+static int placement_get_stats_anchor(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+static int placement_add_server_anchor(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static int placement_remove_server_anchor(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+
+struct placement_mod_map anchor_mod_map =
+{
+    .type = "anchor",
+    .initiate = placement_mod_anchor,
+    .initiate_params = placement_mod_anchor_params,
+};
+
+/* salts tried for one replica before falling back to the next free server */
+#define ANCHOR_SALTS_MAX 32
+
+struct anchor_state
+{
+    uint32_t capacity;      /* buckets in the anchor */
+    uint32_t n_working;
+    uint32_t seed;
+    uint32_t *removed_at;   /* working set size after each bucket's removal,
+                             * 0 for working buckets */
+    uint32_t *working;      /* the working buckets, in the first n_working */
+    uint32_t *location;     /* position of each bucket in working */
+    uint32_t *successor;    /* bucket that replaced each removed bucket */
+    uint32_t *removed;      /* stack of removed buckets, last on top */
+    uint32_t n_removed;
+};
+
+static int anchor_parse_param(void *state, const char *param);
+
+struct placement_mod* placement_mod_anchor(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_anchor_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_anchor_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
+{
+    struct placement_mod *mod_anchor;
+    struct anchor_state *mod_state;
+    uint32_t b;
+
+    (void)virt_factor;
+
+    if(n_svrs < 1)
+        return(NULL);
+
+    mod_anchor = calloc(1, sizeof(*mod_anchor));
+    if(!mod_anchor)
+        return(NULL);
+
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_state)
+    {
+        free(mod_anchor);
+        return(NULL);
+    }
+
+    mod_anchor->data = mod_state;
+    mod_state->capacity = n_svrs;
+    mod_state->n_working = n_svrs;
+    mod_state->seed = seed;
+
+    if(placement_parse_params("anchor", params, anchor_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_anchor);
+        return(NULL);
+    }
+    if(mod_state->capacity < (uint32_t)n_svrs)
+    {
+        fprintf(stderr, "Error: anchor capacity must be at least the number of servers\n");
+        free(mod_state);
+        free(mod_anchor);
+        return(NULL);
+    }
+
+    mod_state->removed_at = calloc(mod_state->capacity,
+        sizeof(*mod_state->removed_at));
+    mod_state->working = malloc(sizeof(*mod_state->working)*mod_state->capacity);
+    mod_state->location = malloc(sizeof(*mod_state->location)*mod_state->capacity);
+    mod_state->successor = malloc(sizeof(*mod_state->successor)*mod_state->capacity);
+    mod_state->removed = malloc(sizeof(*mod_state->removed)*mod_state->capacity);
+    if(!mod_state->removed_at || !mod_state->working ||
+        !mod_state->location || !mod_state->successor || !mod_state->removed)
+    {
+        placement_finalize_anchor(mod_anchor);
+        return(NULL);
+    }
+
+    for(b=0; b<mod_state->capacity; b++)
+    {
+        mod_state->working[b] = b;
+        mod_state->location[b] = b;
+        mod_state->successor[b] = b;
+    }
+    /* the buckets past n_svrs start out removed, the last one first */
+    for(b=mod_state->capacity; b>mod_state->n_working; b--)
+    {
+        mod_state->removed[mod_state->n_removed++] = b-1;
+        mod_state->removed_at[b-1] = b-1;
+    }
+
+    mod_anchor->find_closest = placement_find_closest_anchor;
+    mod_anchor->find_closest_batch = placement_find_closest_batch_anchor;
+    mod_anchor->create_striped = placement_create_striped_random;
+    mod_anchor->finalize = placement_finalize_anchor;
+    mod_anchor->get_stats = placement_get_stats_anchor;
+    mod_anchor->add_server = placement_add_server_anchor;
+    mod_anchor->remove_server = placement_remove_server_anchor;
+
+    return(mod_anchor);
+}
+
+/* parses one module parameter; see the ring module for the format.
+ * capacity is the number of buckets in the anchor, which bounds the
+ * server indices that can ever be added.
+ */
+static int anchor_parse_param(void *state, const char *param)
+{
+    struct anchor_state *mod_state = state;
+
+    if(sscanf(param, "capacity:%u", &mod_state->capacity) == 1)
+    {
+        /* checked against n_svrs by the caller */
+    }
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* returns the working bucket for a key that is already hashed */
+static inline uint32_t anchor_get_bucket(struct anchor_state *mod_state,
+    uint64_t key)
+{
+    const uint32_t *removed_at = mod_state->removed_at;
+    uint32_t b = key % mod_state->capacity;
+    uint32_t h, h1, h2;
+
+    /* while b is removed, rehash among the buckets that were working when
+     * it was; those that have been removed since lead on through their
+     * successors to one that was working then
+     */
+    while(removed_at[b] > 0)
+    {
+        h1 = b;
+        h2 = mod_state->seed;
+        ch_bj_hashlittle2(&key, sizeof(key), &h1, &h2);
+        h = (h1 + (((uint64_t)h2)<<32)) % removed_at[b];
+        while(removed_at[h] >= removed_at[b])
+            h = mod_state->successor[h];
+        b = h;
+    }
+
+    return(b);
+}
+
+static inline void anchor_find_closest(struct anchor_state *mod_state,
+    uint64_t obj, unsigned int replication, unsigned long *server_idxs)
+{
+    uint32_t h1, h2;
+    uint32_t salt = 0;
+    unsigned long svr;
+    unsigned int found, i, tries;
+
+    for(found=0; found<replication && found<mod_state->n_working; found++)
+    {
+        for(tries=0; ; tries++)
+        {
+            /* hash incoming object id (this is like a pre conditioner so
+             * that we balance load even if id space is not well
+             * distributed); each attempt uses the next salt
+             */
+            h1 = salt++;
+            h2 = mod_state->seed;
+            ch_bj_hashlittle2(&obj, sizeof(obj), &h1, &h2);
+            svr = anchor_get_bucket(mod_state,
+                h1 + (((uint64_t)h2)<<32));
+            for(i=0; i<found && server_idxs[i] != svr; i++);
+            if(i == found)
+                break;
+
+            /* only likely when replication is close to the number of
+             * working servers
+             */
+            if(tries == ANCHOR_SALTS_MAX)
+            {
+                do
+                {
+                    svr = mod_state->working[(mod_state->location[svr] + 1) %
+                        mod_state->n_working];
+                    for(i=0; i<found && server_idxs[i] != svr; i++);
+                } while(i < found);
+                break;
+            }
+        }
+        server_idxs[found] = svr;
+    }
+
+    /* fewer servers than replicas */
+    for(; found<replication; found++)
+        server_idxs[found] = UINT64_MAX;
+
+    return;
+}
+
+static void placement_find_closest_anchor(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    anchor_find_closest(mod->data, obj, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_anchor(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct anchor_state *mod_state = mod->data;
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        anchor_find_closest(mod_state, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
+/* only the most recently removed bucket can come back, which restores the
+ * placement from before its removal.  With no servers removed, that is the
+ * next bucket up to the capacity.
+ */
+static int placement_add_server_anchor(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct anchor_state *mod_state = mod->data;
+    uint32_t b;
+
+    if(mod_state->n_removed == 0 ||
+        mod_state->removed[mod_state->n_removed-1] != svr_idx)
+        return(-1);
+
+    b = mod_state->removed[--mod_state->n_removed];
+    mod_state->removed_at[b] = 0;
+    mod_state->location[mod_state->working[mod_state->n_working]] =
+        mod_state->n_working;
+    mod_state->working[mod_state->location[b]] = b;
+    mod_state->successor[b] = b;
+    mod_state->n_working++;
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static int placement_remove_server_anchor(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct anchor_state *mod_state = mod->data;
+    uint32_t b = svr_idx;
+    uint32_t last;
+
+    if(svr_idx >= mod_state->capacity ||
+        mod_state->removed_at[b] > 0 || mod_state->n_working == 1)
+        return(-1);
+
+    /* the last working bucket takes b's place in the working list */
+    mod_state->removed[mod_state->n_removed++] = b;
+    mod_state->n_working--;
+    mod_state->removed_at[b] = mod_state->n_working;
+    last = mod_state->working[mod_state->n_working];
+    mod_state->working[mod_state->location[b]] = last;
+    mod_state->successor[b] = last;
+    mod_state->location[last] = mod_state->location[b];
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static void placement_finalize_anchor(struct placement_mod *mod)
+{
+    struct anchor_state *mod_state = mod->data;
+
+    free(mod_state->removed_at);
+    free(mod_state->working);
+    free(mod_state->location);
+    free(mod_state->successor);
+    free(mod_state->removed);
+    free(mod_state);
+    free(mod);
+
+    return;
+}
+
+static int placement_get_stats_anchor(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct anchor_state *mod_state = mod->data;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->table_bytes = (unsigned long)mod_state->capacity *
+        (sizeof(*mod_state->removed_at) + sizeof(*mod_state->working) +
+        sizeof(*mod_state->location) + sizeof(*mod_state->successor) +
+        sizeof(*mod_state->removed));
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
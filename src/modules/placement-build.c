@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "src/modules/placement-build.h"
+#include "src/lookup3.h"
+
+/* the radix sort handles this many bits of the key per pass; 6 passes
+ * cover all 64 bits, and an even number of passes leaves the result in the
+ * caller's arrays
+ */
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES 6
+
+int placement_build_parse(const char *name, enum placement_build *build)
+{
+    if(strcmp(name, "auto") == 0)
+        *build = PLACEMENT_BUILD_AUTO;
+    else if(strcmp(name, "serial") == 0)
+        *build = PLACEMENT_BUILD_SERIAL;
+    else if(strcmp(name, "parallel") == 0)
+        *build = PLACEMENT_BUILD_PARALLEL;
+    else
+        return(-1);
+
+    return(0);
+}
+
+int placement_build_parallel(enum placement_build build,
+    unsigned long n_vnodes)
+{
+    if(build == PLACEMENT_BUILD_AUTO)
+        return(n_vnodes >= PLACEMENT_BUILD_MIN);
+
+    return(build == PLACEMENT_BUILD_PARALLEL);
+}
+
+int placement_build_threads(int requested)
+{
+#ifdef _OPENMP
+    if(requested <= 0)
+        return(omp_get_max_threads());
+    return(requested);
+#else
+    return(1);
+#endif
+}
+
+int placement_hash_vnodes(uint64_t *ids, uint32_t *svrs,
+    unsigned int n_svrs, unsigned int virt_factor, const uint32_t *counts,
+    int seed, int threads)
+{
+    unsigned long *offsets = NULL;
+    unsigned long i;
+
+    /* where each server's vnodes start */
+    if(counts)
+    {
+        offsets = malloc(sizeof(*offsets)*n_svrs);
+        if(!offsets)
+            return(-1);
+        offsets[0] = 0;
+        for(i=1; i<n_svrs; i++)
+            offsets[i] = offsets[i-1] + counts[i-1];
+    }
+
+#pragma omp parallel for schedule(static) num_threads(threads)
+    for(i=0; i<n_svrs; i++)
+    {
+        uint64_t idx = i;
+        unsigned long pos = counts ? offsets[i] : (unsigned long)i*virt_factor;
+        uint32_t n = counts ? counts[i] : virt_factor;
+        uint32_t h1, h2;
+        uint32_t j;
+
+        for(j=0; j<n; j++)
+        {
+            h1 = j;
+            h2 = seed;
+            ch_bj_hashlittle2(&idx, sizeof(idx), &h1, &h2);
+            ids[pos+j] = h1 + (((uint64_t)h2)<<32);
+            svrs[pos+j] = i;
+        }
+    }
+
+    free(offsets);
+    return(0);
+}
+
+int placement_radix_sort(uint64_t *ids, uint32_t *svrs, unsigned long n,
+    int threads)
+{
+    uint64_t *tmp_ids;
+    uint32_t *tmp_svrs;
+    unsigned long *hist;
+    uint64_t *src_ids = ids, *dst_ids;
+    uint32_t *src_svrs = svrs, *dst_svrs;
+    uint64_t *swap_ids;
+    uint32_t *swap_svrs;
+    unsigned long i, j;
+    uint32_t svr;
+    int pass;
+
+    tmp_ids = malloc(sizeof(*tmp_ids)*n);
+    tmp_svrs = malloc(sizeof(*tmp_svrs)*n);
+    hist = malloc(sizeof(*hist)*RADIX_BUCKETS*threads);
+    if(!tmp_ids || !tmp_svrs || !hist)
+    {
+        free(tmp_ids);
+        free(tmp_svrs);
+        free(hist);
+        return(-1);
+    }
+    dst_ids = tmp_ids;
+    dst_svrs = tmp_svrs;
+
+    for(pass=0; pass<RADIX_PASSES; pass++)
+    {
+        int shift = pass*RADIX_BITS;
+
+        /* each thread counts the digits in its own contiguous chunk, then
+         * scatters that chunk after the same digit from lower numbered
+         * threads, which keeps every pass stable
+         */
+#pragma omp parallel num_threads(threads)
+        {
+            unsigned int t = 0, nt = 1;
+            unsigned long *my_hist;
+            unsigned long lo, hi, k, offset, count;
+            unsigned int d, u;
+
+#ifdef _OPENMP
+            t = omp_get_thread_num();
+            nt = omp_get_num_threads();
+#endif
+            lo = n / nt * t + (t < n % nt ? t : n % nt);
+            hi = lo + n / nt + (t < n % nt);
+            my_hist = &hist[t*RADIX_BUCKETS];
+
+            memset(my_hist, 0, sizeof(*my_hist)*RADIX_BUCKETS);
+            for(k=lo; k<hi; k++)
+                my_hist[(src_ids[k] >> shift) & (RADIX_BUCKETS-1)]++;
+
+#pragma omp barrier
+#pragma omp single
+            {
+                offset = 0;
+                for(d=0; d<RADIX_BUCKETS; d++)
+                {
+                    for(u=0; u<nt; u++)
+                    {
+                        count = hist[u*RADIX_BUCKETS+d];
+                        hist[u*RADIX_BUCKETS+d] = offset;
+                        offset += count;
+                    }
+                }
+            }
+
+            for(k=lo; k<hi; k++)
+            {
+                d = (src_ids[k] >> shift) & (RADIX_BUCKETS-1);
+                dst_ids[my_hist[d]] = src_ids[k];
+                dst_svrs[my_hist[d]] = src_svrs[k];
+                my_hist[d]++;
+            }
+        }
+
+        swap_ids = src_ids;
+        src_ids = dst_ids;
+        dst_ids = swap_ids;
+        swap_svrs = src_svrs;
+        src_svrs = dst_svrs;
+        dst_svrs = swap_svrs;
+    }
+
+    if(src_ids != ids)
+    {
+        memcpy(ids, src_ids, sizeof(*ids)*n);
+        memcpy(svrs, src_svrs, sizeof(*svrs)*n);
+    }
+    free(tmp_ids);
+    free(tmp_svrs);
+    free(hist);
+
+    /* the sort is stable, so equal ids are still in input order; put them
+     * in server order instead.  Equal ids are rare, so this is cheap.
+     */
+    for(i=1; i<n; i++)
+    {
+        if(ids[i] != ids[i-1])
+            continue;
+        svr = svrs[i];
+        for(j=i; j>0 && ids[j-1] == ids[i] && svrs[j-1] > svr; j--)
+            svrs[j] = svrs[j-1];
+        svrs[j] = svr;
+    }
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef PLACEMENT_BUILD_H
+#define PLACEMENT_BUILD_H
+
+#include <stdint.h>
+
+/* helpers for building large vnode tables with several threads.  Without
+ * OpenMP support they still work, but run on a single thread.
+ */
+
+/* how a module builds its table */
+enum placement_build
+{
+    PLACEMENT_BUILD_AUTO = 0, /* parallel for at least PLACEMENT_BUILD_MIN vnodes */
+    PLACEMENT_BUILD_SERIAL,   /* one thread, qsort() */
+    PLACEMENT_BUILD_PARALLEL, /* threaded hashing and radix sort */
+};
+
+#define PLACEMENT_BUILD_MIN 65536
+
+/* handles a module's "build:<serial|parallel|auto>" parameter; returns -1
+ * if the name is unknown
+ */
+int placement_build_parse(const char *name, enum placement_build *build);
+
+/* returns 1 if a table of n_vnodes should be built in parallel */
+int placement_build_parallel(enum placement_build build,
+    unsigned long n_vnodes);
+
+/* number of threads to use for a "build_threads" request; 0 means as many
+ * as OpenMP would use by default
+ */
+int placement_build_threads(int requested);
+
+/* hashes the vnodes of every server into ids/svrs, grouped by server:
+ * server i gets virt_factor vnodes, or counts[i] if counts is not NULL.
+ * Vnode j of server i has the same id that the serial constructors give it.
+ * Returns -1 on allocation failure.
+ */
+int placement_hash_vnodes(uint64_t *ids, uint32_t *svrs,
+    unsigned int n_svrs, unsigned int virt_factor, const uint32_t *counts,
+    int seed, int threads);
+
+/* sorts ids in ascending order with an LSD radix sort, carrying svrs along.
+ * Equal ids are ordered by server index, which is the same order the
+ * modules' qsort() comparison functions give them, so the result matches
+ * a serial build exactly.  Returns -1 on allocation failure.
+ */
+int placement_radix_sort(uint64_t *ids, uint32_t *svrs, unsigned long n,
+    int threads);
+
+#endif /* PLACEMENT_BUILD_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -30,7 +30,7 @@ struct placement_mod* placement_mod_crush(struct crush_map *map, __u32 *weight,
     struct placement_mod *mod_crush;
     struct crush_state *mod_state;
 
-    mod_crush = malloc(sizeof(*mod_crush));
+    mod_crush = calloc(1, sizeof(*mod_crush));
     if(!mod_crush)
         return(NULL);
 
@@ -47,6 +47,7 @@ struct placement_mod* placement_mod_crush(struct crush_map *map, __u32 *weight,
     mod_state->n_weight = n_weight;
 
     mod_crush->find_closest = placement_find_closest_crush;
+    mod_crush->find_closest_batch = placement_find_closest_batch_generic;
     mod_crush->create_striped = placement_create_striped_random;
     mod_crush->finalize = placement_finalize_crush;
 
@@ -58,10 +59,19 @@ static void placement_find_closest_crush(struct placement_mod *mod, uint64_t obj
 {
     struct crush_state *mod_state = mod->data;
     int ret;
-    int result[CH_MAX_REPLICATION];
-    int scratch[CH_MAX_REPLICATION*3];
+    int result_stack[CH_STACK_REPLICATION];
+    int scratch_stack[CH_STACK_REPLICATION*3];
+    int *result = result_stack;
+    int *scratch = scratch_stack;
     int i;
 
+    /* wide layouts don't fit in the stack arrays */
+    if(replication > CH_STACK_REPLICATION)
+    {
+        result = placement_scratch(sizeof(*result)*replication*4);
+        scratch = &result[replication];
+    }
+
     ret = crush_do_rule(mod_state->map, 0, obj, result, replication, 
         mod_state->weight, mod_state->n_weight, scratch);
     assert(ret == replication);
@@ -4,17 +4,24 @@
  *
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <assert.h>
 
 #include "ch-placement.h"
 #include "src/modules/placement-mod.h"
+#include "src/modules/placement-build.h"
+#include "src/modules/placement-hrw.h"
 #include "src/lookup3.h"
 
 static struct placement_mod* placement_mod_hash_lookup3(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_hash_lookup3_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
 static void placement_find_closest_hash_lookup3(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
     unsigned long *server_idxs);
+static void placement_find_closest_batch_hash_lookup3(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
 static void placement_finalize_hash_lookup3(struct placement_mod *mod);
 
 static uint64_t placement_distance_hash(uint64_t a, uint64_t b);
@@ -23,6 +30,7 @@ struct placement_mod_map hash_lookup3_mod_map =
 {
     .type = "hash_lookup3",
     .initiate = placement_mod_hash_lookup3,
+    .initiate_params = placement_mod_hash_lookup3_params,
 };
 
 struct vnode
@@ -35,21 +43,35 @@ struct hash_lookup3_state
 {
     unsigned int n_svrs;
     unsigned int virt_factor;
-    struct vnode *virt_table;
+    struct vnode *virt_table;   /* only kept for the reference scan */
+    uint64_t *ids;              /* vnode ids, in virt_table order */
+    placement_hrw_fn kernel;    /* NULL for the reference scan */
 };
 
+/* number of objects scored together in each pass over the vnode table */
+#define HASH_LOOKUP3_TILE 16
+
+static int hash_lookup3_parse_param(void *state, const char *param);
+
 struct placement_mod* placement_mod_hash_lookup3(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_hash_lookup3_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_hash_lookup3_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
 {
     struct placement_mod *mod_hash_lookup3;
     struct hash_lookup3_state *mod_state;
     uint32_t h1, h2;
     uint64_t i, j;
+    unsigned long n = (unsigned long)n_svrs*virt_factor;
 
-    mod_hash_lookup3 = malloc(sizeof(*mod_hash_lookup3));
+    mod_hash_lookup3 = calloc(1, sizeof(*mod_hash_lookup3));
     if(!mod_hash_lookup3)
         return(NULL);
 
-    mod_state = malloc(sizeof(*mod_state));
+    mod_state = calloc(1, sizeof(*mod_state));
     if(!mod_state)
     {
         free(mod_hash_lookup3);
@@ -58,6 +80,15 @@ struct placement_mod* placement_mod_hash_lookup3(int n_svrs, int virt_factor, in
 
     mod_hash_lookup3->data = mod_state;
 
+    mod_state->kernel = placement_hrw_select(PLACEMENT_HRW_LOOKUP3, "auto");
+    if(placement_parse_params("hash_lookup3", params, hash_lookup3_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_hash_lookup3);
+        return(NULL);
+    }
+
     mod_state->virt_table = malloc(sizeof(*mod_state->virt_table)*n_svrs*virt_factor);
     if(!mod_state->virt_table)
     {
@@ -70,8 +101,9 @@ struct placement_mod* placement_mod_hash_lookup3(int n_svrs, int virt_factor, in
     mod_state->virt_factor = virt_factor;
 
     /* create virt_factor virtual nodes for each server index by jenkins
-     * hashing server index
+     * hashing server index; large tables are hashed by several threads
      */
+#pragma omp parallel for private(j, h1, h2) if((unsigned long)n_svrs*virt_factor >= PLACEMENT_BUILD_MIN)
     for(i=0; i<n_svrs; i++)
     {
         for(j=0; j<virt_factor; j++)
@@ -84,41 +116,153 @@ struct placement_mod* placement_mod_hash_lookup3(int n_svrs, int virt_factor, in
         }
     }
 
+    /* the kernels read the ids as a plain array */
+    if(mod_state->kernel)
+    {
+        mod_state->ids = malloc(sizeof(*mod_state->ids)*n);
+        if(!mod_state->ids)
+        {
+            placement_finalize_hash_lookup3(mod_hash_lookup3);
+            return(NULL);
+        }
+        for(i=0; i<n; i++)
+            mod_state->ids[i] = mod_state->virt_table[i].svr_id;
+        free(mod_state->virt_table);
+        mod_state->virt_table = NULL;
+    }
+
     mod_hash_lookup3->find_closest = placement_find_closest_hash_lookup3;
+    mod_hash_lookup3->find_closest_batch = placement_find_closest_batch_hash_lookup3;
     mod_hash_lookup3->create_striped = placement_create_striped_random;
     mod_hash_lookup3->finalize = placement_finalize_hash_lookup3;
 
     return(mod_hash_lookup3);
 }
 
-static void placement_find_closest_hash_lookup3(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
+/* parses one module parameter; see the ring module for the format.
+ * kernel picks the scoring kernel (see placement-hrw.h), or "reference"
+ * for the original scan.  Every kernel places objects identically.
+ */
+static int hash_lookup3_parse_param(void *state, const char *param)
+{
+    struct hash_lookup3_state *mod_state = state;
+
+    if(strncmp(param, "kernel:", strlen("kernel:")) == 0)
+    {
+        if(placement_hrw_parse(PLACEMENT_HRW_LOOKUP3, param + strlen("kernel:"),
+            &mod_state->kernel) < 0)
+            return(-1);
+    }
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* scores a tile of up to HASH_LOOKUP3_TILE objects against every vnode in a
+ * single pass over the table, caching the distance of each candidate kept
+ * so far.  This is the "reference" kernel, which calls the library hash
+ * for every vnode.
+ */
+static void hash_lookup3_find_closest_tile(struct hash_lookup3_state *mod_state,
+    const uint64_t *objs, unsigned int n_objs, unsigned int replication,
     unsigned long* server_idxs)
 {
-    struct hash_lookup3_state *mod_state = mod->data;
-    struct vnode closest[CH_MAX_REPLICATION];
+    struct vnode closest_stack[HASH_LOOKUP3_TILE*CH_STACK_REPLICATION];
+    uint64_t dist_stack[HASH_LOOKUP3_TILE*CH_STACK_REPLICATION];
+    struct vnode *closest = closest_stack;
+    uint64_t *dist = dist_stack;
     struct vnode svr, tmp_svr;
-    unsigned int i,j;
+    uint64_t svr_dist, tmp_dist;
+    unsigned int i,j,k;
+
+    /* wide layouts don't fit in the stack arrays */
+    if(replication > CH_STACK_REPLICATION)
+    {
+        closest = placement_scratch((unsigned long)n_objs*replication*
+            (sizeof(*closest) + sizeof(*dist)));
+        dist = (void*)&closest[n_objs*replication];
+    }
 
-    for(i=0; i<replication; i++)
-        closest[i].svr_idx = UINT64_MAX;
+    for(k=0; k<n_objs; k++)
+        for(j=0; j<replication; j++)
+            closest[k*replication+j].svr_idx = UINT64_MAX;
 
     for(i=0; i<(mod_state->n_svrs*mod_state->virt_factor); i++)
     {
-        svr = mod_state->virt_table[i];
-        for(j=0; j<replication; j++)
+        for(k=0; k<n_objs; k++)
         {
-            if(closest[j].svr_idx == UINT64_MAX || placement_distance_hash(obj, svr.svr_id) < placement_distance_hash(obj, closest[j].svr_id))
+            struct vnode *obj_closest = &closest[k*replication];
+            uint64_t *obj_dist = &dist[k*replication];
+
+            svr = mod_state->virt_table[i];
+            svr_dist = placement_distance_hash(objs[k], svr.svr_id);
+            for(j=0; j<replication; j++)
             {
-                tmp_svr = closest[j];
-                closest[j] = svr;
-                svr = tmp_svr;
+                if(obj_closest[j].svr_idx == UINT64_MAX || svr_dist < obj_dist[j])
+                {
+                    tmp_svr = obj_closest[j];
+                    tmp_dist = obj_dist[j];
+                    obj_closest[j] = svr;
+                    obj_dist[j] = svr_dist;
+                    svr = tmp_svr;
+                    svr_dist = tmp_dist;
+                }
             }
         }
     }
 
-    for(i=0; i<replication; i++)
+    for(k=0; k<n_objs; k++)
+    {
+        for(j=0; j<replication; j++)
+        {
+            server_idxs[k*replication+j] = closest[k*replication+j].svr_idx;
+        }
+    }
+
+    return;
+}
+
+static void placement_find_closest_hash_lookup3(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
+    unsigned long* server_idxs)
+{
+    struct hash_lookup3_state *mod_state = mod->data;
+
+    if(mod_state->kernel)
+        placement_hrw_find_closest(mod_state->kernel, mod_state->ids,
+            (unsigned long)mod_state->n_svrs*mod_state->virt_factor,
+            mod_state->n_svrs, obj, replication, server_idxs);
+    else
+        hash_lookup3_find_closest_tile(mod_state, &obj, 1, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_hash_lookup3(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct hash_lookup3_state *mod_state = mod->data;
+    unsigned long i;
+    unsigned int n_tile;
+
+    if(mod_state->kernel)
+    {
+        for(i=0; i<n_objs; i++)
+            placement_hrw_find_closest(mod_state->kernel, mod_state->ids,
+                (unsigned long)mod_state->n_svrs*mod_state->virt_factor,
+                mod_state->n_svrs, objs[i], replication,
+                &server_idxs[i*replication]);
+        return;
+    }
+
+    for(i=0; i<n_objs; i+=n_tile)
     {
-        server_idxs[i] = closest[i].svr_idx;
+        n_tile = HASH_LOOKUP3_TILE;
+        if(n_objs - i < n_tile)
+            n_tile = n_objs - i;
+        hash_lookup3_find_closest_tile(mod_state, &objs[i], n_tile, replication,
+            &server_idxs[i*replication]);
     }
 
     return;
@@ -161,6 +305,7 @@ static void placement_finalize_hash_lookup3(struct placement_mod *mod)
     struct hash_lookup3_state *mod_state = mod->data;
 
     free(mod_state->virt_table);
+    free(mod_state->ids);
     free(mod_state);
     free(mod);
 
@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ch-placement.h"
+#include "src/modules/placement-mod.h"
+#include "src/modules/placement-hrw.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PLACEMENT_HRW_X86 1
+#include <immintrin.h>
+#endif
+
+/* number of distances scored at a time before selecting from them */
+#define HRW_CHUNK 256
+
+/* the hashes below are lookup3's hashlittle2() and SpookyHash's Hash64()
+ * specialized for the 8 byte keys that the modules hash, with the
+ * constants folded in.  They must stay bit for bit identical to the
+ * library versions.
+ */
+#define HRW_ROT32(x,k) (((x)<<(k)) | ((x)>>(32-(k))))
+#define HRW_ROT64(x,k) (((x)<<(k)) | ((x)>>(64-(k))))
+
+#define HRW_LOOKUP3_FINAL(a,b,c) \
+{ \
+    c ^= b; c -= HRW_ROT32(b,14); \
+    a ^= c; a -= HRW_ROT32(c,11); \
+    b ^= a; b -= HRW_ROT32(a,25); \
+    c ^= b; c -= HRW_ROT32(b,16); \
+    a ^= c; a -= HRW_ROT32(c,4);  \
+    b ^= a; b -= HRW_ROT32(a,14); \
+    c ^= b; c -= HRW_ROT32(b,24); \
+}
+
+#define HRW_SPOOKY_CONST 0xdeadbeefdeadbeefULL
+
+#define HRW_SPOOKY_END(h0,h1,h2,h3) \
+{ \
+    h3 ^= h2;  h2 = HRW_ROT64(h2,15);  h3 += h2; \
+    h0 ^= h3;  h3 = HRW_ROT64(h3,52);  h0 += h3; \
+    h1 ^= h0;  h0 = HRW_ROT64(h0,26);  h1 += h0; \
+    h2 ^= h1;  h1 = HRW_ROT64(h1,51);  h2 += h1; \
+    h3 ^= h2;  h2 = HRW_ROT64(h2,28);  h3 += h2; \
+    h0 ^= h3;  h3 = HRW_ROT64(h3,9);   h0 += h3; \
+    h1 ^= h0;  h0 = HRW_ROT64(h0,47);  h1 += h0; \
+    h2 ^= h1;  h1 = HRW_ROT64(h1,54);  h2 += h1; \
+    h3 ^= h2;  h2 = HRW_ROT64(h2,32);  h3 += h2; \
+    h0 ^= h3;  h3 = HRW_ROT64(h3,25);  h0 += h3; \
+    h1 ^= h0;  h0 = HRW_ROT64(h0,63);  h1 += h0; \
+}
+
+static inline uint64_t hrw_lookup3(uint64_t obj, uint64_t id)
+{
+    uint64_t higher = obj > id ? obj : id;
+    uint64_t lower = obj > id ? id : obj;
+    uint32_t a, b, c;
+
+    a = b = c = 0xdeadbeef + 8 + (uint32_t)higher;
+    c += (uint32_t)(higher >> 32);
+    b += (uint32_t)(lower >> 32);
+    a += (uint32_t)lower;
+    HRW_LOOKUP3_FINAL(a, b, c);
+
+    return(c + (((uint64_t)b)<<32));
+}
+
+static inline uint64_t hrw_spooky(uint64_t obj, uint64_t id)
+{
+    uint64_t higher = obj > id ? obj : id;
+    uint64_t lower = obj > id ? id : obj;
+    uint64_t a, b, c, d;
+
+    a = b = higher;
+    c = HRW_SPOOKY_CONST + lower;
+    d = HRW_SPOOKY_CONST + (((uint64_t)8) << 56);
+    HRW_SPOOKY_END(a, b, c, d);
+
+    return(a);
+}
+
+static void hrw_lookup3_scalar(const uint64_t *ids, unsigned long n,
+    uint64_t obj, uint64_t *dists)
+{
+    unsigned long i;
+
+    for(i=0; i<n; i++)
+        dists[i] = hrw_lookup3(obj, ids[i]);
+
+    return;
+}
+
+static void hrw_spooky_scalar(const uint64_t *ids, unsigned long n,
+    uint64_t obj, uint64_t *dists)
+{
+    unsigned long i;
+
+    for(i=0; i<n; i++)
+        dists[i] = hrw_spooky(obj, ids[i]);
+
+    return;
+}
+
+#ifdef PLACEMENT_HRW_X86
+#define HRW_VROT32(x,k) \
+    _mm256_or_si256(_mm256_slli_epi32(x, k), _mm256_srli_epi32(x, 32-(k)))
+#define HRW_VROT64(x,k) \
+    _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64-(k)))
+
+/* splits four ids into the larger and smaller of each and obj, comparing
+ * as unsigned (avx2 only has a signed 64 bit compare)
+ */
+__attribute__((target("avx2")))
+static inline void hrw_order_avx2(__m256i v, __m256i o, __m256i sign,
+    __m256i *higher, __m256i *lower)
+{
+    __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(o, sign),
+        _mm256_xor_si256(v, sign));
+
+    *higher = _mm256_blendv_epi8(v, o, gt);
+    *lower = _mm256_blendv_epi8(o, v, gt);
+    return;
+}
+
+/* eight vnodes at a time, one per 32 bit lane */
+__attribute__((target("avx2")))
+static void hrw_lookup3_avx2(const uint64_t *ids, unsigned long n,
+    uint64_t obj, uint64_t *dists)
+{
+    __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    __m256i o = _mm256_set1_epi64x((long long)obj);
+    __m256i init = _mm256_set1_epi32(0xdeadbeef + 8);
+    __m256i hi0, lo0, hi1, lo1;
+    __m256i higher_lo, higher_hi, lower_lo, lower_hi;
+    __m256i a, b, c, t0, t1;
+    unsigned long i;
+
+    for(i=0; i+8<=n; i+=8)
+    {
+        hrw_order_avx2(_mm256_loadu_si256((const __m256i*)&ids[i]), o, sign,
+            &hi0, &lo0);
+        hrw_order_avx2(_mm256_loadu_si256((const __m256i*)&ids[i+4]), o,
+            sign, &hi1, &lo1);
+
+        /* gather the low and high 32 bits of the eight values into
+         * separate vectors, in id order
+         */
+#define HRW_SPLIT(v) _mm256_permute4x64_epi64( \
+    _mm256_shuffle_epi32(v, _MM_SHUFFLE(3,1,2,0)), _MM_SHUFFLE(3,1,2,0))
+        t0 = HRW_SPLIT(hi0);
+        t1 = HRW_SPLIT(hi1);
+        higher_lo = _mm256_permute2x128_si256(t0, t1, 0x20);
+        higher_hi = _mm256_permute2x128_si256(t0, t1, 0x31);
+        t0 = HRW_SPLIT(lo0);
+        t1 = HRW_SPLIT(lo1);
+        lower_lo = _mm256_permute2x128_si256(t0, t1, 0x20);
+        lower_hi = _mm256_permute2x128_si256(t0, t1, 0x31);
+#undef HRW_SPLIT
+
+        a = _mm256_add_epi32(init, higher_lo);
+        b = a;
+        c = _mm256_add_epi32(a, higher_hi);
+        b = _mm256_add_epi32(b, lower_hi);
+        a = _mm256_add_epi32(a, lower_lo);
+
+        c = _mm256_xor_si256(c, b); c = _mm256_sub_epi32(c, HRW_VROT32(b,14));
+        a = _mm256_xor_si256(a, c); a = _mm256_sub_epi32(a, HRW_VROT32(c,11));
+        b = _mm256_xor_si256(b, a); b = _mm256_sub_epi32(b, HRW_VROT32(a,25));
+        c = _mm256_xor_si256(c, b); c = _mm256_sub_epi32(c, HRW_VROT32(b,16));
+        a = _mm256_xor_si256(a, c); a = _mm256_sub_epi32(a, HRW_VROT32(c,4));
+        b = _mm256_xor_si256(b, a); b = _mm256_sub_epi32(b, HRW_VROT32(a,14));
+        c = _mm256_xor_si256(c, b); c = _mm256_sub_epi32(c, HRW_VROT32(b,24));
+
+        /* dist = c + (b << 32), back in id order */
+        t0 = _mm256_unpacklo_epi32(c, b);
+        t1 = _mm256_unpackhi_epi32(c, b);
+        _mm256_storeu_si256((__m256i*)&dists[i],
+            _mm256_permute2x128_si256(t0, t1, 0x20));
+        _mm256_storeu_si256((__m256i*)&dists[i+4],
+            _mm256_permute2x128_si256(t0, t1, 0x31));
+    }
+    hrw_lookup3_scalar(&ids[i], n-i, obj, &dists[i]);
+
+    return;
+}
+
+/* four vnodes per vector, two vectors at a time to hide latency */
+__attribute__((target("avx2")))
+static void hrw_spooky_avx2(const uint64_t *ids, unsigned long n,
+    uint64_t obj, uint64_t *dists)
+{
+    __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    __m256i o = _mm256_set1_epi64x((long long)obj);
+    __m256i k = _mm256_set1_epi64x((long long)HRW_SPOOKY_CONST);
+    __m256i d0 = _mm256_set1_epi64x(
+        (long long)(HRW_SPOOKY_CONST + (((uint64_t)8) << 56)));
+    __m256i h0, h1, h2, h3, g0, g1, g2, g3, lower;
+    unsigned long i;
+
+    for(i=0; i+8<=n; i+=8)
+    {
+        hrw_order_avx2(_mm256_loadu_si256((const __m256i*)&ids[i]), o, sign,
+            &h0, &lower);
+        h1 = h0;
+        h2 = _mm256_add_epi64(k, lower);
+        h3 = d0;
+        hrw_order_avx2(_mm256_loadu_si256((const __m256i*)&ids[i+4]), o,
+            sign, &g0, &lower);
+        g1 = g0;
+        g2 = _mm256_add_epi64(k, lower);
+        g3 = d0;
+
+#define HRW_VSTEP(x0,x1,x2,x3,r) \
+    x3 = _mm256_xor_si256(x3, x2); x2 = HRW_VROT64(x2, r); \
+    x3 = _mm256_add_epi64(x3, x2);
+#define HRW_VSTEP2(p0,p1,p2,p3,r) \
+    HRW_VSTEP(h##p0,h##p1,h##p2,h##p3,r) HRW_VSTEP(g##p0,g##p1,g##p2,g##p3,r)
+        /* same rounds as HRW_SPOOKY_END(h0,h1,h2,h3) */
+        HRW_VSTEP2(0,1,2,3,15)
+        HRW_VSTEP2(1,2,3,0,52)
+        HRW_VSTEP2(2,3,0,1,26)
+        HRW_VSTEP2(3,0,1,2,51)
+        HRW_VSTEP2(0,1,2,3,28)
+        HRW_VSTEP2(1,2,3,0,9)
+        HRW_VSTEP2(2,3,0,1,47)
+        HRW_VSTEP2(3,0,1,2,54)
+        HRW_VSTEP2(0,1,2,3,32)
+        HRW_VSTEP2(1,2,3,0,25)
+        HRW_VSTEP2(2,3,0,1,63)
+#undef HRW_VSTEP2
+#undef HRW_VSTEP
+
+        _mm256_storeu_si256((__m256i*)&dists[i], h0);
+        _mm256_storeu_si256((__m256i*)&dists[i+4], g0);
+    }
+    hrw_spooky_scalar(&ids[i], n-i, obj, &dists[i]);
+
+    return;
+}
+#endif
+
+placement_hrw_fn placement_hrw_select(enum placement_hrw_hash hash,
+    const char *name)
+{
+    placement_hrw_fn scalar = hash == PLACEMENT_HRW_LOOKUP3 ?
+        hrw_lookup3_scalar : hrw_spooky_scalar;
+
+    if(strcmp(name, "scalar") == 0)
+        return(scalar);
+
+#ifdef PLACEMENT_HRW_X86
+    __builtin_cpu_init();
+    if(strcmp(name, "avx2") == 0 || strcmp(name, "auto") == 0)
+    {
+        if(__builtin_cpu_supports("avx2"))
+            return(hash == PLACEMENT_HRW_LOOKUP3 ?
+                hrw_lookup3_avx2 : hrw_spooky_avx2);
+        return(strcmp(name, "auto") == 0 ? scalar : NULL);
+    }
+#else
+    if(strcmp(name, "auto") == 0)
+        return(scalar);
+#endif
+
+    return(NULL);
+}
+
+int placement_hrw_parse(enum placement_hrw_hash hash, const char *name,
+    placement_hrw_fn *fn)
+{
+    if(strcmp(name, "reference") == 0)
+    {
+        *fn = NULL;
+        return(0);
+    }
+
+    *fn = placement_hrw_select(hash, name);
+    if(!*fn)
+    {
+        fprintf(stderr, "Error: hrw kernel \"%s\" is unknown or not supported by this cpu\n",
+            name);
+        return(-1);
+    }
+
+    return(0);
+}
+
+void placement_hrw_find_closest(placement_hrw_fn fn, const uint64_t *ids,
+    unsigned long n, unsigned int n_svrs, uint64_t obj,
+    unsigned int replication, unsigned long *server_idxs)
+{
+    uint64_t chunk[HRW_CHUNK];
+    uint64_t dist_stack[CH_STACK_REPLICATION];
+    unsigned long pos_stack[CH_STACK_REPLICATION];
+    uint64_t *dist = dist_stack;
+    unsigned long *pos = pos_stack;
+    uint64_t worst = UINT64_MAX;
+    unsigned int found = 0;
+    unsigned long base, i, m;
+    unsigned int j;
+
+    if(replication == 0)
+        return;
+
+    /* wide layouts don't fit in the stack arrays */
+    if(replication > CH_STACK_REPLICATION)
+    {
+        dist = placement_scratch(replication*(sizeof(*dist) + sizeof(*pos)));
+        pos = (void*)&dist[replication];
+    }
+
+    for(base=0; base<n; base+=m)
+    {
+        m = n - base < HRW_CHUNK ? n - base : HRW_CHUNK;
+        fn(&ids[base], m, obj, chunk);
+
+        for(i=0; i<m; i++)
+        {
+            /* once the list is full, nearly every vnode fails this one
+             * well predicted comparison.  Equal distances keep the earlier
+             * vnode.
+             */
+            if(found == replication && chunk[i] >= worst)
+                continue;
+
+            j = found < replication ? found++ : replication - 1;
+            for(; j>0 && dist[j-1] > chunk[i]; j--)
+            {
+                dist[j] = dist[j-1];
+                pos[j] = pos[j-1];
+            }
+            dist[j] = chunk[i];
+            pos[j] = base + i;
+            if(found == replication)
+                worst = dist[replication-1];
+        }
+    }
+
+    for(j=0; j<found; j++)
+        server_idxs[j] = pos[j] % n_svrs;
+    for(; j<replication; j++)
+        server_idxs[j] = UINT64_MAX;
+
+    return;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef PLACEMENT_HRW_H
+#define PLACEMENT_HRW_H
+
+#include <stdint.h>
+
+/* scoring kernels for rendezvous (highest random weight) placement.  Each
+ * fills dists[i] with the distance between obj and ids[i] for i in [0, n),
+ * exactly as the hash_lookup3 or hash_spooky module defines it: the smaller
+ * of the two ids is hashed with the larger one as the seed.
+ */
+typedef void (*placement_hrw_fn)(const uint64_t *ids, unsigned long n,
+    uint64_t obj, uint64_t *dists);
+
+enum placement_hrw_hash
+{
+    PLACEMENT_HRW_LOOKUP3,
+    PLACEMENT_HRW_SPOOKY
+};
+
+/* returns the kernel for hash with the given name ("auto", "scalar" or
+ * "avx2"), or NULL if the name is unknown or the kernel is not supported
+ * by this cpu.  "auto" picks the widest kernel the cpu supports.
+ */
+placement_hrw_fn placement_hrw_select(enum placement_hrw_hash hash,
+    const char *name);
+
+/* handles a module's "kernel:<name>" parameter.  The name may also be
+ * "reference", in which case *fn is set to NULL and the module should use
+ * its original scan.  Returns -1 if the kernel is unknown or unsupported.
+ */
+int placement_hrw_parse(enum placement_hrw_hash hash, const char *name,
+    placement_hrw_fn *fn);
+
+/* reports the replication vnodes closest to obj, nearest first, breaking
+ * ties in favor of the earlier vnode.  ids is the vnode table in the usual
+ * virt_factor-major order, so vnode i belongs to server i % n_svrs.  Slots
+ * past the number of vnodes are set to UINT64_MAX.
+ */
+void placement_hrw_find_closest(placement_hrw_fn fn, const uint64_t *ids,
+    unsigned long n, unsigned int n_svrs, uint64_t obj,
+    unsigned int replication, unsigned long *server_idxs);
+
+#endif /* PLACEMENT_HRW_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Jump consistent hashing (Lamping and Veach).  The object id drives a
+ * pseudo random sequence of jumps through the server indices, and the
+ * last jump that lands below n_svrs picks the server.  It takes O(ln n)
+ * arithmetic per lookup and keeps no table at all, so building an
+ * instance is free.
+ *
+ * Servers can only be added or removed at the end of the index range:
+ * going from n to n+1 servers moves 1/(n+1) of the objects, all of them
+ * onto the new server.  Building a new instance is the way to change the
+ * number of servers.
+ *
+ * Further replicas repeat the jump with the object id hashed under a new
+ * salt, skipping servers already chosen, so each replica is itself placed
+ * by jump hashing.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "src/modules/placement-mod.h"
+#include "src/lookup3.h"
+
+static struct placement_mod* placement_mod_jump(int n_svrs, int virt_factor, int seed);
+static void placement_find_closest_jump(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_find_closest_batch_jump(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_finalize_jump(struct placement_mod *mod);
+static int placement_get_stats_jump(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+
+struct placement_mod_map jump_mod_map =
+{
+    .type = "jump",
+    .initiate = placement_mod_jump,
+};
+
+/* salts tried for one replica before falling back to the next free server */
+#define JUMP_SALTS_MAX 32
+
+struct jump_state
+{
+    unsigned int n_svrs;
+    uint32_t seed;
+};
+
+struct placement_mod* placement_mod_jump(int n_svrs, int virt_factor, int seed)
+{
+    struct placement_mod *mod_jump;
+    struct jump_state *mod_state;
+
+    (void)virt_factor;
+
+    if(n_svrs < 1)
+        return(NULL);
+
+    mod_jump = calloc(1, sizeof(*mod_jump));
+    if(!mod_jump)
+        return(NULL);
+
+    mod_state = malloc(sizeof(*mod_state));
+    if(!mod_state)
+    {
+        free(mod_jump);
+        return(NULL);
+    }
+
+    mod_jump->data = mod_state;
+    mod_state->n_svrs = n_svrs;
+    mod_state->seed = seed;
+
+    mod_jump->find_closest = placement_find_closest_jump;
+    mod_jump->find_closest_batch = placement_find_closest_batch_jump;
+    mod_jump->create_striped = placement_create_striped_random;
+    mod_jump->finalize = placement_finalize_jump;
+    mod_jump->get_stats = placement_get_stats_jump;
+
+    return(mod_jump);
+}
+
+/* the jump consistent hash function from the paper */
+static inline unsigned long jump_hash(uint64_t key, unsigned int n_svrs)
+{
+    int64_t b = -1;
+    int64_t j = 0;
+
+    while(j < n_svrs)
+    {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1));
+    }
+
+    return(b);
+}
+
+static inline void jump_find_closest(struct jump_state *mod_state,
+    uint64_t obj, unsigned int replication, unsigned long *server_idxs)
+{
+    uint32_t h1, h2;
+    uint32_t salt = 0;
+    unsigned long svr;
+    unsigned int found, i, tries;
+
+    for(found=0; found<replication && found<mod_state->n_svrs; found++)
+    {
+        for(tries=0; ; tries++)
+        {
+            /* hash incoming object id (this is like a pre conditioner so
+             * that we balance load even if id space is not well
+             * distributed); each attempt uses the next salt
+             */
+            h1 = salt++;
+            h2 = mod_state->seed;
+            ch_bj_hashlittle2(&obj, sizeof(obj), &h1, &h2);
+            svr = jump_hash(h1 + (((uint64_t)h2)<<32), mod_state->n_svrs);
+            for(i=0; i<found && server_idxs[i] != svr; i++);
+            if(i == found)
+                break;
+
+            /* only likely when replication is close to n_svrs */
+            if(tries == JUMP_SALTS_MAX)
+            {
+                do
+                {
+                    svr = (svr + 1) % mod_state->n_svrs;
+                    for(i=0; i<found && server_idxs[i] != svr; i++);
+                } while(i < found);
+                break;
+            }
+        }
+        server_idxs[found] = svr;
+    }
+
+    /* fewer servers than replicas */
+    for(; found<replication; found++)
+        server_idxs[found] = UINT64_MAX;
+
+    return;
+}
+
+static void placement_find_closest_jump(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    jump_find_closest(mod->data, obj, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_jump(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct jump_state *mod_state = mod->data;
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        jump_find_closest(mod_state, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
+static void placement_finalize_jump(struct placement_mod *mod)
+{
+    struct jump_state *mod_state = mod->data;
+
+    free(mod_state);
+    free(mod);
+
+    return;
+}
+
+static int placement_get_stats_jump(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    (void)mod;
+
+    /* there is no table */
+    memset(stats, 0, sizeof(*stats));
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
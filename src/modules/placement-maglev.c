@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Maglev hashing.  Each server has a permutation of the slots of a
+ * prime-sized lookup table, given by an offset and a skip derived from its
+ * id.  The table is filled by letting the servers take turns claiming the
+ * next free slot in their permutation, so every server ends up with
+ * nearly the same number of slots.  Placing an object is then a hash, a
+ * modulo and a table read; further replicas are the next distinct servers
+ * found by walking forward through the table.
+ *
+ * Membership changes refill the table from the same permutations, so most
+ * slots keep their server.  Unlike the ring, a few slots that belonged to
+ * other servers also change hands, but the number is small when the table
+ * is much larger than the number of servers.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "src/modules/placement-mod.h"
+#include "src/lookup3.h"
+
+static struct placement_mod* placement_mod_maglev(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_maglev_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
+static void placement_find_closest_maglev(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_find_closest_batch_maglev(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_finalize_maglev(struct placement_mod *mod);
+static int placement_get_stats_maglev(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+static int placement_add_server_maglev(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static int placement_remove_server_maglev(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+
+struct placement_mod_map maglev_mod_map =
+{
+    .type = "maglev",
+    .initiate = placement_mod_maglev,
+    .initiate_params = placement_mod_maglev_params,
+};
+
+/* default number of table slots per server, before rounding up to a prime */
+#define MAGLEV_SLOTS_PER_SERVER 100
+/* keeps the slots and the per server permutations within 32 bits */
+#define MAGLEV_TABLE_MAX 2147483647UL
+
+struct maglev_state
+{
+    unsigned int n_svrs;
+    unsigned int n_alive;
+    unsigned long table_size;   /* always prime */
+    uint32_t *table;            /* server owning each slot */
+    uint32_t *offsets;          /* first slot in each server's permutation */
+    uint32_t *skips;            /* step through each server's permutation */
+    uint32_t *next;             /* scratch for maglev_populate() */
+    char *alive;
+    double build_seconds;
+};
+
+static int maglev_parse_param(void *state, const char *param);
+static void maglev_populate(struct maglev_state *mod_state);
+
+struct placement_mod* placement_mod_maglev(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_maglev_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static int maglev_is_prime(unsigned long n)
+{
+    unsigned long d;
+
+    if(n < 2)
+        return(0);
+    for(d=2; d*d<=n; d++)
+        if(n % d == 0)
+            return(0);
+
+    return(1);
+}
+
+static struct placement_mod* placement_mod_maglev_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
+{
+    struct placement_mod *mod_maglev;
+    struct maglev_state *mod_state;
+    unsigned long table_size;
+    uint64_t k;
+    uint32_t h1, h2;
+    double start;
+
+    (void)virt_factor;
+
+    if(n_svrs < 1)
+        return(NULL);
+
+    mod_maglev = calloc(1, sizeof(*mod_maglev));
+    if(!mod_maglev)
+        return(NULL);
+
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_state)
+    {
+        free(mod_maglev);
+        return(NULL);
+    }
+
+    mod_maglev->data = mod_state;
+    mod_state->n_svrs = n_svrs;
+    mod_state->n_alive = n_svrs;
+    mod_state->table_size = (unsigned long)MAGLEV_SLOTS_PER_SERVER * n_svrs;
+
+    if(placement_parse_params("maglev", params, maglev_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_maglev);
+        return(NULL);
+    }
+
+    /* every server needs at least one slot, and the skips only visit every
+     * slot if the table size is prime
+     */
+    table_size = mod_state->table_size;
+    if(table_size < (unsigned long)n_svrs)
+        table_size = n_svrs;
+    while(!maglev_is_prime(table_size))
+        table_size++;
+    if(table_size > MAGLEV_TABLE_MAX)
+    {
+        fprintf(stderr, "Error: maglev table size must be at most %lu\n",
+            MAGLEV_TABLE_MAX);
+        free(mod_state);
+        free(mod_maglev);
+        return(NULL);
+    }
+    mod_state->table_size = table_size;
+
+    mod_state->table = malloc(sizeof(*mod_state->table)*table_size);
+    mod_state->offsets = malloc(sizeof(*mod_state->offsets)*n_svrs);
+    mod_state->skips = malloc(sizeof(*mod_state->skips)*n_svrs);
+    mod_state->next = malloc(sizeof(*mod_state->next)*n_svrs);
+    mod_state->alive = malloc(n_svrs);
+    if(!mod_state->table || !mod_state->offsets || !mod_state->skips ||
+        !mod_state->next || !mod_state->alive)
+    {
+        placement_finalize_maglev(mod_maglev);
+        return(NULL);
+    }
+    memset(mod_state->alive, 1, n_svrs);
+
+    start = placement_wtime();
+    /* the permutation only depends on the server's own index, so it stays
+     * put when other servers come and go
+     */
+    for(k=0; k<(uint64_t)n_svrs; k++)
+    {
+        h1 = 0;
+        h2 = seed;
+        ch_bj_hashlittle2(&k, sizeof(k), &h1, &h2);
+        mod_state->offsets[k] = h1 % table_size;
+        mod_state->skips[k] = h2 % (table_size - 1) + 1;
+    }
+    maglev_populate(mod_state);
+    mod_state->build_seconds = placement_wtime() - start;
+
+    mod_maglev->find_closest = placement_find_closest_maglev;
+    mod_maglev->find_closest_batch = placement_find_closest_batch_maglev;
+    mod_maglev->create_striped = placement_create_striped_random;
+    mod_maglev->finalize = placement_finalize_maglev;
+    mod_maglev->get_stats = placement_get_stats_maglev;
+    mod_maglev->add_server = placement_add_server_maglev;
+    mod_maglev->remove_server = placement_remove_server_maglev;
+
+    return(mod_maglev);
+}
+
+/* parses one module parameter; see the ring module for the format.
+ * table_size is the minimum number of slots in the lookup table; it is
+ * rounded up to the next prime.
+ */
+static int maglev_parse_param(void *state, const char *param)
+{
+    struct maglev_state *mod_state = state;
+
+    if(sscanf(param, "table_size:%lu", &mod_state->table_size) == 1)
+    {
+        if(mod_state->table_size > MAGLEV_TABLE_MAX)
+        {
+            fprintf(stderr, "Error: maglev table size must be at most %lu\n",
+                MAGLEV_TABLE_MAX);
+            return(-1);
+        }
+    }
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* fills the table from the permutations of the member servers.  They take
+ * turns in index order, each claiming the next slot in its permutation
+ * that is still free, until every slot is taken.
+ */
+static void maglev_populate(struct maglev_state *mod_state)
+{
+    unsigned long filled = 0;
+    unsigned long slot;
+    unsigned int i;
+
+    for(slot=0; slot<mod_state->table_size; slot++)
+        mod_state->table[slot] = UINT32_MAX;
+    for(i=0; i<mod_state->n_svrs; i++)
+        mod_state->next[i] = mod_state->offsets[i];
+
+    while(1)
+    {
+        for(i=0; i<mod_state->n_svrs; i++)
+        {
+            if(!mod_state->alive[i])
+                continue;
+            slot = mod_state->next[i];
+            while(mod_state->table[slot] != UINT32_MAX)
+            {
+                slot += mod_state->skips[i];
+                if(slot >= mod_state->table_size)
+                    slot -= mod_state->table_size;
+            }
+            mod_state->table[slot] = i;
+            slot += mod_state->skips[i];
+            if(slot >= mod_state->table_size)
+                slot -= mod_state->table_size;
+            mod_state->next[i] = slot;
+            if(++filled == mod_state->table_size)
+                return;
+        }
+    }
+}
+
+static inline void maglev_find_closest(struct maglev_state *mod_state,
+    uint64_t obj, unsigned int replication, unsigned long *server_idxs)
+{
+    uint32_t h1 = 0;
+    uint32_t h2 = 0;
+    uint64_t hashed_obj;
+    unsigned long slot;
+    unsigned long steps;
+    unsigned int found, i;
+    uint32_t svr;
+
+    /* hash incoming object id (this is like a pre conditioner so that we
+     * balance load even if id space is not well distributed)
+     */
+    ch_bj_hashlittle2(&obj, sizeof(obj), &h1, &h2);
+    hashed_obj = h1 + (((uint64_t)h2)<<32);
+    slot = hashed_obj % mod_state->table_size;
+
+    if(replication == 0)
+        return;
+    server_idxs[0] = mod_state->table[slot];
+
+    /* the rest are the next distinct servers in the table.  Every member
+     * owns at least one slot, so one pass over the table finds them all.
+     */
+    found = 1;
+    for(steps=1; found<replication && found<mod_state->n_alive &&
+        steps<mod_state->table_size; steps++)
+    {
+        if(++slot == mod_state->table_size)
+            slot = 0;
+        svr = mod_state->table[slot];
+        for(i=0; i<found && server_idxs[i] != svr; i++);
+        if(i == found)
+            server_idxs[found++] = svr;
+    }
+
+    /* fewer members than replicas */
+    for(; found<replication; found++)
+        server_idxs[found] = UINT64_MAX;
+
+    return;
+}
+
+static void placement_find_closest_maglev(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    maglev_find_closest(mod->data, obj, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_maglev(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct maglev_state *mod_state = mod->data;
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        maglev_find_closest(mod_state, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
+/* the permutations are fixed when the instance is built, so only servers
+ * it was built with can come back
+ */
+static int placement_add_server_maglev(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct maglev_state *mod_state = mod->data;
+
+    if(svr_idx >= mod_state->n_svrs || mod_state->alive[svr_idx])
+        return(-1);
+
+    mod_state->alive[svr_idx] = 1;
+    mod_state->n_alive++;
+    maglev_populate(mod_state);
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static int placement_remove_server_maglev(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct maglev_state *mod_state = mod->data;
+
+    if(svr_idx >= mod_state->n_svrs || !mod_state->alive[svr_idx] ||
+        mod_state->n_alive == 1)
+        return(-1);
+
+    mod_state->alive[svr_idx] = 0;
+    mod_state->n_alive--;
+    maglev_populate(mod_state);
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static void placement_finalize_maglev(struct placement_mod *mod)
+{
+    struct maglev_state *mod_state = mod->data;
+
+    free(mod_state->table);
+    free(mod_state->offsets);
+    free(mod_state->skips);
+    free(mod_state->next);
+    free(mod_state->alive);
+    free(mod_state);
+    free(mod);
+
+    return;
+}
+
+static int placement_get_stats_maglev(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct maglev_state *mod_state = mod->data;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->table_bytes = mod_state->table_size * sizeof(*mod_state->table) +
+        mod_state->n_svrs * (sizeof(*mod_state->offsets) +
+        sizeof(*mod_state->skips) + sizeof(*mod_state->next) +
+        sizeof(*mod_state->alive));
+    stats->build_seconds = mod_state->build_seconds;
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -8,17 +8,41 @@
 #define PLACEMENT_MOD_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+struct ch_placement_stats;
+struct ch_placement_arc;
+struct placement_snapshot;
 
 struct placement_mod
 {
     void (*find_closest)(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
         unsigned long* server_idxs);
-    void (*create_striped)(struct placement_mod *mod, unsigned long file_size, 
+    void (*find_closest_batch)(struct placement_mod *mod, const uint64_t *objs,
+        unsigned long n_objs, unsigned int replication, 
+        unsigned long* server_idxs);
+    /* rng is a caller's random state, or NULL to use random() */
+    void (*create_striped)(struct placement_mod *mod, uint64_t *rng,
+      unsigned long file_size, 
       unsigned int replication, unsigned int max_stripe_width, 
       unsigned int strip_size,
       unsigned int* num_objects,
       uint64_t *oids, unsigned long *sizes);
     void (*finalize)(struct placement_mod *mod);
+    /* optional; NULL if the module does not track stats */
+    int (*get_stats)(struct placement_mod *mod, struct ch_placement_stats *stats);
+    /* optional; NULL if the module does not support membership changes */
+    int (*add_server)(struct placement_mod *mod, unsigned long svr_idx,
+        struct ch_placement_arc **arcs, unsigned long *n_arcs);
+    int (*remove_server)(struct placement_mod *mod, unsigned long svr_idx,
+        struct ch_placement_arc **arcs, unsigned long *n_arcs);
+    /* optional; NULL if the module cannot be saved to a snapshot */
+    void (*save)(struct placement_mod *mod, struct placement_snapshot *snap);
+    /* optional; NULL if the module does not place with bounded loads */
+    int (*set_load)(struct placement_mod *mod, unsigned long svr_idx,
+        unsigned long load);
+    int (*get_load)(struct placement_mod *mod, unsigned long svr_idx,
+        unsigned long *load);
     void *data;
 };
 
@@ -26,16 +50,88 @@ struct placement_mod_map
 {
     char* type;
     struct placement_mod* (*initiate)(int n_svrs, int virt_factor, int seed);
+    /* optional; initialization with a comma delimited parameter list */
+    struct placement_mod* (*initiate_params)(int n_svrs, int virt_factor,
+        int seed, const char* params);
+    /* optional; initialization with per-server weights (params may be
+     * NULL)
+     */
+    struct placement_mod* (*initiate_weighted)(int n_svrs, int virt_factor,
+        int seed, const double *weights, const char* params);
+    /* optional; creates an instance from a snapshot written by the
+     * module's save function.  The snapshot stays mapped until the
+     * instance is finalized, so the module may point into it.
+     */
+    struct placement_mod* (*load)(struct placement_snapshot *snap);
 };
 
 /* generic striping function; just allocates random oids */
-void placement_create_striped_random(struct placement_mod *mod,
+void placement_create_striped_random(struct placement_mod *mod, uint64_t *rng,
   unsigned long file_size, 
   unsigned int replication, unsigned int max_stripe_width, 
   unsigned int strip_size,
   unsigned int* num_objects,
   uint64_t *oids, unsigned long *sizes);
 
+/* next value from rng with ch_placement_random_u64_r(), or from
+ * ch_placement_random_u64() if rng is NULL
+ */
+uint64_t placement_random_u64(uint64_t *rng);
+
+/* returned by a parameter handler for a key it does not know */
+#define PLACEMENT_PARAM_UNKNOWN 1
+
+/* handles one "key:value" module parameter for placement_parse_params();
+ * returns 0 if it was applied, -1 if the value is invalid (after printing
+ * why), or PLACEMENT_PARAM_UNKNOWN
+ */
+typedef int (*placement_param_fn)(void *state, const char *param);
+
+/* splits a comma delimited list of module parameters and passes each one
+ * to handler along with state.  name is the module name, used to report
+ * unknown parameters.  A NULL params is an empty list.  Returns -1 on the
+ * first parameter that is unknown or invalid.
+ */
+int placement_parse_params(const char *name, const char *params,
+    placement_param_fn handler, void *state);
+
+/* scratch space of at least size bytes for a lookup that doesn't fit in
+ * its stack arrays.  Each thread keeps one buffer that only grows, so
+ * this allocates only when a thread sees a wider layout than before; it
+ * aborts if the memory is not available, since lookups cannot fail.  The
+ * buffer is reused by the thread's next call.
+ */
+void* placement_scratch(size_t size);
+
+/* wall clock time in seconds, for timing table construction */
+double placement_wtime(void);
+
+/* list of arcs built up during a membership change */
+struct placement_arc_list
+{
+    struct ch_placement_arc *arcs;
+    unsigned long n_arcs;
+    unsigned long size;
+};
+
+/* ends a membership change in a module whose objects do not move in
+ * ranges of the oid space: clears the caller's arcs, if it asked for
+ * them, and returns the matching code for ch_placement_add_server()
+ */
+int placement_no_arcs(struct ch_placement_arc **arcs, unsigned long *n_arcs);
+
+/* appends an arc to the list, growing it as needed; returns -1 on
+ * allocation failure
+ */
+int placement_arc_append(struct placement_arc_list *list, uint64_t start,
+    uint64_t end, unsigned int n_rings, unsigned int ring,
+    unsigned long old_svr, unsigned long new_svr);
+
+/* generic batch lookup; just calls find_closest once per object */
+void placement_find_closest_batch_generic(struct placement_mod *mod,
+  const uint64_t *objs, unsigned long n_objs,
+  unsigned int replication, unsigned long *server_idxs);
+
 
 #endif /* PLACEMENT_MOD_H */
 
@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Multi-probe consistent hashing (Appleton and O'Reilly).  Each server has
+ * a single point on the ring, and each object is hashed to several probe
+ * points instead.  The object goes to the server owning the probe that is
+ * closest to its owning point, which evens out the load about as well as
+ * virtual nodes do with a table that has one entry per server.
+ *
+ * Points own the ring from their id up to the next id, as in the ring
+ * module.  Each probe's owner is found through a small prefix index with
+ * about one point per bucket.  Further replicas are the next distinct
+ * servers clockwise from the winning point.  Removing a server only moves
+ * the objects whose winning probe it owned: every other probe can only
+ * get farther away.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "src/modules/placement-mod.h"
+#include "src/modules/placement-search.h"
+#include "src/modules/placement-build.h"
+#include "src/lookup3.h"
+
+static struct placement_mod* placement_mod_multiprobe(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_multiprobe_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
+static void placement_find_closest_multiprobe(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_find_closest_batch_multiprobe(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_finalize_multiprobe(struct placement_mod *mod);
+static int placement_get_stats_multiprobe(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+static int placement_add_server_multiprobe(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static int placement_remove_server_multiprobe(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+
+struct placement_mod_map multiprobe_mod_map =
+{
+    .type = "multiprobe",
+    .initiate = placement_mod_multiprobe,
+    .initiate_params = placement_mod_multiprobe_params,
+};
+
+/* 21 probes give a peak to mean load ratio of about 1.05 */
+#define MULTIPROBE_PROBES_DEFAULT 21
+#define MULTIPROBE_PROBES_MAX 256
+/* upper limit on the size of the prefix index (4 bytes per bucket) */
+#define MULTIPROBE_PREFIX_BITS_MAX 24
+
+struct multiprobe_state
+{
+    unsigned int n_svrs;
+    int seed;
+    unsigned int n_probes;
+    placement_search_fn search;
+    int prefix_request;     /* -1 to size automatically, 0 if disabled */
+    int prefix_bits;
+    uint64_t *ids;          /* one point per server, in ascending order */
+    uint32_t *svrs;         /* server index of each entry in ids */
+    uint32_t *prefix_index; /* first point at or after each bucket start */
+    double build_seconds;
+    double index_build_seconds;
+};
+
+static int multiprobe_parse_param(void *state, const char *param);
+static int multiprobe_build_prefix_index(struct multiprobe_state *mod_state);
+
+struct placement_mod* placement_mod_multiprobe(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_multiprobe_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_multiprobe_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
+{
+    struct placement_mod *mod_multiprobe;
+    struct multiprobe_state *mod_state;
+    double start;
+    int ret;
+
+    (void)virt_factor;
+
+    if(n_svrs < 1)
+        return(NULL);
+
+    mod_multiprobe = calloc(1, sizeof(*mod_multiprobe));
+    if(!mod_multiprobe)
+        return(NULL);
+
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_state)
+    {
+        free(mod_multiprobe);
+        return(NULL);
+    }
+
+    mod_multiprobe->data = mod_state;
+    mod_state->n_svrs = n_svrs;
+    mod_state->seed = seed;
+    mod_state->n_probes = MULTIPROBE_PROBES_DEFAULT;
+    mod_state->search = placement_search_select("auto");
+    mod_state->prefix_request = -1;
+
+    if(placement_parse_params("multiprobe", params, multiprobe_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_multiprobe);
+        return(NULL);
+    }
+
+    mod_state->ids = malloc(sizeof(*mod_state->ids)*(n_svrs+1));
+    mod_state->svrs = malloc(sizeof(*mod_state->svrs)*n_svrs);
+    if(!mod_state->ids || !mod_state->svrs)
+    {
+        placement_finalize_multiprobe(mod_multiprobe);
+        return(NULL);
+    }
+
+    /* each server's point is the id of its first vnode in the ring */
+    start = placement_wtime();
+    ret = placement_hash_vnodes(mod_state->ids, mod_state->svrs, n_svrs, 1,
+        NULL, seed, 1);
+    if(ret == 0)
+        ret = placement_radix_sort(mod_state->ids, mod_state->svrs, n_svrs, 1);
+    if(ret < 0)
+    {
+        placement_finalize_multiprobe(mod_multiprobe);
+        return(NULL);
+    }
+    mod_state->build_seconds = placement_wtime() - start;
+
+    start = placement_wtime();
+    if(multiprobe_build_prefix_index(mod_state) < 0)
+    {
+        placement_finalize_multiprobe(mod_multiprobe);
+        return(NULL);
+    }
+    mod_state->index_build_seconds = placement_wtime() - start;
+
+    mod_multiprobe->find_closest = placement_find_closest_multiprobe;
+    mod_multiprobe->find_closest_batch = placement_find_closest_batch_multiprobe;
+    mod_multiprobe->create_striped = placement_create_striped_random;
+    mod_multiprobe->finalize = placement_finalize_multiprobe;
+    mod_multiprobe->get_stats = placement_get_stats_multiprobe;
+    mod_multiprobe->add_server = placement_add_server_multiprobe;
+    mod_multiprobe->remove_server = placement_remove_server_multiprobe;
+
+    return(mod_multiprobe);
+}
+
+/* parses one module parameter; see the ring module for the format.
+ * probes is the number of probes per object.  prefix_bits sizes the prefix
+ * index ("auto" by default, 0 to search the points instead), and search
+ * picks the kernel for that search (see placement-search.h).
+ */
+static int multiprobe_parse_param(void *state, const char *param)
+{
+    struct multiprobe_state *mod_state = state;
+
+    if(sscanf(param, "probes:%u", &mod_state->n_probes) == 1)
+    {
+        if(mod_state->n_probes < 1 ||
+            mod_state->n_probes > MULTIPROBE_PROBES_MAX)
+        {
+            fprintf(stderr, "Error: probes must be between 1 and %d\n",
+                MULTIPROBE_PROBES_MAX);
+            return(-1);
+        }
+    }
+    else if(strcmp(param, "prefix_bits:auto") == 0)
+        mod_state->prefix_request = -1;
+    else if(sscanf(param, "prefix_bits:%d", &mod_state->prefix_request) == 1)
+    {
+        if(mod_state->prefix_request < 0 ||
+            mod_state->prefix_request > MULTIPROBE_PREFIX_BITS_MAX)
+        {
+            fprintf(stderr, "Error: prefix_bits must be between 0 and %d\n",
+                MULTIPROBE_PREFIX_BITS_MAX);
+            return(-1);
+        }
+    }
+    else if(strncmp(param, "search:", strlen("search:")) == 0)
+    {
+        if(placement_search_parse(param + strlen("search:"),
+            &mod_state->search) < 0)
+            return(-1);
+        if(!mod_state->search)
+        {
+            fprintf(stderr, "Error: multiprobe does not use bsearch()\n");
+            return(-1);
+        }
+    }
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* builds a table with one entry per value of the top prefix_bits bits of
+ * the id space, holding the position of the first point at or after the
+ * start of that bucket.  The extra final entry is n_svrs.  Called again
+ * after every membership change, and also fills the spare slot at the end
+ * of ids.  If the table cannot be allocated the old one is kept.
+ */
+static int multiprobe_build_prefix_index(struct multiprobe_state *mod_state)
+{
+    unsigned long n_buckets, bucket;
+    unsigned long i = 0;
+    uint32_t *prefix_index = NULL;
+    int prefix_bits;
+
+    /* about two buckets per point */
+    prefix_bits = mod_state->prefix_request;
+    if(prefix_bits < 0)
+    {
+        prefix_bits = 1;
+        while(prefix_bits < MULTIPROBE_PREFIX_BITS_MAX &&
+            ((unsigned long)1 << prefix_bits) < 2*mod_state->n_svrs)
+            prefix_bits++;
+    }
+
+    if(prefix_bits > 0)
+    {
+        n_buckets = (unsigned long)1 << prefix_bits;
+        prefix_index = malloc(sizeof(*prefix_index)*(n_buckets+1));
+        if(!prefix_index)
+            return(-1);
+
+        for(bucket=0; bucket<n_buckets; bucket++)
+        {
+            while(i < mod_state->n_svrs &&
+                (mod_state->ids[i] >> (64 - prefix_bits)) < bucket)
+                i++;
+            prefix_index[bucket] = i;
+        }
+        prefix_index[n_buckets] = mod_state->n_svrs;
+    }
+
+    mod_state->ids[mod_state->n_svrs] = UINT64_MAX;
+    free(mod_state->prefix_index);
+    mod_state->prefix_index = prefix_index;
+    mod_state->prefix_bits = prefix_bits;
+
+    return(0);
+}
+
+/* returns the position of the point that owns the probe */
+static inline unsigned long multiprobe_search(
+    struct multiprobe_state *mod_state, uint64_t probe)
+{
+    unsigned long i, end;
+
+    if(mod_state->prefix_index)
+    {
+        /* every id before the bucket is <= probe and every id after it is
+         * > probe, so the first id > probe is within [i, end].  Buckets
+         * rarely hold more than one point, so the first step is taken
+         * without branching (ids has a spare slot at the end for it).
+         */
+        i = mod_state->prefix_index[probe >> (64 - mod_state->prefix_bits)];
+        end = mod_state->prefix_index[(probe >> (64 - mod_state->prefix_bits)) + 1];
+        i += (i < end) & (mod_state->ids[i] <= probe);
+        while(i < end && mod_state->ids[i] <= probe)
+            i++;
+    }
+    else
+        i = mod_state->search(mod_state->ids, mod_state->n_svrs, probe);
+
+    /* no id <= probe: it belongs to the last point */
+    return((i ? i : mod_state->n_svrs) - 1);
+}
+
+static inline void multiprobe_find_closest(struct multiprobe_state *mod_state,
+    uint64_t obj, unsigned int replication, unsigned long *server_idxs)
+{
+    unsigned long n = mod_state->n_svrs;
+    uint32_t h1, h2;
+    uint64_t base, step, probe;
+    uint64_t dist, best_dist = UINT64_MAX;
+    unsigned long pos, best = 0;
+    unsigned long steps;
+    unsigned int found, i;
+    uint32_t svr;
+
+    /* the probes are h(obj) + i * g(obj) (double hashing), with an odd
+     * step so that they are all different
+     */
+    h1 = 0;
+    h2 = mod_state->seed;
+    ch_bj_hashlittle2(&obj, sizeof(obj), &h1, &h2);
+    base = h1 + (((uint64_t)h2)<<32);
+    h1 = 1;
+    h2 = mod_state->seed;
+    ch_bj_hashlittle2(&obj, sizeof(obj), &h1, &h2);
+    step = (h1 + (((uint64_t)h2)<<32)) | 1;
+
+    /* ties go to the earlier probe */
+    for(i=0, probe=base; i<mod_state->n_probes; i++, probe+=step)
+    {
+        pos = multiprobe_search(mod_state, probe);
+        dist = probe - mod_state->ids[pos];
+        best = dist < best_dist ? pos : best;
+        best_dist = dist < best_dist ? dist : best_dist;
+    }
+
+    /* walk clockwise from the winning point for the rest */
+    found = 0;
+    for(steps=0, pos=best; steps<n && found<replication; steps++)
+    {
+        svr = mod_state->svrs[pos];
+        if(++pos == n)
+            pos = 0;
+        for(i=0; i<found && server_idxs[i] != svr; i++);
+        if(i == found)
+            server_idxs[found++] = svr;
+    }
+
+    /* fewer servers than replicas */
+    for(; found<replication; found++)
+        server_idxs[found] = UINT64_MAX;
+
+    return;
+}
+
+static void placement_find_closest_multiprobe(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    multiprobe_find_closest(mod->data, obj, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_multiprobe(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct multiprobe_state *mod_state = mod->data;
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        multiprobe_find_closest(mod_state, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
+/* returns the position of svr_idx's point, or n_svrs if it has none */
+static unsigned long multiprobe_find_point(struct multiprobe_state *mod_state,
+    unsigned long svr_idx)
+{
+    unsigned long i;
+
+    for(i=0; i<mod_state->n_svrs && mod_state->svrs[i] != svr_idx; i++);
+
+    return(i);
+}
+
+static int placement_add_server_multiprobe(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct multiprobe_state *mod_state = mod->data;
+    uint64_t idx = svr_idx;
+    uint64_t id, *ids;
+    uint32_t *svrs;
+    uint32_t h1, h2;
+    unsigned long pos;
+
+    if(svr_idx > UINT32_MAX ||
+        multiprobe_find_point(mod_state, svr_idx) < mod_state->n_svrs)
+        return(-1);
+
+    ids = realloc(mod_state->ids, sizeof(*ids)*(mod_state->n_svrs+2));
+    if(!ids)
+        return(-1);
+    mod_state->ids = ids;
+    svrs = realloc(mod_state->svrs, sizeof(*svrs)*(mod_state->n_svrs+1));
+    if(!svrs)
+        return(-1);
+    mod_state->svrs = svrs;
+
+    /* hash the point the same way the constructor does, and insert it in
+     * the same order the sort would have given it
+     */
+    h1 = 0;
+    h2 = mod_state->seed;
+    ch_bj_hashlittle2(&idx, sizeof(idx), &h1, &h2);
+    id = h1 + (((uint64_t)h2)<<32);
+    for(pos=mod_state->n_svrs; pos>0 && (ids[pos-1] > id ||
+        (ids[pos-1] == id && svrs[pos-1] > svr_idx)); pos--)
+    {
+        ids[pos] = ids[pos-1];
+        svrs[pos] = svrs[pos-1];
+    }
+    ids[pos] = id;
+    svrs[pos] = svr_idx;
+    mod_state->n_svrs++;
+
+    /* take the point out again if the new index cannot be built */
+    if(multiprobe_build_prefix_index(mod_state) < 0)
+    {
+        mod_state->n_svrs--;
+        memmove(&ids[pos], &ids[pos+1],
+            sizeof(*ids)*(mod_state->n_svrs-pos));
+        memmove(&svrs[pos], &svrs[pos+1],
+            sizeof(*svrs)*(mod_state->n_svrs-pos));
+        ids[mod_state->n_svrs] = UINT64_MAX;
+        return(-1);
+    }
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static int placement_remove_server_multiprobe(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct multiprobe_state *mod_state = mod->data;
+    unsigned long pos;
+    uint64_t id;
+
+    pos = multiprobe_find_point(mod_state, svr_idx);
+    if(pos == mod_state->n_svrs || mod_state->n_svrs == 1)
+        return(-1);
+
+    id = mod_state->ids[pos];
+    mod_state->n_svrs--;
+    memmove(&mod_state->ids[pos], &mod_state->ids[pos+1],
+        sizeof(*mod_state->ids)*(mod_state->n_svrs-pos));
+    memmove(&mod_state->svrs[pos], &mod_state->svrs[pos+1],
+        sizeof(*mod_state->svrs)*(mod_state->n_svrs-pos));
+
+    /* put the point back if the new index cannot be built */
+    if(multiprobe_build_prefix_index(mod_state) < 0)
+    {
+        memmove(&mod_state->ids[pos+1], &mod_state->ids[pos],
+            sizeof(*mod_state->ids)*(mod_state->n_svrs-pos));
+        memmove(&mod_state->svrs[pos+1], &mod_state->svrs[pos],
+            sizeof(*mod_state->svrs)*(mod_state->n_svrs-pos));
+        mod_state->ids[pos] = id;
+        mod_state->svrs[pos] = svr_idx;
+        mod_state->n_svrs++;
+        return(-1);
+    }
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static void placement_finalize_multiprobe(struct placement_mod *mod)
+{
+    struct multiprobe_state *mod_state = mod->data;
+
+    free(mod_state->ids);
+    free(mod_state->svrs);
+    free(mod_state->prefix_index);
+    free(mod_state);
+    free(mod);
+
+    return;
+}
+
+static int placement_get_stats_multiprobe(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct multiprobe_state *mod_state = mod->data;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->table_bytes = mod_state->n_svrs *
+        (sizeof(*mod_state->ids) + sizeof(*mod_state->svrs));
+    if(mod_state->prefix_index)
+        stats->index_bytes = (((unsigned long)1 << mod_state->prefix_bits) + 1) *
+            sizeof(*mod_state->prefix_index);
+    stats->build_seconds = mod_state->build_seconds;
+    stats->index_build_seconds = mod_state->index_build_seconds;
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -7,57 +7,136 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ch-placement.h"
 #include "src/modules/placement-mod.h"
+#include "src/modules/placement-search.h"
+#include "src/modules/placement-build.h"
+#include "src/modules/placement-snapshot.h"
 #include "src/lookup3.h"
 
 static struct placement_mod* placement_mod_multiring(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_multiring_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
 static void placement_find_closest_multiring(struct placement_mod *mod, uint64_t obj, 
     unsigned int replication, unsigned long *server_idxs);
+static void placement_find_closest_batch_multiring(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
 static void placement_finalize_multiring(struct placement_mod *mod);
+static int placement_get_stats_multiring(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+static int placement_add_server_multiring(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static int placement_remove_server_multiring(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
 static void placement_create_striped_multiring(
-  struct placement_mod *mod,
+  struct placement_mod *mod, uint64_t *rng,
   unsigned long file_size, 
   unsigned int replication, unsigned int max_stripe_width, 
   unsigned int strip_size,
   unsigned int* num_objects,
   uint64_t *oids, unsigned long *sizes);
+static void placement_save_multiring(struct placement_mod *mod,
+    struct placement_snapshot *snap);
+static struct placement_mod* placement_load_multiring(
+    struct placement_snapshot *snap);
 
 static int vnode_cmp(const void* a, const void *b);
-static int vnode_nearest_cmp(const void* key, const void *member);
+static int ring_nearest_cmp(const void* key, const void *member);
 
 struct placement_mod_map multiring_mod_map = 
 {
     .type = "multiring",
     .initiate = placement_mod_multiring,
+    .initiate_params = placement_mod_multiring_params,
+    .load = placement_load_multiring,
 };
 
-struct multiring_state;
+/* upper limit on the size of the prefix index (4 bytes per bucket) */
+#define MULTIRING_PREFIX_BITS_MAX 24
 
+/* a parallel build sorts rings at least this large with a radix sort */
+#define MULTIRING_RADIX_MIN 4096
+
+/* batches are grouped by ring once the rings outgrow this many bytes, and
+ * the batch has at least MULTIRING_GROUP_PER_RING objects per ring
+ */
+#define MULTIRING_GROUP_MIN_BYTES (2*1024*1024)
+#define MULTIRING_GROUP_PER_RING 4
+
+/* a vnode while its ring is being sorted */
 struct vnode
 {
-    uint64_t svr_idx;
     uint64_t svr_id;
-    struct multiring_state* mod_state;
-    unsigned long array_idx;
+    uint32_t svr_idx;
+};
+
+/* a bsearch() key; vnodes are compared by their position on the ring */
+struct ring_key
+{
+    uint64_t obj;
+    const uint64_t *ids;
+    unsigned long n_svrs;
 };
 
+/* the rings are stored one after the other in a single slab, as parallel
+ * arrays: ring r holds ids and servers [r*n_svrs, (r+1)*n_svrs)
+ */
 struct multiring_state
 {
     unsigned int n_svrs;
     unsigned int virt_factor;
-    struct vnode **virt_table;
+    int seed;
+    uint64_t *ring_ids;     /* vnode ids, sorted within each ring */
+    uint32_t *ring_svrs;    /* server index of each vnode */
+    placement_search_fn search; /* NULL to use bsearch() */
+    int prefix_bits;        /* -1 to size automatically, 0 if disabled */
+    uint32_t *prefix_index; /* one index of 2^prefix_bits+1 entries per ring */
+    enum placement_build build;
+    int build_threads;      /* 0 to use the OpenMP default */
+    double build_seconds;
+    double index_build_seconds;
+    int mapped;             /* rings and indexes point into a snapshot */
+};
+
+/* first section of a multiring snapshot.  It is followed by the ids of
+ * every ring (virt_factor rows of n_svrs, in ring order), the matching
+ * server indexes, and the prefix index if there is one.
+ */
+struct multiring_snapshot
+{
+    uint32_t n_svrs;
+    uint32_t virt_factor;
+    int32_t seed;
+    int32_t prefix_bits;
+    uint32_t search;        /* 0 if the rings used bsearch() */
 };
 
+static int multiring_parse_param(void *state, const char *param);
+static int multiring_build_prefix_index(struct multiring_state *mod_state);
+static int multiring_build_rings_serial(struct multiring_state *mod_state);
+static int multiring_build_rings_parallel(struct multiring_state *mod_state);
+static int multiring_build_indexes(struct multiring_state *mod_state);
+static void multiring_free_indexes(struct multiring_state *mod_state);
+
 struct placement_mod* placement_mod_multiring(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_multiring_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_multiring_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
 {
     struct placement_mod *mod_multiring;
     struct multiring_state *mod_state;
-    uint32_t h1, h2;
-    uint64_t i, j;
+    int ret;
+    double start;
 
-    mod_multiring = malloc(sizeof(*mod_multiring));
+    mod_multiring = calloc(1, sizeof(*mod_multiring));
     if(!mod_multiring)
         return(NULL);
 
@@ -68,62 +147,513 @@ struct placement_mod* placement_mod_multiring(int n_svrs, int virt_factor, int s
         return(NULL);
     }
 
+    memset(mod_state, 0, sizeof(*mod_state));
+
     mod_multiring->data = mod_state;
 
-    mod_state->virt_table = malloc(sizeof(*mod_state->virt_table)*virt_factor);
-    if(!mod_state->virt_table)
+    mod_state->n_svrs = n_svrs;
+    mod_state->virt_factor = virt_factor;
+    mod_state->seed = seed;
+    mod_state->search = placement_search_select("auto");
+
+    ret = placement_parse_params("multiring", params, multiring_parse_param,
+        mod_state);
+    if(ret < 0)
     {
         free(mod_state);
         free(mod_multiring);
         return(NULL);
     }
-    for(i=0; i<virt_factor; i++)
+
+    mod_state->ring_ids = malloc(sizeof(*mod_state->ring_ids) *
+        n_svrs * virt_factor);
+    mod_state->ring_svrs = malloc(sizeof(*mod_state->ring_svrs) *
+        n_svrs * virt_factor);
+    if(!mod_state->ring_ids || !mod_state->ring_svrs)
     {
-        mod_state->virt_table[i] = malloc(sizeof(*mod_state->virt_table[0])*n_svrs);
-        if(!mod_state->virt_table[i])
-        {
-            free(mod_state->virt_table);
-            free(mod_state);
-            free(mod_multiring);
-            return(NULL);
-        }
+        placement_finalize_multiring(mod_multiring);
+        return(NULL);
     }
-   
-    mod_state->n_svrs = n_svrs;
-    mod_state->virt_factor = virt_factor;
 
-    /* create virt_factor virtual nodes for each server index by jenkins
+    start = placement_wtime();
+
+    /* large tables build their rings on several threads; both paths give
+     * exactly the same rings
+     */
+    if(placement_build_parallel(mod_state->build,
+        (unsigned long)n_svrs*virt_factor))
+        ret = multiring_build_rings_parallel(mod_state);
+    else
+        ret = multiring_build_rings_serial(mod_state);
+    if(ret < 0)
+    {
+        placement_finalize_multiring(mod_multiring);
+        return(NULL);
+    }
+
+    mod_state->build_seconds = placement_wtime() - start;
+    start = placement_wtime();
+
+    ret = multiring_build_indexes(mod_state);
+    if(ret < 0)
+    {
+        placement_finalize_multiring(mod_multiring);
+        return(NULL);
+    }
+
+    mod_state->index_build_seconds = placement_wtime() - start;
+
+    mod_multiring->find_closest = placement_find_closest_multiring;
+    mod_multiring->find_closest_batch = placement_find_closest_batch_multiring;
+    mod_multiring->create_striped = placement_create_striped_multiring;
+    mod_multiring->finalize = placement_finalize_multiring;
+    mod_multiring->get_stats = placement_get_stats_multiring;
+    mod_multiring->add_server = placement_add_server_multiring;
+    mod_multiring->remove_server = placement_remove_server_multiring;
+    mod_multiring->save = placement_save_multiring;
+
+    return(mod_multiring);
+}
+
+/* hashes the vnodes of one ring into its place in the slab and sorts them,
+ * with a radix sort or qsort(); both give the same order
+ */
+static int multiring_build_ring(struct multiring_state *mod_state,
+    unsigned long ring, int radix)
+{
+    unsigned long n_svrs = mod_state->n_svrs;
+    uint64_t *ids = &mod_state->ring_ids[ring*n_svrs];
+    uint32_t *svrs = &mod_state->ring_svrs[ring*n_svrs];
+    struct vnode *vnodes;
+    uint32_t h1, h2;
+    uint64_t i;
+
+    /* create a virtual node on this ring for each server index by jenkins
      * hashing server index
      */
     for(i=0; i<n_svrs; i++)
     {
-        for(j=0; j<virt_factor; j++)
+        h1 = ring;
+        h2 = mod_state->seed;
+        ch_bj_hashlittle2(&i, sizeof(i), &h1, &h2);
+        ids[i] = h1 + (((uint64_t)h2)<<32);
+        svrs[i] = i;
+    }
+
+    if(radix)
+        return(placement_radix_sort(ids, svrs, n_svrs, 1));
+
+    vnodes = malloc(sizeof(*vnodes)*n_svrs);
+    if(!vnodes)
+        return(-1);
+    for(i=0; i<n_svrs; i++)
+    {
+        vnodes[i].svr_id = ids[i];
+        vnodes[i].svr_idx = svrs[i];
+    }
+    qsort(vnodes, n_svrs, sizeof(*vnodes), vnode_cmp);
+    for(i=0; i<n_svrs; i++)
+    {
+        ids[i] = vnodes[i].svr_id;
+        svrs[i] = vnodes[i].svr_idx;
+    }
+    free(vnodes);
+
+    return(0);
+}
+
+static int multiring_build_rings_serial(struct multiring_state *mod_state)
+{
+    unsigned long ring;
+
+    for(ring=0; ring<mod_state->virt_factor; ring++)
+        if(multiring_build_ring(mod_state, ring, 0) < 0)
+            return(-1);
+
+    return(0);
+}
+
+/* same rings as multiring_build_rings_serial(), with the rings divided
+ * among threads.  Large rings are radix sorted.
+ */
+static int multiring_build_rings_parallel(struct multiring_state *mod_state)
+{
+    int threads = placement_build_threads(mod_state->build_threads);
+    int radix = mod_state->n_svrs >= MULTIRING_RADIX_MIN;
+    int failed = 0;
+    long ring;
+
+#pragma omp parallel for schedule(dynamic) num_threads(threads) reduction(|:failed)
+    for(ring=0; ring<mod_state->virt_factor; ring++)
+        if(multiring_build_ring(mod_state, ring, radix) < 0)
+            failed = 1;
+
+    return(failed ? -1 : 0);
+}
+
+/* parameters are optional; expected in the format
+ * "prefix_bits:12,search:scalar".  prefix_bits may also be "auto" to size
+ * the index from the number of servers.  search picks the kernel used to
+ * search each ring (see placement-search.h), or "bsearch".  build is
+ * "serial", "parallel" or "auto", and build_threads caps the threads used
+ * by a parallel build.
+ */
+static int multiring_parse_param(void *state, const char *param)
+{
+    struct multiring_state *mod_state = state;
+
+    if(strcmp(param, "prefix_bits:auto") == 0)
+        mod_state->prefix_bits = -1;
+    else if(sscanf(param, "prefix_bits:%d", &mod_state->prefix_bits) == 1)
+    {
+        if(mod_state->prefix_bits < 0 ||
+            mod_state->prefix_bits > MULTIRING_PREFIX_BITS_MAX)
         {
-            h1 = j;
-            h2 = seed;
-            ch_bj_hashlittle2(&i, sizeof(i), &h1, &h2);
-            mod_state->virt_table[j][i].svr_idx = i;
-            mod_state->virt_table[j][i].svr_id = h1 + (((uint64_t)h2)<<32);
+            fprintf(stderr, "Error: prefix_bits must be between 0 and %d\n",
+                MULTIRING_PREFIX_BITS_MAX);
+            return(-1);
         }
     }
+    else if(strncmp(param, "search:", strlen("search:")) == 0)
+    {
+        if(placement_search_parse(param + strlen("search:"),
+            &mod_state->search) < 0)
+            return(-1);
+    }
+    else if(strncmp(param, "build:", strlen("build:")) == 0)
+    {
+        if(placement_build_parse(param + strlen("build:"),
+            &mod_state->build) < 0)
+        {
+            fprintf(stderr, "Error: unknown build \"%s\"\n", param);
+            return(-1);
+        }
+    }
+    else if(sscanf(param, "build_threads:%d", &mod_state->build_threads) == 1)
+    {
+        /* 0 or less uses the OpenMP default */
+    }
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* builds, for each ring, a table with one entry per value of the top
+ * prefix_bits bits of the id space, holding the position of the first vnode
+ * at or after the start of that bucket.  The extra final entry of each table
+ * is n_svrs.
+ */
+static int multiring_build_prefix_index(struct multiring_state *mod_state)
+{
+    unsigned long n_buckets;
+    unsigned long bucket;
+    unsigned long i;
+    uint32_t *index;
+    const uint64_t *ids;
+    unsigned int ring;
 
-    for(i=0; i<virt_factor; i++)
+    /* by default use roughly one bucket per vnode on each ring */
+    if(mod_state->prefix_bits < 0)
     {
-        qsort(mod_state->virt_table[i], n_svrs, 
-            sizeof(*mod_state->virt_table[0]), vnode_cmp);
+        mod_state->prefix_bits = 1;
+        while(mod_state->prefix_bits < MULTIRING_PREFIX_BITS_MAX &&
+            ((unsigned long)1 << mod_state->prefix_bits) < mod_state->n_svrs)
+            mod_state->prefix_bits++;
+    }
+
+    n_buckets = (unsigned long)1 << mod_state->prefix_bits;
+    mod_state->prefix_index = malloc(sizeof(*mod_state->prefix_index) *
+        (n_buckets+1) * mod_state->virt_factor);
+    if(!mod_state->prefix_index)
+        return(-1);
 
-        for(j=0; j<n_svrs; j++)
+    for(ring=0; ring<mod_state->virt_factor; ring++)
+    {
+        index = &mod_state->prefix_index[ring*(n_buckets+1)];
+        ids = &mod_state->ring_ids[(unsigned long)ring*mod_state->n_svrs];
+        i = 0;
+        for(bucket=0; bucket<n_buckets; bucket++)
         {
-            mod_state->virt_table[i][j].array_idx = j;
-            mod_state->virt_table[i][j].mod_state = mod_state;
+            while(i < mod_state->n_svrs &&
+                (ids[i] >> (64 - mod_state->prefix_bits)) < bucket)
+                i++;
+            index[bucket] = i;
         }
+        index[n_buckets] = mod_state->n_svrs;
     }
 
-    mod_multiring->find_closest = placement_find_closest_multiring;
-    mod_multiring->create_striped = placement_create_striped_multiring;
-    mod_multiring->finalize = placement_finalize_multiring;
+    return(0);
+}
 
-    return(mod_multiring);
+/* builds whichever optional lookup indexes were requested.  The prefix
+ * index takes precedence over the search kernel, which works on the slab
+ * directly.
+ */
+static int multiring_build_indexes(struct multiring_state *mod_state)
+{
+    int ret;
+
+    if(mod_state->prefix_bits != 0)
+    {
+        ret = multiring_build_prefix_index(mod_state);
+        if(ret < 0)
+            return(-1);
+    }
+
+    return(0);
+}
+
+static void multiring_free_indexes(struct multiring_state *mod_state)
+{
+    free(mod_state->prefix_index);
+    mod_state->prefix_index = NULL;
+
+    return;
+}
+
+/* sets up next as a copy of the rings with a new slab and builds its
+ * lookup indexes, without touching mod_state, so that a membership change
+ * that runs out of memory leaves the rings as they were.  On failure the
+ * caller still owns ids and svrs.
+ */
+static int multiring_prepare(struct multiring_state *mod_state,
+    struct multiring_state *next, uint64_t *ids, uint32_t *svrs,
+    unsigned int n_svrs)
+{
+    int ret;
+
+    *next = *mod_state;
+    next->ring_ids = ids;
+    next->ring_svrs = svrs;
+    next->n_svrs = n_svrs;
+    next->prefix_index = NULL;
+
+    ret = multiring_build_indexes(next);
+    if(ret < 0)
+    {
+        multiring_free_indexes(next);
+        return(-1);
+    }
+
+    return(0);
+}
+
+/* replaces the rings and their indexes with the ones built by
+ * multiring_prepare()
+ */
+static void multiring_commit(struct multiring_state *mod_state,
+    struct multiring_state *next)
+{
+    free(mod_state->ring_ids);
+    free(mod_state->ring_svrs);
+    multiring_free_indexes(mod_state);
+    *mod_state = *next;
+
+    return;
+}
+
+/* position of svr_idx's vnode on the given ring, or -1 if it is not a
+ * member
+ */
+static long multiring_find_member(struct multiring_state *mod_state,
+    int ring, unsigned long svr_idx)
+{
+    const uint32_t *svrs = &mod_state->ring_svrs[(unsigned long)ring*mod_state->n_svrs];
+    unsigned long i;
+
+    for(i=0; i<mod_state->n_svrs; i++)
+        if(svrs[i] == svr_idx)
+            return(i);
+
+    return(-1);
+}
+
+/* records the arc owned by the vnode at pos on the given ring, which moves
+ * between that vnode's server and the server before it
+ */
+static int multiring_collect_arc(struct multiring_state *mod_state,
+    int ring, unsigned long pos, int adding, struct placement_arc_list *list)
+{
+    unsigned long n = mod_state->n_svrs;
+    const uint64_t *ids = &mod_state->ring_ids[(unsigned long)ring*n];
+    const uint32_t *svrs = &mod_state->ring_svrs[(unsigned long)ring*n];
+    unsigned long prev = (pos + n - 1) % n;
+    unsigned long next = (pos + 1) % n;
+
+    /* a vnode sharing its id with the next one owns nothing */
+    if(ids[next] == ids[pos])
+        return(0);
+
+    if(adding)
+        return(placement_arc_append(list, ids[pos], ids[next] - 1,
+            mod_state->virt_factor, ring, svrs[prev], svrs[pos]));
+    else
+        return(placement_arc_append(list, ids[pos], ids[next] - 1,
+            mod_state->virt_factor, ring, svrs[pos], svrs[prev]));
+}
+
+/* hands the arc list to the caller, or discards it */
+static void multiring_return_arcs(struct placement_arc_list *list,
+    struct ch_placement_arc **arcs, unsigned long *n_arcs)
+{
+    if(arcs)
+    {
+        *arcs = list->arcs;
+        *n_arcs = list->n_arcs;
+    }
+    else
+        free(list->arcs);
+
+    return;
+}
+
+static int placement_add_server_multiring(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct multiring_state *mod_state = mod->data;
+    struct multiring_state next;
+    struct placement_arc_list list = {NULL, 0, 0};
+    unsigned long n = mod_state->n_svrs;
+    uint64_t *ids;
+    uint32_t *svrs;
+    uint64_t idx = svr_idx;
+    uint64_t id;
+    unsigned long src, dst, end;
+    uint32_t h1, h2;
+    unsigned int ring;
+    int ret;
+
+    if(svr_idx > UINT32_MAX || multiring_find_member(mod_state, 0, svr_idx) >= 0)
+        return(-1);
+
+    ids = malloc(sizeof(*ids) * (n+1) * mod_state->virt_factor);
+    svrs = malloc(sizeof(*svrs) * (n+1) * mod_state->virt_factor);
+    if(!ids || !svrs)
+    {
+        free(ids);
+        free(svrs);
+        return(-1);
+    }
+
+    /* copy each ring into the new slab, merging in the new vnode */
+    for(ring=0, src=0, dst=0; ring<mod_state->virt_factor; ring++)
+    {
+        /* hash the new vnode the same way the constructor does */
+        h1 = ring;
+        h2 = mod_state->seed;
+        ch_bj_hashlittle2(&idx, sizeof(idx), &h1, &h2);
+        id = h1 + (((uint64_t)h2)<<32);
+
+        /* insert after any vnodes that sort before the new one */
+        end = src + n;
+        while(src < end && (mod_state->ring_ids[src] < id ||
+            (mod_state->ring_ids[src] == id &&
+            mod_state->ring_svrs[src] < svr_idx)))
+        {
+            ids[dst] = mod_state->ring_ids[src];
+            svrs[dst] = mod_state->ring_svrs[src];
+            src++;
+            dst++;
+        }
+        ids[dst] = id;
+        svrs[dst] = svr_idx;
+        dst++;
+        while(src < end)
+        {
+            ids[dst] = mod_state->ring_ids[src];
+            svrs[dst] = mod_state->ring_svrs[src];
+            src++;
+            dst++;
+        }
+    }
+
+    ret = multiring_prepare(mod_state, &next, ids, svrs, n+1);
+    for(ring=0; ring<mod_state->virt_factor && ret == 0; ring++)
+        ret = multiring_collect_arc(&next, ring,
+            multiring_find_member(&next, ring, svr_idx), 1, &list);
+    if(ret < 0)
+    {
+        free(list.arcs);
+        multiring_free_indexes(&next);
+        free(ids);
+        free(svrs);
+        return(-1);
+    }
+
+    multiring_commit(mod_state, &next);
+    multiring_return_arcs(&list, arcs, n_arcs);
+
+    return(0);
+}
+
+static int placement_remove_server_multiring(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct multiring_state *mod_state = mod->data;
+    struct multiring_state next;
+    struct placement_arc_list list = {NULL, 0, 0};
+    unsigned long n = (unsigned long)mod_state->n_svrs * mod_state->virt_factor;
+    uint64_t *ids;
+    uint32_t *svrs;
+    unsigned long i, k;
+    unsigned int ring;
+    int ret;
+
+    if(mod_state->n_svrs < 2 ||
+        multiring_find_member(mod_state, 0, svr_idx) < 0)
+        return(-1);
+
+    /* the arcs have to be found while the vnodes are still on the rings */
+    for(ring=0; ring<mod_state->virt_factor; ring++)
+    {
+        ret = multiring_collect_arc(mod_state, ring,
+            multiring_find_member(mod_state, ring, svr_idx), 0, &list);
+        if(ret < 0)
+        {
+            free(list.arcs);
+            return(-1);
+        }
+    }
+
+    ids = malloc(sizeof(*ids) * (n - mod_state->virt_factor));
+    svrs = malloc(sizeof(*svrs) * (n - mod_state->virt_factor));
+    if(!ids || !svrs)
+    {
+        free(ids);
+        free(svrs);
+        free(list.arcs);
+        return(-1);
+    }
+
+    /* drop the server's vnode from every ring; the rings after it move
+     * down in the slab as a result
+     */
+    for(i=0, k=0; i<n; i++)
+    {
+        if(mod_state->ring_svrs[i] == svr_idx)
+            continue;
+        ids[k] = mod_state->ring_ids[i];
+        svrs[k] = mod_state->ring_svrs[i];
+        k++;
+    }
+
+    ret = multiring_prepare(mod_state, &next, ids, svrs,
+        mod_state->n_svrs - 1);
+    if(ret < 0)
+    {
+        free(ids);
+        free(svrs);
+        free(list.arcs);
+        return(-1);
+    }
+
+    multiring_commit(mod_state, &next);
+    multiring_return_arcs(&list, arcs, n_arcs);
+
+    return(0);
 }
 
 static int vnode_cmp(const void* a, const void *b)
@@ -131,71 +661,205 @@ static int vnode_cmp(const void* a, const void *b)
     const struct vnode *v_a = a;
     const struct vnode *v_b = b;
 
+    /* equal ids are ordered by server, so that the order does not depend
+     * on the sort algorithm
+     */
     if(v_a->svr_id < v_b->svr_id)
         return(-1);
     else if(v_a->svr_id > v_b->svr_id)
         return(1);
+    else if(v_a->svr_idx < v_b->svr_idx)
+        return(-1);
+    else if(v_a->svr_idx > v_b->svr_idx)
+        return(1);
     else
         return(0);
 }
 
-static void placement_find_closest_multiring(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
-    unsigned long* server_idxs)
+/* finds the position of the vnode with the greatest id less than or equal
+ * to the oid on the given ring, using the prefix index to narrow the search
+ * to the vnodes in the oid's bucket, which are then scanned
+ */
+static inline unsigned long multiring_search_prefix(
+    struct multiring_state *mod_state, int ring, const uint64_t *ids,
+    uint64_t obj)
 {
-    struct multiring_state *mod_state = mod->data;
-    struct vnode* svr;
-    int current_index;
-    int i;
+    const uint32_t *index = &mod_state->prefix_index[ring *
+        (((unsigned long)1 << mod_state->prefix_bits) + 1)];
+    uint64_t bucket = obj >> (64 - mod_state->prefix_bits);
+    unsigned long i = index[bucket];
+    unsigned long end = index[bucket+1];
 
-    /* NOTE: there are other methods of partitioning objects across rings;
-     * for now we assuming object IDs are randomly distributed and modulo
-     * will work just fine.
+    /* every id before the bucket is <= oid and every id after it is > oid,
+     * so the first id > oid is within [i, end]
      */
-    int ring = obj % mod_state->virt_factor;
+    while(i < end && ids[i] <= obj)
+        i++;
 
-    /* binary search through multiring to find the server with the greatest 
-     * virtual ID less than the oid 
-     */
-    svr = bsearch(&obj, mod_state->virt_table[ring], 
-        mod_state->n_svrs, 
-        sizeof(*mod_state->virt_table[0]), vnode_nearest_cmp);
+    if(i == 0)
+        return(mod_state->n_svrs-1);
+    return(i-1);
+}
 
-    /* if bsearch didn't find a match, then the object belongs to the last
-     * server partition
-     */
-    if(!svr)
-        svr = &mod_state->virt_table[ring][mod_state->n_svrs-1];
+/* places an object on the given ring, which must be obj % virt_factor */
+static inline void multiring_find_closest_ring(
+    struct multiring_state *mod_state, int ring, uint64_t obj,
+    unsigned int replication, unsigned long* server_idxs)
+{
+    unsigned long n = mod_state->n_svrs;
+    const uint64_t *ids = &mod_state->ring_ids[(unsigned long)ring*n];
+    const uint32_t *svrs = &mod_state->ring_svrs[(unsigned long)ring*n];
+    struct ring_key key;
+    const uint64_t *svr;
+    unsigned long current_index;
+    int i;
+
+    if(mod_state->prefix_index)
+        current_index = multiring_search_prefix(mod_state, ring, ids, obj);
+    else if(mod_state->search)
+    {
+        current_index = mod_state->search(ids, n, obj);
+        /* no id <= oid: wrap around to the last server */
+        if(current_index == 0)
+            current_index = n;
+        current_index--;
+    }
+    else
+    {
+        /* binary search through multiring to find the server with the greatest
+         * virtual ID less than the oid
+         */
+        key.obj = obj;
+        key.ids = ids;
+        key.n_svrs = n;
+        svr = bsearch(&key, ids, n, sizeof(*ids), ring_nearest_cmp);
+
+        /* if bsearch didn't find a match, then the object belongs to the last
+         * server partition
+         */
+        current_index = svr ? (unsigned long)(svr - ids) : n-1;
+    }
 
     /* walk through ring, clockwise, to find N closest servers. */
     /* note: there are no duplicates on a given ring */
-    current_index = svr->array_idx;
     for(i=0; i<replication; i++)
     {
-        if(current_index == mod_state->n_svrs)
+        if(current_index == n)
             current_index = 0;
 
-        server_idxs[i] = mod_state->virt_table[ring][current_index].svr_idx;
+        server_idxs[i] = svrs[current_index];
         current_index++;
     }
 
     return;
 }
 
-static int vnode_nearest_cmp(const void* key, const void *member)
+static inline void multiring_find_closest(struct multiring_state *mod_state,
+    uint64_t obj, unsigned int replication, unsigned long* server_idxs)
+{
+    /* NOTE: there are other methods of partitioning objects across rings;
+     * for now we assuming object IDs are randomly distributed and modulo
+     * will work just fine.
+     */
+    multiring_find_closest_ring(mod_state, obj % mod_state->virt_factor, obj,
+        replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_multiring(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    multiring_find_closest(mod->data, obj, replication, server_idxs);
+
+    return;
+}
+
+/* once the rings are too large to stay in cache together, a batch is
+ * first grouped by ring (a counting sort into a copy of the oids) and then
+ * placed one ring at a time, so that each ring is brought into cache once
+ * per batch.  The results still land in the caller's order.
+ */
+static void placement_find_closest_batch_multiring(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct multiring_state *mod_state = mod->data;
+    unsigned long vf = mod_state->virt_factor;
+    unsigned long *ends = NULL;
+    uint32_t *order = NULL;
+    uint32_t *rings = NULL;
+    uint64_t *grouped = NULL;
+    unsigned long i, k;
+    unsigned long ring;
+
+    if((unsigned long)mod_state->n_svrs * vf * (sizeof(*mod_state->ring_ids) +
+        sizeof(*mod_state->ring_svrs)) >= MULTIRING_GROUP_MIN_BYTES &&
+        n_objs >= vf * MULTIRING_GROUP_PER_RING && n_objs <= UINT32_MAX)
+    {
+        ends = calloc(vf + 1, sizeof(*ends));
+        order = malloc(sizeof(*order) * n_objs);
+        rings = malloc(sizeof(*rings) * n_objs);
+        grouped = malloc(sizeof(*grouped) * n_objs);
+    }
+    if(!ends || !order || !rings || !grouped)
+    {
+        free(ends);
+        free(order);
+        free(rings);
+        free(grouped);
+        for(i=0; i<n_objs; i++)
+            multiring_find_closest(mod_state, objs[i], replication,
+                &server_idxs[i*replication]);
+        return;
+    }
+
+    for(i=0; i<n_objs; i++)
+    {
+        rings[i] = objs[i] % vf;
+        ends[rings[i]+1]++;
+    }
+    for(ring=0; ring<vf; ring++)
+        ends[ring+1] += ends[ring];
+    /* this leaves ends[ring] at the end of the ring's objects */
+    for(i=0; i<n_objs; i++)
+    {
+        k = ends[rings[i]]++;
+        order[k] = i;
+        grouped[k] = objs[i];
+    }
+
+    for(ring=0, k=0; ring<vf; ring++)
+        for(; k<ends[ring]; k++)
+            multiring_find_closest_ring(mod_state, ring, grouped[k],
+                replication, &server_idxs[(unsigned long)order[k]*replication]);
+
+    free(ends);
+    free(order);
+    free(rings);
+    free(grouped);
+
+    return;
+}
+
+static int ring_nearest_cmp(const void* key, const void *member)
 {
-    const uint64_t* obj = key;
-    const struct vnode *svr = member;
-    int ring = (*obj) % svr->mod_state->virt_factor;
+    const struct ring_key* ring_key = key;
+    const uint64_t *svr_id = member;
+    unsigned long array_idx = svr_id - ring_key->ids;
 
-    if(*obj < svr->svr_id)
+    if(ring_key->obj < *svr_id)
         return(-1);
-    if(*obj > svr->svr_id)
+    if(ring_key->obj > *svr_id)
     {
         /* are we on the last server already? */
-        if(svr->array_idx == (svr->mod_state->n_svrs-1))
+        if(array_idx == (ring_key->n_svrs-1))
             return(0);
-        /* is the oid also larger than the next server's id? */
-        if(svr->mod_state->virt_table[ring][svr->array_idx+1].svr_id < *obj)
+        /* is the oid also at or past the next server's id?  (matching the
+         * next id exactly belongs to the next server, so that exactly one
+         * entry compares equal)
+         */
+        if(ring_key->ids[array_idx+1] <= ring_key->obj)
             return(1);
     }
 
@@ -206,19 +870,40 @@ static int vnode_nearest_cmp(const void* key, const void *member)
 static void placement_finalize_multiring(struct placement_mod *mod)
 {
     struct multiring_state *mod_state = mod->data;
-    int i;
 
-    for(i=0; i<mod_state->virt_factor; i++)
-        free(mod_state->virt_table[i]);
-    free(mod_state->virt_table);
+    if(!mod_state->mapped)
+    {
+        free(mod_state->ring_ids);
+        free(mod_state->ring_svrs);
+        multiring_free_indexes(mod_state);
+    }
     free(mod_state);
     free(mod);
 
     return;
 }
 
+static int placement_get_stats_multiring(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct multiring_state *mod_state = mod->data;
+
+    stats->table_bytes = (unsigned long)mod_state->virt_factor *
+        mod_state->n_svrs * (sizeof(*mod_state->ring_ids) +
+        sizeof(*mod_state->ring_svrs));
+    stats->index_bytes = 0;
+    if(mod_state->prefix_index)
+        stats->index_bytes += mod_state->virt_factor *
+            (((unsigned long)1 << mod_state->prefix_bits) + 1) *
+            sizeof(*mod_state->prefix_index);
+    stats->build_seconds = mod_state->build_seconds;
+    stats->index_build_seconds = mod_state->index_build_seconds;
+
+    return(0);
+}
+
 static void placement_create_striped_multiring(
-  struct placement_mod *mod,
+  struct placement_mod *mod, uint64_t *rng,
   unsigned long file_size, 
   unsigned int replication, unsigned int max_stripe_width, 
   unsigned int strip_size,
@@ -226,8 +911,9 @@ static void placement_create_striped_multiring(
   uint64_t *oids, unsigned long *sizes)
 {
     struct multiring_state *mod_state = mod->data;
-    int ring = random() % mod_state->virt_factor;
-    int ring_idx = random() % mod_state->n_svrs;
+    int ring;
+    int ring_idx;
+    const uint64_t *ids;
     unsigned int stripe_width;
     int i;
     unsigned long size_left = file_size;
@@ -235,6 +921,19 @@ static void placement_create_striped_multiring(
     uint64_t range, oid_offset;
     unsigned long check_size = 0;
 
+    /* starting ring and position on it */
+    if(rng)
+    {
+        ring = ch_placement_random_u64_r(rng) % mod_state->virt_factor;
+        ring_idx = ch_placement_random_u64_r(rng) % mod_state->n_svrs;
+    }
+    else
+    {
+        ring = random() % mod_state->virt_factor;
+        ring_idx = random() % mod_state->n_svrs;
+    }
+    ids = &mod_state->ring_ids[(unsigned long)ring*mod_state->n_svrs];
+
     /* how many objects to use */
     stripe_width = file_size / strip_size + 1;
     if(file_size % strip_size == 0)
@@ -274,10 +973,9 @@ static void placement_create_striped_multiring(
     {
         /* figure out size of object interval for this server on this ring */
         if(ring_idx < (mod_state->n_svrs-1))
-            range = mod_state->virt_table[ring][ring_idx+1].svr_id - mod_state->virt_table[ring][ring_idx].svr_id;
+            range = ids[ring_idx+1] - ids[ring_idx];
         else
-            range = UINT64_MAX - mod_state->virt_table[ring][ring_idx].svr_id
-                + mod_state->virt_table[ring][0].svr_id;
+            range = UINT64_MAX - ids[ring_idx] + ids[0];
 
         /* divide by mod_state->virt_factor to account for the fact that objects are
          * partitioned over each ring
@@ -287,9 +985,9 @@ static void placement_create_striped_multiring(
         range -= 3;
 
         /* pick oid offset within range as random number within range */
-        oid_offset = ch_placement_random_u64() % range;
+        oid_offset = placement_random_u64(rng) % range;
         /* calculate true oid based on offset */
-        oids[i] = (mod_state->virt_table[ring][ring_idx].svr_id + (oid_offset+1)*mod_state->virt_factor);
+        oids[i] = (ids[ring_idx] + (oid_offset+1)*mod_state->virt_factor);
         /* round down to an oid that falls in this ring */
         oids[i] -= oids[i]%mod_state->virt_factor;
         oids[i] += ring;
@@ -300,6 +998,100 @@ static void placement_create_striped_multiring(
     return;
 }
 
+static void placement_save_multiring(struct placement_mod *mod,
+    struct placement_snapshot *snap)
+{
+    struct multiring_state *mod_state = mod->data;
+    struct multiring_snapshot header;
+    unsigned long n = (unsigned long)mod_state->n_svrs * mod_state->virt_factor;
+
+    memset(&header, 0, sizeof(header));
+    header.n_svrs = mod_state->n_svrs;
+    header.virt_factor = mod_state->virt_factor;
+    header.seed = mod_state->seed;
+    header.prefix_bits = mod_state->prefix_index ? mod_state->prefix_bits : 0;
+    header.search = (mod_state->search != NULL);
+
+    placement_snapshot_write(snap, &header, sizeof(header));
+    placement_snapshot_write(snap, mod_state->ring_ids,
+        n * sizeof(*mod_state->ring_ids));
+    placement_snapshot_write(snap, mod_state->ring_svrs,
+        n * sizeof(*mod_state->ring_svrs));
+    if(header.prefix_bits)
+        placement_snapshot_write(snap, mod_state->prefix_index,
+            mod_state->virt_factor *
+            (((unsigned long)1 << header.prefix_bits) + 1) *
+            sizeof(*mod_state->prefix_index));
+
+    return;
+}
+
+/* the snapshot holds the slab as it is in memory, so the rings and the
+ * prefix index are used in place; nothing is copied, hashed or sorted
+ */
+static struct placement_mod* placement_load_multiring(
+    struct placement_snapshot *snap)
+{
+    const struct multiring_snapshot *header;
+    struct placement_mod *mod_multiring;
+    struct multiring_state *mod_state;
+    unsigned long n;
+    double start = placement_wtime();
+
+    header = placement_snapshot_read(snap, 1, sizeof(*header));
+    if(!header || header->n_svrs == 0 || header->virt_factor == 0 ||
+        header->prefix_bits < 0 ||
+        header->prefix_bits > MULTIRING_PREFIX_BITS_MAX)
+        return(NULL);
+    n = (unsigned long)header->n_svrs * header->virt_factor;
+
+    mod_multiring = calloc(1, sizeof(*mod_multiring));
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_multiring || !mod_state)
+    {
+        free(mod_multiring);
+        free(mod_state);
+        return(NULL);
+    }
+    mod_multiring->data = mod_state;
+
+    mod_state->mapped = 1;
+    mod_state->n_svrs = header->n_svrs;
+    mod_state->virt_factor = header->virt_factor;
+    mod_state->seed = header->seed;
+    mod_state->prefix_bits = header->prefix_bits;
+    /* the kernel itself depends on the cpu loading the snapshot */
+    mod_state->search = header->search ? placement_search_select("auto") : NULL;
+
+    mod_state->ring_ids = (uint64_t*)placement_snapshot_read(snap, n,
+        sizeof(*mod_state->ring_ids));
+    mod_state->ring_svrs = (uint32_t*)placement_snapshot_read(snap, n,
+        sizeof(*mod_state->ring_svrs));
+    if(mod_state->prefix_bits)
+        mod_state->prefix_index = (uint32_t*)placement_snapshot_read(snap,
+            mod_state->virt_factor *
+            (((unsigned long)1 << mod_state->prefix_bits) + 1),
+            sizeof(*mod_state->prefix_index));
+    if(snap->error || !mod_state->ring_ids || !mod_state->ring_svrs)
+    {
+        free(mod_state);
+        free(mod_multiring);
+        return(NULL);
+    }
+
+    mod_state->build_seconds = placement_wtime() - start;
+
+    /* the indexes are read-only, so membership changes are not offered */
+    mod_multiring->find_closest = placement_find_closest_multiring;
+    mod_multiring->find_closest_batch = placement_find_closest_batch_multiring;
+    mod_multiring->create_striped = placement_create_striped_multiring;
+    mod_multiring->finalize = placement_finalize_multiring;
+    mod_multiring->get_stats = placement_get_stats_multiring;
+    mod_multiring->save = placement_save_multiring;
+
+    return(mod_multiring);
+}
+
 /*
  * Local variables:
  *  c-indent-level: 4
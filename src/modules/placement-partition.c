@@ -0,0 +1,982 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Fixed partition (hash slot) placement.  The oid space is split into
+ * 2^partition_bits equal ranges by the top bits of the oid, and a table
+ * holds the replica set of each partition, so a lookup is a shift and one
+ * row read.  Like the ring, it expects oids that are already spread over
+ * the whole 64 bit space.
+ *
+ * The table is built either balanced (each replica rank of the partitions
+ * dealt round robin over the servers, in a different hashed order per
+ * rank) or from the ring with the same servers, virt_factor and seed, so
+ * that a deployment using the ring can move to a cached table with few
+ * objects moving.  After that, membership changes only rewrite rows:
+ * - a removed server's slots go to the least loaded servers not already
+ *   in the row,
+ * - a server coming back reclaims the slots it held (its "home" slots),
+ *   undoing those changes, and
+ * - a new server takes slots from the most loaded servers until it holds
+ *   its share of each replica rank.
+ * Every moved slot is needed to keep the ranks balanced.  Since partitions
+ * are ranges of oids, the primary changes are reported as arcs.
+ *
+ * The table can be saved with ch_placement_save() and mapped by other
+ * processes with ch_placement_load_mmap(), which is how services cache it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "src/modules/placement-mod.h"
+#include "src/modules/placement-build.h"
+#include "src/modules/placement-snapshot.h"
+#include "src/lookup3.h"
+
+static struct placement_mod* placement_mod_partition(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_partition_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
+static void placement_find_closest_partition(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_find_closest_batch_partition(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_finalize_partition(struct placement_mod *mod);
+static int placement_get_stats_partition(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+static int placement_add_server_partition(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static int placement_remove_server_partition(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static void placement_save_partition(struct placement_mod *mod,
+    struct placement_snapshot *snap);
+static struct placement_mod* placement_load_partition(
+    struct placement_snapshot *snap);
+
+struct placement_mod_map partition_mod_map =
+{
+    .type = "partition",
+    .initiate = placement_mod_partition,
+    .initiate_params = placement_mod_partition_params,
+    .load = placement_load_partition,
+};
+
+/* the default gives each server about 100 partitions */
+#define PARTITION_PER_SVR 100
+#define PARTITION_BITS_MAX 24
+#define PARTITION_REPLICAS_DEFAULT 3
+#define PARTITION_REPLICAS_MAX 16
+/* a slot with no server, when there are fewer members than replicas */
+#define PARTITION_EMPTY UINT32_MAX
+
+enum partition_from
+{
+    PARTITION_FROM_BALANCED = 0,
+    PARTITION_FROM_RING,
+};
+
+struct partition_state
+{
+    unsigned int n_svrs;    /* current members */
+    unsigned int virt_factor;
+    int seed;
+    int bits_request;       /* -1 for auto */
+    int bits;
+    unsigned long n_parts;
+    unsigned int width;     /* replicas stored per partition */
+    enum partition_from from;
+    uint32_t *table;        /* n_parts rows of width servers */
+    unsigned long n_empty;  /* empty slots in the table */
+    uint32_t *home;         /* server each slot goes back to */
+    unsigned long *counts;  /* slots held, per server and replica rank */
+    unsigned char *member;
+    unsigned long n_slots;  /* entries in member (and counts / width) */
+    int mapped;             /* table points into a snapshot */
+};
+
+/* first section of a partition snapshot; the table follows */
+struct partition_snapshot
+{
+    uint32_t n_svrs;
+    uint32_t width;
+    int32_t bits;
+    uint32_t reserved;
+    uint64_t n_empty;
+};
+
+/* a server id paired with its index, for sorting */
+struct partition_svr
+{
+    uint64_t id;
+    uint32_t svr;
+};
+
+/* copy of what a membership change rewrites, taken when arcs are asked
+ * for, so that the change can be undone if they cannot be recorded
+ */
+struct partition_undo
+{
+    uint32_t *table;
+    uint32_t *home;
+    unsigned long *counts;
+    unsigned long n_empty;
+    unsigned int n_svrs;
+};
+
+static int partition_parse_param(void *state, const char *param);
+static int partition_build_balanced(struct partition_state *mod_state);
+static int partition_build_from_ring(struct partition_state *mod_state);
+
+struct placement_mod* placement_mod_partition(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_partition_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_partition_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
+{
+    struct placement_mod *mod_partition;
+    struct partition_state *mod_state;
+    unsigned long n_entries;
+    unsigned long i;
+    unsigned int j;
+    int ret;
+
+    if(n_svrs < 1)
+        return(NULL);
+
+    mod_partition = calloc(1, sizeof(*mod_partition));
+    if(!mod_partition)
+        return(NULL);
+
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_state)
+    {
+        free(mod_partition);
+        return(NULL);
+    }
+
+    mod_partition->data = mod_state;
+    mod_state->n_svrs = n_svrs;
+    mod_state->virt_factor = virt_factor;
+    mod_state->seed = seed;
+    mod_state->bits_request = -1;
+    mod_state->width = n_svrs < PARTITION_REPLICAS_DEFAULT ?
+        n_svrs : PARTITION_REPLICAS_DEFAULT;
+
+    if(placement_parse_params("partition", params, partition_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_partition);
+        return(NULL);
+    }
+    if(mod_state->width > (unsigned int)n_svrs)
+    {
+        fprintf(stderr, "Error: partition replicas must be at most the number of servers\n");
+        free(mod_state);
+        free(mod_partition);
+        return(NULL);
+    }
+    if(mod_state->from == PARTITION_FROM_RING && virt_factor < 1)
+    {
+        free(mod_state);
+        free(mod_partition);
+        return(NULL);
+    }
+
+    mod_state->bits = mod_state->bits_request;
+    if(mod_state->bits < 0)
+    {
+        mod_state->bits = 1;
+        while(mod_state->bits < PARTITION_BITS_MAX &&
+            ((unsigned long)1 << mod_state->bits) <
+            (unsigned long)PARTITION_PER_SVR * n_svrs)
+            mod_state->bits++;
+    }
+    mod_state->n_parts = (unsigned long)1 << mod_state->bits;
+
+    n_entries = mod_state->n_parts * mod_state->width;
+    mod_state->n_slots = n_svrs;
+    mod_state->table = malloc(sizeof(*mod_state->table) * n_entries);
+    mod_state->home = malloc(sizeof(*mod_state->home) * n_entries);
+    mod_state->counts = calloc((unsigned long)n_svrs * mod_state->width,
+        sizeof(*mod_state->counts));
+    mod_state->member = malloc(n_svrs);
+    if(!mod_state->table || !mod_state->home || !mod_state->counts ||
+        !mod_state->member)
+    {
+        placement_finalize_partition(mod_partition);
+        return(NULL);
+    }
+    memset(mod_state->member, 1, n_svrs);
+
+    if(mod_state->from == PARTITION_FROM_RING)
+        ret = partition_build_from_ring(mod_state);
+    else
+        ret = partition_build_balanced(mod_state);
+    if(ret < 0)
+    {
+        placement_finalize_partition(mod_partition);
+        return(NULL);
+    }
+
+    memcpy(mod_state->home, mod_state->table,
+        sizeof(*mod_state->home) * n_entries);
+    for(i=0; i<mod_state->n_parts; i++)
+        for(j=0; j<mod_state->width; j++)
+            mod_state->counts[(unsigned long)mod_state->table[i*mod_state->width+j]*
+                mod_state->width + j]++;
+
+    mod_partition->find_closest = placement_find_closest_partition;
+    mod_partition->find_closest_batch = placement_find_closest_batch_partition;
+    mod_partition->create_striped = placement_create_striped_random;
+    mod_partition->finalize = placement_finalize_partition;
+    mod_partition->get_stats = placement_get_stats_partition;
+    mod_partition->add_server = placement_add_server_partition;
+    mod_partition->remove_server = placement_remove_server_partition;
+    mod_partition->save = placement_save_partition;
+
+    return(mod_partition);
+}
+
+/* parses one module parameter; see the ring module for the format.
+ * partition_bits sets the number of partitions ("auto" by default, for
+ * about 100 per server), replicas the number of servers stored per
+ * partition (lookups for more continue into the following partitions),
+ * and from picks how the table is built ("balanced" or "ring").
+ */
+static int partition_parse_param(void *state, const char *param)
+{
+    struct partition_state *mod_state = state;
+
+    if(strcmp(param, "partition_bits:auto") == 0)
+        mod_state->bits_request = -1;
+    else if(sscanf(param, "partition_bits:%d", &mod_state->bits_request) == 1)
+    {
+        if(mod_state->bits_request < 1 ||
+            mod_state->bits_request > PARTITION_BITS_MAX)
+        {
+            fprintf(stderr, "Error: partition_bits must be between 1 and %d\n",
+                PARTITION_BITS_MAX);
+            return(-1);
+        }
+    }
+    else if(sscanf(param, "replicas:%u", &mod_state->width) == 1)
+    {
+        if(mod_state->width < 1 ||
+            mod_state->width > PARTITION_REPLICAS_MAX)
+        {
+            fprintf(stderr, "Error: replicas must be between 1 and %d\n",
+                PARTITION_REPLICAS_MAX);
+            return(-1);
+        }
+    }
+    else if(strcmp(param, "from:balanced") == 0)
+        mod_state->from = PARTITION_FROM_BALANCED;
+    else if(strcmp(param, "from:ring") == 0)
+        mod_state->from = PARTITION_FROM_RING;
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+static int partition_svr_cmp(const void* a, const void *b)
+{
+    const struct partition_svr *s_a = a;
+    const struct partition_svr *s_b = b;
+
+    if(s_a->id < s_b->id)
+        return(-1);
+    else if(s_a->id > s_b->id)
+        return(1);
+    else if(s_a->svr < s_b->svr)
+        return(-1);
+    else if(s_a->svr > s_b->svr)
+        return(1);
+    else
+        return(0);
+}
+
+/* deals replica rank j of the partitions round robin over the servers,
+ * ordered by their vnode j id.  A server already in the row is passed
+ * over and dealt next instead, which keeps every rank within a slot or so
+ * of even.
+ */
+static int partition_build_balanced(struct partition_state *mod_state)
+{
+    struct partition_svr *order;
+    struct partition_svr tmp;
+    uint64_t *ids;
+    uint32_t *svrs;
+    uint32_t *row;
+    unsigned long n = mod_state->n_svrs;
+    unsigned long width = mod_state->width;
+    unsigned long i, p, pos, k;
+    unsigned int j, m;
+
+    order = malloc(sizeof(*order) * n);
+    ids = malloc(sizeof(*ids) * n * width);
+    svrs = malloc(sizeof(*svrs) * n * width);
+    if(!order || !ids || !svrs ||
+        placement_hash_vnodes(ids, svrs, n, width, NULL, mod_state->seed,
+        1) < 0)
+    {
+        free(order);
+        free(ids);
+        free(svrs);
+        return(-1);
+    }
+
+    for(j=0; j<width; j++)
+    {
+        for(i=0; i<n; i++)
+        {
+            order[i].id = ids[i*width + j];
+            order[i].svr = i;
+        }
+        qsort(order, n, sizeof(*order), partition_svr_cmp);
+
+        for(p=0, pos=0; p<mod_state->n_parts; p++, pos++)
+        {
+            row = &mod_state->table[p*width];
+            for(k=0; ; k++)
+            {
+                for(m=0; m<j && row[m] != order[(pos + k) % n].svr; m++);
+                if(m == j)
+                    break;
+            }
+            tmp = order[(pos + k) % n];
+            order[(pos + k) % n] = order[pos % n];
+            order[pos % n] = tmp;
+            row[j] = tmp.svr;
+        }
+    }
+
+    free(order);
+    free(ids);
+    free(svrs);
+
+    return(0);
+}
+
+/* gives each partition the replicas the ring would give the first oid in
+ * it, so that only the oids on either side of a vnode boundary inside a
+ * partition are placed differently
+ */
+static int partition_build_from_ring(struct partition_state *mod_state)
+{
+    uint64_t *ids;
+    uint32_t *svrs;
+    uint32_t *row;
+    unsigned long n = (unsigned long)mod_state->n_svrs *
+        mod_state->virt_factor;
+    unsigned long p, pos, start, steps;
+    unsigned int found, m;
+    uint64_t point;
+
+    ids = malloc(sizeof(*ids) * n);
+    svrs = malloc(sizeof(*svrs) * n);
+    if(!ids || !svrs ||
+        placement_hash_vnodes(ids, svrs, mod_state->n_svrs,
+        mod_state->virt_factor, NULL, mod_state->seed, 1) < 0 ||
+        placement_radix_sort(ids, svrs, n, 1) < 0)
+    {
+        free(ids);
+        free(svrs);
+        return(-1);
+    }
+
+    /* pos counts the vnodes at or below the partition's first oid */
+    for(p=0, pos=0; p<mod_state->n_parts; p++)
+    {
+        point = (uint64_t)p << (64 - mod_state->bits);
+        while(pos < n && ids[pos] <= point)
+            pos++;
+        /* no id <= oid: wrap around to the last vnode */
+        start = pos ? pos - 1 : n - 1;
+
+        row = &mod_state->table[p*mod_state->width];
+        for(found=0, steps=0; found<mod_state->width && steps<n; steps++)
+        {
+            for(m=0; m<found && row[m] != svrs[(start + steps) % n]; m++);
+            if(m == found)
+                row[found++] = svrs[(start + steps) % n];
+        }
+    }
+
+    free(ids);
+    free(svrs);
+
+    return(0);
+}
+
+/* fills server_idxs from the rows starting at partition p, skipping empty
+ * slots and duplicates, for lookups wider than the table or while some
+ * slots are empty
+ */
+static void partition_find_closest_walk(struct partition_state *mod_state,
+    unsigned long p, unsigned int replication, unsigned long *server_idxs)
+{
+    const uint32_t *row;
+    unsigned long steps;
+    unsigned int found = 0;
+    unsigned int i, j;
+
+    for(steps=0; steps<mod_state->n_parts && found<replication; steps++)
+    {
+        row = &mod_state->table[p*mod_state->width];
+        for(j=0; j<mod_state->width && found<replication; j++)
+        {
+            if(row[j] == PARTITION_EMPTY)
+                continue;
+            for(i=0; i<found && server_idxs[i] != row[j]; i++);
+            if(i == found)
+                server_idxs[found++] = row[j];
+        }
+        p = (p + 1) & (mod_state->n_parts - 1);
+    }
+
+    /* fewer members than replicas */
+    for(; found<replication; found++)
+        server_idxs[found] = UINT64_MAX;
+
+    return;
+}
+
+static inline void partition_find_closest(struct partition_state *mod_state,
+    uint64_t obj, unsigned int replication, unsigned long *server_idxs)
+{
+    unsigned long p = obj >> (64 - mod_state->bits);
+    const uint32_t *row = &mod_state->table[p*mod_state->width];
+    unsigned int i;
+
+    if(replication <= mod_state->width && !mod_state->n_empty)
+    {
+        for(i=0; i<replication; i++)
+            server_idxs[i] = row[i];
+        return;
+    }
+
+    partition_find_closest_walk(mod_state, p, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_partition(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    partition_find_closest(mod->data, obj, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_partition(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct partition_state *mod_state = mod->data;
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        partition_find_closest(mod_state, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
+static inline int partition_row_has(struct partition_state *mod_state,
+    unsigned long p, uint32_t svr)
+{
+    const uint32_t *row = &mod_state->table[p*mod_state->width];
+    unsigned int j;
+
+    for(j=0; j<mod_state->width && row[j] != svr; j++);
+
+    return(j < mod_state->width);
+}
+
+/* puts svr in slot j of partition p, keeping the counts */
+static inline void partition_set_slot(struct partition_state *mod_state,
+    unsigned long p, unsigned int j, uint32_t svr)
+{
+    uint32_t *slot = &mod_state->table[p*mod_state->width + j];
+
+    if(*slot == PARTITION_EMPTY)
+        mod_state->n_empty--;
+    else
+        mod_state->counts[(unsigned long)*slot*mod_state->width + j]--;
+    if(svr == PARTITION_EMPTY)
+        mod_state->n_empty++;
+    else
+        mod_state->counts[(unsigned long)svr*mod_state->width + j]++;
+    *slot = svr;
+
+    return;
+}
+
+/* returns the member holding the fewest rank j slots that is not already
+ * in partition p's row, or PARTITION_EMPTY.  The scan starts at a point
+ * that depends on p, so that ties are spread over the servers.
+ */
+static uint32_t partition_pick(struct partition_state *mod_state,
+    unsigned long p, unsigned int j)
+{
+    unsigned long start = (p * 2654435761UL) % mod_state->n_slots;
+    unsigned long best_count = ~0UL;
+    unsigned long i, svr;
+    uint32_t best = PARTITION_EMPTY;
+
+    for(i=0; i<mod_state->n_slots; i++)
+    {
+        svr = start + i < mod_state->n_slots ? start + i :
+            start + i - mod_state->n_slots;
+        if(!mod_state->member[svr] ||
+            mod_state->counts[svr*mod_state->width + j] >= best_count ||
+            partition_row_has(mod_state, p, svr))
+            continue;
+        best = svr;
+        best_count = mod_state->counts[svr*mod_state->width + j];
+    }
+
+    return(best);
+}
+
+/* moves the row's servers ahead of its empty slots, so that the primary
+ * is only empty when the whole row is
+ */
+static void partition_compact_row(struct partition_state *mod_state,
+    unsigned long p)
+{
+    uint32_t *row = &mod_state->table[p*mod_state->width];
+    uint32_t svr;
+    unsigned int j, k;
+
+    for(j=0, k=0; j<mod_state->width; j++)
+    {
+        if(row[j] == PARTITION_EMPTY)
+            continue;
+        if(k != j)
+        {
+            svr = row[j];
+            partition_set_slot(mod_state, p, j, PARTITION_EMPTY);
+            partition_set_slot(mod_state, p, k, svr);
+        }
+        k++;
+    }
+
+    return;
+}
+
+/* records that the primary of partition p changed, extending the last arc
+ * when it covers the partition just before with the same servers
+ */
+static int partition_arc(struct partition_state *mod_state,
+    struct placement_arc_list *list, unsigned long p, uint32_t old_svr,
+    uint32_t new_svr)
+{
+    struct ch_placement_arc *last;
+    uint64_t start = (uint64_t)p << (64 - mod_state->bits);
+    uint64_t end = start + (UINT64_MAX >> mod_state->bits);
+
+    if(!list || old_svr == new_svr)
+        return(0);
+
+    if(list->n_arcs)
+    {
+        last = &list->arcs[list->n_arcs-1];
+        if(last->end + 1 == start && last->old_svr == old_svr &&
+            last->new_svr == new_svr)
+        {
+            last->end = end;
+            return(0);
+        }
+    }
+
+    return(placement_arc_append(list, start, end, 1, 0, old_svr, new_svr));
+}
+
+/* hands the arc list to the caller, or discards it */
+static void partition_return_arcs(struct placement_arc_list *list,
+    struct ch_placement_arc **arcs, unsigned long *n_arcs)
+{
+    if(arcs)
+    {
+        *arcs = list->arcs;
+        *n_arcs = list->n_arcs;
+    }
+    else
+        free(list->arcs);
+
+    return;
+}
+
+static int partition_save_undo(struct partition_state *mod_state,
+    struct partition_undo *undo)
+{
+    unsigned long n = mod_state->n_parts * mod_state->width;
+
+    undo->table = malloc(sizeof(*undo->table) * n);
+    undo->home = malloc(sizeof(*undo->home) * n);
+    undo->counts = malloc(sizeof(*undo->counts) * mod_state->n_slots *
+        mod_state->width);
+    if(!undo->table || !undo->home || !undo->counts)
+    {
+        free(undo->table);
+        free(undo->home);
+        free(undo->counts);
+        return(-1);
+    }
+
+    memcpy(undo->table, mod_state->table, sizeof(*undo->table) * n);
+    memcpy(undo->home, mod_state->home, sizeof(*undo->home) * n);
+    memcpy(undo->counts, mod_state->counts, sizeof(*undo->counts) *
+        mod_state->n_slots * mod_state->width);
+    undo->n_empty = mod_state->n_empty;
+    undo->n_svrs = mod_state->n_svrs;
+
+    return(0);
+}
+
+static void partition_drop_undo(struct partition_undo *undo)
+{
+    free(undo->table);
+    free(undo->home);
+    free(undo->counts);
+
+    return;
+}
+
+/* puts back what partition_save_undo() copied, and frees the copy */
+static void partition_undo(struct partition_state *mod_state,
+    struct partition_undo *undo)
+{
+    unsigned long n = mod_state->n_parts * mod_state->width;
+
+    memcpy(mod_state->table, undo->table, sizeof(*undo->table) * n);
+    memcpy(mod_state->home, undo->home, sizeof(*undo->home) * n);
+    memcpy(mod_state->counts, undo->counts, sizeof(*undo->counts) *
+        mod_state->n_slots * mod_state->width);
+    mod_state->n_empty = undo->n_empty;
+    mod_state->n_svrs = undo->n_svrs;
+    partition_drop_undo(undo);
+
+    return;
+}
+
+/* fills the empty slots of partition p with the least loaded members */
+static void partition_fill_row(struct partition_state *mod_state,
+    unsigned long p)
+{
+    unsigned int j;
+
+    for(j=0; j<mod_state->width; j++)
+        if(mod_state->table[p*mod_state->width + j] == PARTITION_EMPTY)
+            partition_set_slot(mod_state, p, j,
+                partition_pick(mod_state, p, j));
+    partition_compact_row(mod_state, p);
+
+    return;
+}
+
+/* a new server takes rank j slots from servers holding more than their
+ * share until it has its own.  The partitions are visited in an order
+ * that depends on the server, so that it takes them from all over the
+ * table.
+ */
+static int partition_take_share(struct partition_state *mod_state,
+    uint32_t svr, struct placement_arc_list *list)
+{
+    unsigned long mask = mod_state->n_parts - 1;
+    unsigned long share = mod_state->n_parts / mod_state->n_svrs;
+    unsigned long start, stride, i, p;
+    uint32_t h1 = 0;
+    uint32_t h2 = mod_state->seed;
+    uint32_t owner;
+    unsigned int j;
+
+    ch_bj_hashlittle2(&svr, sizeof(svr), &h1, &h2);
+    start = h1 & mask;
+    /* any odd stride visits every partition */
+    stride = (h2 | 1) & mask;
+
+    for(j=0; j<mod_state->width; j++)
+    {
+        for(i=0; i<mod_state->n_parts &&
+            mod_state->counts[(unsigned long)svr*mod_state->width + j] < share;
+            i++)
+        {
+            p = (start + i*stride) & mask;
+            owner = mod_state->table[p*mod_state->width + j];
+            if(owner == PARTITION_EMPTY ||
+                mod_state->counts[(unsigned long)owner*mod_state->width + j] <= share ||
+                partition_row_has(mod_state, p, svr))
+                continue;
+            partition_set_slot(mod_state, p, j, svr);
+            mod_state->home[p*mod_state->width + j] = svr;
+            if(j == 0 && partition_arc(mod_state, list, p, owner, svr) < 0)
+                return(-1);
+        }
+    }
+
+    return(0);
+}
+
+static int placement_add_server_partition(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct partition_state *mod_state = mod->data;
+    struct placement_arc_list list = {NULL, 0, 0};
+    struct placement_arc_list *lp = arcs ? &list : NULL;
+    struct partition_undo undo;
+    unsigned long width = mod_state->width;
+    unsigned long reclaimed = 0;
+    unsigned long p;
+    uint32_t old_primary;
+    unsigned int j;
+
+    if(svr_idx >= PARTITION_EMPTY ||
+        (svr_idx < mod_state->n_slots && mod_state->member[svr_idx]))
+        return(-1);
+
+    if(svr_idx >= mod_state->n_slots)
+    {
+        unsigned char *member = realloc(mod_state->member, svr_idx + 1);
+        unsigned long *counts;
+
+        if(!member)
+            return(-1);
+        mod_state->member = member;
+        counts = realloc(mod_state->counts,
+            sizeof(*counts) * (svr_idx + 1) * width);
+        if(!counts)
+            return(-1);
+        mod_state->counts = counts;
+        memset(&member[mod_state->n_slots], 0, svr_idx + 1 - mod_state->n_slots);
+        memset(&counts[mod_state->n_slots*width], 0,
+            sizeof(*counts) * (svr_idx + 1 - mod_state->n_slots) * width);
+        mod_state->n_slots = svr_idx + 1;
+    }
+
+    /* only recording the arcs can fail part way through */
+    if(arcs && partition_save_undo(mod_state, &undo) < 0)
+        return(-1);
+
+    mod_state->member[svr_idx] = 1;
+    mod_state->n_svrs++;
+
+    /* take back the slots the server held, and fill any empty ones */
+    for(p=0; p<mod_state->n_parts; p++)
+    {
+        old_primary = mod_state->table[p*width];
+        for(j=0; j<width; j++)
+        {
+            if(mod_state->home[p*width + j] == svr_idx &&
+                !partition_row_has(mod_state, p, svr_idx))
+            {
+                partition_set_slot(mod_state, p, j, svr_idx);
+                reclaimed++;
+            }
+        }
+        if(mod_state->n_empty)
+            partition_fill_row(mod_state, p);
+        if(partition_arc(mod_state, lp, p, old_primary,
+            mod_state->table[p*width]) < 0)
+            break;
+    }
+
+    if(p < mod_state->n_parts ||
+        (!reclaimed && partition_take_share(mod_state, svr_idx, lp) < 0))
+    {
+        partition_undo(mod_state, &undo);
+        mod_state->member[svr_idx] = 0;
+        free(list.arcs);
+        return(-1);
+    }
+
+    if(arcs)
+        partition_drop_undo(&undo);
+    partition_return_arcs(&list, arcs, n_arcs);
+
+    return(0);
+}
+
+static int placement_remove_server_partition(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct partition_state *mod_state = mod->data;
+    struct placement_arc_list list = {NULL, 0, 0};
+    struct partition_undo undo;
+    unsigned long width = mod_state->width;
+    unsigned long p;
+    uint32_t old_primary;
+    unsigned int j;
+    int changed;
+
+    if(mod_state->n_svrs < 2 || svr_idx >= mod_state->n_slots ||
+        !mod_state->member[svr_idx])
+        return(-1);
+
+    /* only recording the arcs can fail part way through */
+    if(arcs && partition_save_undo(mod_state, &undo) < 0)
+        return(-1);
+
+    mod_state->member[svr_idx] = 0;
+    mod_state->n_svrs--;
+
+    /* the slots keep svr_idx as their home, so that it can take them
+     * back
+     */
+    for(p=0; p<mod_state->n_parts; p++)
+    {
+        old_primary = mod_state->table[p*width];
+        changed = 0;
+        for(j=0; j<width; j++)
+        {
+            if(mod_state->table[p*width + j] == svr_idx)
+            {
+                partition_set_slot(mod_state, p, j, PARTITION_EMPTY);
+                changed = 1;
+            }
+        }
+        if(!changed)
+            continue;
+        partition_fill_row(mod_state, p);
+        if(arcs && partition_arc(mod_state, &list, p, old_primary,
+            mod_state->table[p*width]) < 0)
+        {
+            partition_undo(mod_state, &undo);
+            mod_state->member[svr_idx] = 1;
+            free(list.arcs);
+            return(-1);
+        }
+    }
+
+    if(arcs)
+        partition_drop_undo(&undo);
+    partition_return_arcs(&list, arcs, n_arcs);
+
+    return(0);
+}
+
+static void placement_finalize_partition(struct placement_mod *mod)
+{
+    struct partition_state *mod_state = mod->data;
+
+    if(!mod_state->mapped)
+        free(mod_state->table);
+    free(mod_state->home);
+    free(mod_state->counts);
+    free(mod_state->member);
+    free(mod_state);
+    free(mod);
+
+    return;
+}
+
+static int placement_get_stats_partition(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct partition_state *mod_state = mod->data;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->table_bytes = mod_state->n_parts * mod_state->width *
+        sizeof(*mod_state->table);
+    /* only needed for membership changes */
+    if(mod_state->home)
+        stats->index_bytes = mod_state->n_parts * mod_state->width *
+            sizeof(*mod_state->home) + mod_state->n_slots *
+            (mod_state->width * sizeof(*mod_state->counts) +
+            sizeof(*mod_state->member));
+
+    return(0);
+}
+
+static void placement_save_partition(struct placement_mod *mod,
+    struct placement_snapshot *snap)
+{
+    struct partition_state *mod_state = mod->data;
+    struct partition_snapshot header;
+
+    memset(&header, 0, sizeof(header));
+    header.n_svrs = mod_state->n_svrs;
+    header.width = mod_state->width;
+    header.bits = mod_state->bits;
+    header.n_empty = mod_state->n_empty;
+
+    placement_snapshot_write(snap, &header, sizeof(header));
+    placement_snapshot_write(snap, mod_state->table,
+        mod_state->n_parts * mod_state->width * sizeof(*mod_state->table));
+
+    return;
+}
+
+/* points a new instance at the table in a mapped snapshot.  The home
+ * slots and counts are not saved, so it cannot change membership.
+ */
+static struct placement_mod* placement_load_partition(
+    struct placement_snapshot *snap)
+{
+    const struct partition_snapshot *header;
+    struct placement_mod *mod_partition;
+    struct partition_state *mod_state;
+
+    header = placement_snapshot_read(snap, 1, sizeof(*header));
+    if(!header || header->n_svrs < 1 || header->width < 1 ||
+        header->width > PARTITION_REPLICAS_MAX || header->bits < 1 ||
+        header->bits > PARTITION_BITS_MAX)
+        return(NULL);
+
+    mod_partition = calloc(1, sizeof(*mod_partition));
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_partition || !mod_state)
+    {
+        free(mod_partition);
+        free(mod_state);
+        return(NULL);
+    }
+    mod_partition->data = mod_state;
+
+    mod_state->mapped = 1;
+    mod_state->n_svrs = header->n_svrs;
+    mod_state->width = header->width;
+    mod_state->bits = header->bits;
+    mod_state->n_parts = (unsigned long)1 << header->bits;
+    mod_state->n_empty = header->n_empty;
+    mod_state->table = (uint32_t*)placement_snapshot_read(snap,
+        mod_state->n_parts * mod_state->width, sizeof(*mod_state->table));
+    if(!mod_state->table)
+    {
+        free(mod_state);
+        free(mod_partition);
+        return(NULL);
+    }
+
+    mod_partition->find_closest = placement_find_closest_partition;
+    mod_partition->find_closest_batch = placement_find_closest_batch_partition;
+    mod_partition->create_striped = placement_create_striped_random;
+    mod_partition->finalize = placement_finalize_partition;
+    mod_partition->get_stats = placement_get_stats_partition;
+    mod_partition->save = placement_save_partition;
+
+    return(mod_partition);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
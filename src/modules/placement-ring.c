@@ -5,17 +5,45 @@
  */
 
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ch-placement.h"
 #include "src/modules/placement-mod.h"
+#include "src/modules/placement-search.h"
+#include "src/modules/placement-build.h"
+#include "src/modules/placement-snapshot.h"
 #include "src/lookup3.h"
 
 static struct placement_mod* placement_mod_ring(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_ring_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
+static struct placement_mod* placement_mod_ring_weighted(int n_svrs,
+    int virt_factor, int seed, const double *weights, const char* params);
 static void placement_find_closest_ring(struct placement_mod *mod, uint64_t obj, 
     unsigned int replication, unsigned long *server_idxs);
+static void placement_find_closest_batch_ring(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
 static void placement_finalize_ring(struct placement_mod *mod);
+static int placement_get_stats_ring(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+static int placement_add_server_ring(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static int placement_remove_server_ring(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static void placement_save_ring(struct placement_mod *mod,
+    struct placement_snapshot *snap);
+static int placement_set_load_ring(struct placement_mod *mod,
+    unsigned long svr_idx, unsigned long load);
+static int placement_get_load_ring(struct placement_mod *mod,
+    unsigned long svr_idx, unsigned long *load);
+static struct placement_mod* placement_load_ring(
+    struct placement_snapshot *snap);
 
 static int vnode_cmp(const void* a, const void *b);
 static int vnode_nearest_cmp(const void* a, const void *b);
@@ -24,33 +52,125 @@ struct placement_mod_map ring_mod_map =
 {
     .type = "ring",
     .initiate = placement_mod_ring,
+    .initiate_params = placement_mod_ring_params,
+    .initiate_weighted = placement_mod_ring_weighted,
+    .load = placement_load_ring,
 };
 
-struct ring_state;
-
+/* only used while building the ring */
 struct vnode
 {
     uint64_t svr_idx;
     uint64_t svr_id;
-    struct ring_state* mod_state;
-    unsigned long array_idx;
+};
+
+/* search key handed to bsearch(); carries the table bounds so that the
+ * comparison function can look at the neighboring vnode
+ */
+struct ring_key
+{
+    uint64_t obj;
+    const uint64_t *vnode_ids;
+    unsigned long n_vnodes;
+};
+
+/* upper limit on the size of the prefix index (4 bytes per bucket) */
+#define RING_PREFIX_BITS_MAX 28
+
+enum ring_layout
+{
+    RING_LAYOUT_SORTED = 0, /* binary search over the sorted ids */
+    RING_LAYOUT_EYTZINGER,  /* branch free search over a BFS ordered copy */
 };
 
 struct ring_state
 {
     unsigned int n_svrs;
+    unsigned int n_members; /* servers with vnodes; 0 on a loaded ring */
     unsigned int virt_factor;
-    struct vnode *virt_table;
+    int seed;
+    unsigned long n_vnodes;
+    enum ring_layout layout;
+    placement_search_fn search; /* NULL to use bsearch() on the sorted layout */
+    uint64_t *vnode_ids;   /* vnode ids, in ascending order */
+    uint32_t *vnode_svrs;  /* server index of each entry in vnode_ids */
+    uint64_t *eytz_ids;    /* vnode ids in eytzinger order (1-based) */
+    uint32_t *eytz_ranks;  /* position in vnode_ids of each eytz_ids entry */
+    int prefix_bits;       /* -1 to size automatically, 0 if disabled */
+    uint32_t *prefix_index; /* first vnode at or after each bucket start */
+    unsigned int succ_request; /* requested successor table width */
+    unsigned int succ_width; /* distinct servers per successor table row */
+    uint32_t *succ_table;  /* next succ_width distinct servers, per vnode */
+    enum placement_build build;
+    int build_threads;     /* 0 to use the OpenMP default */
+    double build_seconds;
+    double index_build_seconds;
+    int mapped;            /* tables point into a snapshot; don't free them */
+    double load_factor;    /* bounded loads capacity factor, 0 if disabled */
+    unsigned long *loads;  /* live load of each server index */
+    double *load_weights;  /* weight of each server index, 0 if not a member */
+    unsigned long n_loads; /* entries in loads and load_weights */
+    unsigned long total_load;
+    double total_weight;   /* sum of load_weights */
 };
 
+/* first section of a ring snapshot; the tables follow in the order
+ * vnode_ids, vnode_svrs, eytz_ids, eytz_ranks, prefix_index, succ_table,
+ * each present only if the ring has it
+ */
+struct ring_snapshot
+{
+    uint32_t n_svrs;
+    uint32_t virt_factor;
+    int32_t seed;
+    uint32_t layout;
+    uint64_t n_vnodes;
+    int32_t prefix_bits;
+    uint32_t succ_request;
+    uint32_t succ_width;
+    uint32_t search;       /* 0 if the ring used bsearch() */
+};
+
+static int ring_parse_param(void *state, const char *param);
+static int ring_init_loads(struct ring_state *mod_state,
+    const double *weights);
+static unsigned long ring_weighted_counts(unsigned int n_svrs,
+    unsigned int virt_factor, const double *weights, uint32_t *counts);
+static int ring_build_table_serial(struct ring_state *mod_state,
+    const uint32_t *counts, uint32_t max_count);
+static int ring_build_table_parallel(struct ring_state *mod_state,
+    const uint32_t *counts);
+static int ring_build_eytzinger(struct ring_state *mod_state);
+static int ring_build_prefix_index(struct ring_state *mod_state);
+static int ring_build_successor_table(struct ring_state *mod_state);
+static int ring_build_indexes(struct ring_state *mod_state);
+static void ring_free_indexes(struct ring_state *mod_state);
+
 struct placement_mod* placement_mod_ring(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_ring_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_ring_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
+{
+    return(placement_mod_ring_weighted(n_svrs, virt_factor, seed, NULL,
+        params));
+}
+
+/* weights may be NULL, in which case every server gets virt_factor vnodes */
+static struct placement_mod* placement_mod_ring_weighted(int n_svrs,
+    int virt_factor, int seed, const double *weights, const char* params)
 {
     struct placement_mod *mod_ring;
     struct ring_state *mod_state;
-    uint32_t h1, h2;
-    uint64_t i, j;
+    uint32_t *counts = NULL;
+    uint32_t max_count;
+    uint64_t i;
+    int ret;
+    double start;
 
-    mod_ring = malloc(sizeof(*mod_ring));
+    mod_ring = calloc(1, sizeof(*mod_ring));
     if(!mod_ring)
         return(NULL);
 
@@ -60,48 +180,818 @@ struct placement_mod* placement_mod_ring(int n_svrs, int virt_factor, int seed)
         free(mod_ring);
         return(NULL);
     }
+    memset(mod_state, 0, sizeof(*mod_state));
 
     mod_ring->data = mod_state;
 
-    mod_state->virt_table = malloc(sizeof(*mod_state->virt_table)*n_svrs*virt_factor);
-    if(!mod_state->virt_table)
+    mod_state->n_svrs = n_svrs;
+    mod_state->n_members = n_svrs;
+    mod_state->virt_factor = virt_factor;
+    mod_state->seed = seed;
+    mod_state->n_vnodes = (unsigned long)n_svrs*virt_factor;
+    mod_state->layout = RING_LAYOUT_SORTED;
+    mod_state->search = placement_search_select("auto");
+    max_count = virt_factor;
+
+    ret = placement_parse_params("ring", params, ring_parse_param,
+        mod_state);
+    if(ret < 0)
     {
         free(mod_state);
         free(mod_ring);
         return(NULL);
     }
+    /* lookups go through the prefix index when there is one, so an
+     * eytzinger copy would never be searched
+     */
+    if(mod_state->prefix_bits != 0)
+        mod_state->layout = RING_LAYOUT_SORTED;
 
-    mod_state->n_svrs = n_svrs;
-    mod_state->virt_factor = virt_factor;
+    if(weights)
+    {
+        counts = malloc(sizeof(*counts)*n_svrs);
+        if(counts)
+            mod_state->n_vnodes = ring_weighted_counts(n_svrs, virt_factor,
+                weights, counts);
+        if(!counts || mod_state->n_vnodes == 0)
+        {
+            free(counts);
+            free(mod_state);
+            free(mod_ring);
+            return(NULL);
+        }
+        /* servers with a weight of zero get no vnodes */
+        mod_state->n_members = 0;
+        for(i=0, max_count=0; i<(uint64_t)n_svrs; i++)
+        {
+            if(counts[i] > max_count)
+                max_count = counts[i];
+            if(counts[i] > 0)
+                mod_state->n_members++;
+        }
+    }
 
-    /* create virt_factor virtual nodes for each server index by jenkins
-     * hashing server index
+    mod_state->vnode_ids = malloc(sizeof(*mod_state->vnode_ids)*mod_state->n_vnodes);
+    mod_state->vnode_svrs = malloc(sizeof(*mod_state->vnode_svrs)*mod_state->n_vnodes);
+    if(!mod_state->vnode_ids || !mod_state->vnode_svrs)
+    {
+        free(counts);
+        free(mod_state->vnode_ids);
+        free(mod_state->vnode_svrs);
+        free(mod_state);
+        free(mod_ring);
+        return(NULL);
+    }
+
+    start = placement_wtime();
+
+    /* large tables are hashed by several threads and radix sorted; both
+     * paths give exactly the same table
      */
+    if(placement_build_parallel(mod_state->build, mod_state->n_vnodes))
+        ret = ring_build_table_parallel(mod_state, counts);
+    else
+        ret = ring_build_table_serial(mod_state, counts, max_count);
+    free(counts);
+    if(ret < 0)
+    {
+        placement_finalize_ring(mod_ring);
+        return(NULL);
+    }
+
+    mod_state->build_seconds = placement_wtime() - start;
+    start = placement_wtime();
+
+    ret = ring_build_indexes(mod_state);
+    if(ret < 0)
+    {
+        placement_finalize_ring(mod_ring);
+        return(NULL);
+    }
+
+    mod_state->index_build_seconds = placement_wtime() - start;
+
+    if(mod_state->load_factor > 0)
+    {
+        ret = ring_init_loads(mod_state, weights);
+        if(ret < 0)
+        {
+            placement_finalize_ring(mod_ring);
+            return(NULL);
+        }
+    }
+
+    mod_ring->find_closest = placement_find_closest_ring;
+    mod_ring->find_closest_batch = placement_find_closest_batch_ring;
+    mod_ring->create_striped = placement_create_striped_random;
+    mod_ring->finalize = placement_finalize_ring;
+    mod_ring->get_stats = placement_get_stats_ring;
+    mod_ring->add_server = placement_add_server_ring;
+    mod_ring->remove_server = placement_remove_server_ring;
+    if(mod_state->loads)
+    {
+        /* placement depends on the live loads, which are not saved */
+        mod_ring->set_load = placement_set_load_ring;
+        mod_ring->get_load = placement_get_load_ring;
+    }
+    else
+        mod_ring->save = placement_save_ring;
+
+    return(mod_ring);
+}
+
+/* recomputes total_weight, rather than adding and subtracting, so that
+ * membership changes don't accumulate rounding errors
+ */
+static void ring_sum_weights(struct ring_state *mod_state)
+{
+    unsigned long i;
+
+    mod_state->total_weight = 0;
+    for(i=0; i<mod_state->n_loads; i++)
+        mod_state->total_weight += mod_state->load_weights[i];
+
+    return;
+}
+
+/* sets up the loads and weights used for bounded loads.  Weights are
+ * scaled so that the average server has a weight of 1, which is also the
+ * weight of a server added later (it gets virt_factor vnodes).
+ */
+static int ring_init_loads(struct ring_state *mod_state,
+    const double *weights)
+{
+    unsigned int n_svrs = mod_state->n_svrs;
+    double total = 0;
+    unsigned int i;
+
+    mod_state->n_loads = n_svrs;
+    mod_state->loads = calloc(n_svrs, sizeof(*mod_state->loads));
+    mod_state->load_weights = malloc(sizeof(*mod_state->load_weights) *
+        n_svrs);
+    if(!mod_state->loads || !mod_state->load_weights)
+        return(-1);
+
+    if(weights)
+        for(i=0; i<n_svrs; i++)
+            total += weights[i];
+    for(i=0; i<n_svrs; i++)
+        mod_state->load_weights[i] = weights ?
+            weights[i] * n_svrs / total : 1;
+    ring_sum_weights(mod_state);
+
+    return(0);
+}
+
+/* fills in the number of vnodes for each server, in proportion to its
+ * weight so that a server of average weight gets virt_factor.  A server
+ * with a positive weight always gets at least one vnode; one with a weight
+ * of zero gets none.  Returns the total, or 0 if the weights are invalid.
+ */
+static unsigned long ring_weighted_counts(unsigned int n_svrs,
+    unsigned int virt_factor, const double *weights, uint32_t *counts)
+{
+    double total = 0;
+    double count;
+    unsigned long n_vnodes = 0;
+    unsigned int i;
+
     for(i=0; i<n_svrs; i++)
     {
-        for(j=0; j<virt_factor; j++)
+        if(!(weights[i] >= 0))
+            return(0);
+        total += weights[i];
+    }
+    if(!(total > 0))
+        return(0);
+
+    for(i=0; i<n_svrs; i++)
+    {
+        count = (double)virt_factor * n_svrs * (weights[i] / total) + 0.5;
+        if(count > UINT32_MAX)
+            return(0);
+        counts[i] = (uint32_t)count;
+        if(counts[i] == 0 && weights[i] > 0)
+            counts[i] = 1;
+        n_vnodes += counts[i];
+    }
+
+    return(n_vnodes);
+}
+
+/* fills in vnode_ids and vnode_svrs on one thread.  counts is NULL if the
+ * ring is not weighted.
+ */
+static int ring_build_table_serial(struct ring_state *mod_state,
+    const uint32_t *counts, uint32_t max_count)
+{
+    struct vnode *virt_table;
+    uint32_t h1, h2;
+    uint64_t i, j, k;
+
+    virt_table = malloc(sizeof(*virt_table)*mod_state->n_vnodes);
+    if(!virt_table)
+        return(-1);
+
+    /* create virt_factor virtual nodes (or counts[i] if weighted) for each
+     * server index by jenkins hashing server index.  Virtual node j of a
+     * server has the same id whatever the weights, so changing a weight
+     * only adds or drops that server's last vnodes.
+     */
+    k = 0;
+    for(j=0; j<max_count; j++)
+    {
+        for(i=0; i<mod_state->n_svrs; i++)
         {
+            if(counts && j >= counts[i])
+                continue;
             h1 = j;
-            h2 = seed;
+            h2 = mod_state->seed;
             ch_bj_hashlittle2(&i, sizeof(i), &h1, &h2);
-            mod_state->virt_table[j*n_svrs+i].svr_idx = i;
-            mod_state->virt_table[j*n_svrs+i].svr_id = h1 + (((uint64_t)h2)<<32);
+            virt_table[k].svr_idx = i;
+            virt_table[k].svr_id = h1 + (((uint64_t)h2)<<32);
+            k++;
         }
     }
 
-    qsort(mod_state->virt_table, n_svrs*virt_factor, sizeof(*mod_state->virt_table), vnode_cmp);
+    qsort(virt_table, mod_state->n_vnodes, sizeof(*virt_table), vnode_cmp);
 
-    for(i=0; i<n_svrs*virt_factor; i++)
+    /* split the sorted table into separate id and server arrays */
+    for(i=0; i<mod_state->n_vnodes; i++)
     {
-        mod_state->virt_table[i].array_idx = i;
-        mod_state->virt_table[i].mod_state = mod_state;
+        mod_state->vnode_ids[i] = virt_table[i].svr_id;
+        mod_state->vnode_svrs[i] = virt_table[i].svr_idx;
     }
+    free(virt_table);
 
-    mod_ring->find_closest = placement_find_closest_ring;
-    mod_ring->create_striped = placement_create_striped_random;
-    mod_ring->finalize = placement_finalize_ring;
+    return(0);
+}
 
-    return(mod_ring);
+/* same table as ring_build_table_serial(), hashed by several threads and
+ * radix sorted
+ */
+static int ring_build_table_parallel(struct ring_state *mod_state,
+    const uint32_t *counts)
+{
+    int threads = placement_build_threads(mod_state->build_threads);
+    int ret;
+
+    ret = placement_hash_vnodes(mod_state->vnode_ids, mod_state->vnode_svrs,
+        mod_state->n_svrs, mod_state->virt_factor, counts, mod_state->seed,
+        threads);
+    if(ret < 0)
+        return(-1);
+
+    return(placement_radix_sort(mod_state->vnode_ids, mod_state->vnode_svrs,
+        mod_state->n_vnodes, threads));
+}
+
+/* parameters are optional; expected in the format
+ * "layout:eytzinger,successors:3" or "prefix_bits:16,search:avx2".
+ * prefix_bits may also be "auto" to size the index from the number of
+ * vnodes; the prefix index replaces the eytzinger layout, so the latter is
+ * ignored when both are given.  successors is the number of distinct
+ * servers to precompute for each vnode.  search picks the kernel used on
+ * the sorted layout (see placement-search.h), or "bsearch".  build is "serial", "parallel" or
+ * "auto", and build_threads caps the threads used by a parallel build.
+ * bounded_load turns on consistent hashing with bounded loads, with the
+ * given capacity factor (see ch_placement_set_load()).
+ */
+static int ring_parse_param(void *state, const char *param)
+{
+    struct ring_state *mod_state = state;
+
+    if(strcmp(param, "layout:sorted") == 0)
+        mod_state->layout = RING_LAYOUT_SORTED;
+    else if(strcmp(param, "layout:eytzinger") == 0)
+        mod_state->layout = RING_LAYOUT_EYTZINGER;
+    else if(strcmp(param, "prefix_bits:auto") == 0)
+        mod_state->prefix_bits = -1;
+    else if(sscanf(param, "prefix_bits:%d", &mod_state->prefix_bits) == 1)
+    {
+        if(mod_state->prefix_bits < 0 ||
+            mod_state->prefix_bits > RING_PREFIX_BITS_MAX)
+        {
+            fprintf(stderr, "Error: prefix_bits must be between 0 and %d\n",
+                RING_PREFIX_BITS_MAX);
+            return(-1);
+        }
+    }
+    else if(strncmp(param, "search:", strlen("search:")) == 0)
+    {
+        if(placement_search_parse(param + strlen("search:"),
+            &mod_state->search) < 0)
+            return(-1);
+    }
+    else if(sscanf(param, "successors:%u", &mod_state->succ_request) == 1)
+    {
+        /* clamped to the number of servers when the table is built */
+    }
+    else if(strncmp(param, "build:", strlen("build:")) == 0)
+    {
+        if(placement_build_parse(param + strlen("build:"),
+            &mod_state->build) < 0)
+        {
+            fprintf(stderr, "Error: unknown build \"%s\"\n", param);
+            return(-1);
+        }
+    }
+    else if(sscanf(param, "build_threads:%d", &mod_state->build_threads) == 1)
+    {
+        /* 0 or less uses the OpenMP default */
+    }
+    else if(sscanf(param, "bounded_load:%lf", &mod_state->load_factor) == 1)
+    {
+        if(!(mod_state->load_factor >= 1))
+        {
+            fprintf(stderr, "Error: bounded_load must be at least 1\n");
+            return(-1);
+        }
+    }
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* recursively lays out the sorted ids in eytzinger (breadth first) order by
+ * doing an in-order walk of the implicit tree rooted at slot k
+ */
+static unsigned long ring_fill_eytzinger(struct ring_state *mod_state,
+    unsigned long sorted_idx, unsigned long k)
+{
+    if(k <= mod_state->n_vnodes)
+    {
+        sorted_idx = ring_fill_eytzinger(mod_state, sorted_idx, 2*k);
+        mod_state->eytz_ids[k] = mod_state->vnode_ids[sorted_idx];
+        mod_state->eytz_ranks[k] = sorted_idx;
+        sorted_idx++;
+        sorted_idx = ring_fill_eytzinger(mod_state, sorted_idx, 2*k+1);
+    }
+
+    return(sorted_idx);
+}
+
+static int ring_build_eytzinger(struct ring_state *mod_state)
+{
+    int ret;
+
+    /* align to a cache line so that the 8 descendants of slot k three
+     * levels down (slots 8k to 8k+7) always share a single line
+     */
+    ret = posix_memalign((void**)&mod_state->eytz_ids, 64,
+        sizeof(*mod_state->eytz_ids)*(mod_state->n_vnodes+1));
+    if(ret != 0)
+    {
+        mod_state->eytz_ids = NULL;
+        return(-1);
+    }
+    mod_state->eytz_ranks = malloc(sizeof(*mod_state->eytz_ranks)*(mod_state->n_vnodes+1));
+    if(!mod_state->eytz_ranks)
+        return(-1);
+
+    /* slot 0 is unused; the root of the implicit tree is slot 1 */
+    mod_state->eytz_ids[0] = 0;
+    mod_state->eytz_ranks[0] = 0;
+    ring_fill_eytzinger(mod_state, 0, 1);
+
+    return(0);
+}
+
+/* builds a table with one entry per value of the top prefix_bits bits of
+ * the id space, holding the position of the first vnode at or after the
+ * start of that bucket.  The extra final entry is n_vnodes.
+ */
+static int ring_build_prefix_index(struct ring_state *mod_state)
+{
+    unsigned long n_buckets;
+    unsigned long bucket;
+    unsigned long i = 0;
+
+    /* by default use roughly one bucket per vnode */
+    if(mod_state->prefix_bits < 0)
+    {
+        mod_state->prefix_bits = 1;
+        while(mod_state->prefix_bits < RING_PREFIX_BITS_MAX &&
+            ((unsigned long)1 << mod_state->prefix_bits) < mod_state->n_vnodes)
+            mod_state->prefix_bits++;
+    }
+
+    n_buckets = (unsigned long)1 << mod_state->prefix_bits;
+    mod_state->prefix_index = malloc(sizeof(*mod_state->prefix_index)*(n_buckets+1));
+    if(!mod_state->prefix_index)
+        return(-1);
+
+    for(bucket=0; bucket<n_buckets; bucket++)
+    {
+        while(i < mod_state->n_vnodes &&
+            (mod_state->vnode_ids[i] >> (64 - mod_state->prefix_bits)) < bucket)
+            i++;
+        mod_state->prefix_index[bucket] = i;
+    }
+    mod_state->prefix_index[n_buckets] = mod_state->n_vnodes;
+
+    return(0);
+}
+
+/* precomputes, for every vnode position, the first succ_width distinct
+ * servers found walking clockwise from it; this is exactly the replica set
+ * that the lookup walk would produce
+ */
+static int ring_build_successor_table(struct ring_state *mod_state)
+{
+    unsigned long pos, walk;
+    unsigned int found, j;
+    uint32_t *row;
+    uint32_t svr;
+
+    /* can't find more distinct servers than there are on the ring */
+    mod_state->succ_width = mod_state->succ_request;
+    if(mod_state->succ_width > mod_state->n_members)
+        mod_state->succ_width = mod_state->n_members;
+
+    mod_state->succ_table = malloc(sizeof(*mod_state->succ_table) *
+        mod_state->succ_width * mod_state->n_vnodes);
+    if(!mod_state->succ_table)
+        return(-1);
+
+    for(pos=0; pos<mod_state->n_vnodes; pos++)
+    {
+        row = &mod_state->succ_table[pos*mod_state->succ_width];
+        found = 0;
+        walk = pos;
+        while(found < mod_state->succ_width)
+        {
+            svr = mod_state->vnode_svrs[walk];
+            for(j=0; j<found && row[j] != svr; j++);
+            if(j == found)
+                row[found++] = svr;
+            walk++;
+            if(walk == mod_state->n_vnodes)
+                walk = 0;
+        }
+    }
+
+    return(0);
+}
+
+/* builds whichever optional lookup indexes were requested */
+static int ring_build_indexes(struct ring_state *mod_state)
+{
+    int ret;
+
+    if(mod_state->layout == RING_LAYOUT_EYTZINGER)
+    {
+        ret = ring_build_eytzinger(mod_state);
+        if(ret < 0)
+            return(-1);
+    }
+
+    if(mod_state->prefix_bits != 0)
+    {
+        ret = ring_build_prefix_index(mod_state);
+        if(ret < 0)
+            return(-1);
+    }
+
+    if(mod_state->succ_request > 0)
+    {
+        ret = ring_build_successor_table(mod_state);
+        if(ret < 0)
+            return(-1);
+    }
+
+    return(0);
+}
+
+static void ring_free_indexes(struct ring_state *mod_state)
+{
+    free(mod_state->eytz_ids);
+    free(mod_state->eytz_ranks);
+    free(mod_state->prefix_index);
+    free(mod_state->succ_table);
+    mod_state->eytz_ids = NULL;
+    mod_state->eytz_ranks = NULL;
+    mod_state->prefix_index = NULL;
+    mod_state->succ_table = NULL;
+    mod_state->succ_width = 0;
+
+    return;
+}
+
+/* sets up next as a copy of the ring with new vnode tables and builds its
+ * lookup indexes, without touching mod_state, so that a membership change
+ * that runs out of memory leaves the ring as it was.  On failure the
+ * caller still owns ids and svrs.
+ */
+static int ring_prepare(struct ring_state *mod_state, struct ring_state *next,
+    uint64_t *ids, uint32_t *svrs, unsigned long n_vnodes,
+    unsigned int n_members)
+{
+    int ret;
+
+    *next = *mod_state;
+    next->vnode_ids = ids;
+    next->vnode_svrs = svrs;
+    next->n_vnodes = n_vnodes;
+    next->n_members = n_members;
+    next->eytz_ids = NULL;
+    next->eytz_ranks = NULL;
+    next->prefix_index = NULL;
+    next->succ_table = NULL;
+
+    ret = ring_build_indexes(next);
+    if(ret < 0)
+    {
+        ring_free_indexes(next);
+        return(-1);
+    }
+
+    return(0);
+}
+
+/* replaces the ring's tables and indexes with the ones built by
+ * ring_prepare()
+ */
+static void ring_commit(struct ring_state *mod_state, struct ring_state *next)
+{
+    free(mod_state->vnode_ids);
+    free(mod_state->vnode_svrs);
+    ring_free_indexes(mod_state);
+    *mod_state = *next;
+
+    return;
+}
+
+static int ring_is_member(struct ring_state *mod_state, unsigned long svr_idx)
+{
+    unsigned long i;
+
+    for(i=0; i<mod_state->n_vnodes; i++)
+        if(mod_state->vnode_svrs[i] == svr_idx)
+            return(1);
+
+    return(0);
+}
+
+/* records the arcs owned by svr_idx's vnodes.  Each maximal run of its
+ * vnodes owns the oids from the first id in the run up to the next id on
+ * the ring, and that range belongs to the server just before the run
+ * whenever svr_idx is not a member.
+ */
+static int ring_collect_arcs(struct ring_state *mod_state,
+    unsigned long svr_idx, int adding, struct placement_arc_list *list)
+{
+    unsigned long n = mod_state->n_vnodes;
+    unsigned long first, i, pos, next;
+    unsigned long other;
+    uint64_t start, end;
+    int ret;
+
+    /* start the walk just after a vnode of some other server, so that no
+     * run of svr_idx's vnodes is split by the wrap around
+     */
+    for(first=0; mod_state->vnode_svrs[first] == svr_idx; first++);
+
+    for(i=1; i<=n; i++)
+    {
+        pos = (first + i) % n;
+        if(mod_state->vnode_svrs[pos] != svr_idx)
+            continue;
+
+        other = mod_state->vnode_svrs[(pos + n - 1) % n];
+        start = mod_state->vnode_ids[pos];
+        while(mod_state->vnode_svrs[(first + i + 1) % n] == svr_idx)
+            i++;
+        next = (first + i + 1) % n;
+        /* a run sharing its id with the next vnode owns nothing */
+        if(mod_state->vnode_ids[next] == start)
+            continue;
+        end = mod_state->vnode_ids[next] - 1;
+
+        if(adding)
+            ret = placement_arc_append(list, start, end, 1, 0, other, svr_idx);
+        else
+            ret = placement_arc_append(list, start, end, 1, 0, svr_idx, other);
+        if(ret < 0)
+            return(-1);
+    }
+
+    return(0);
+}
+
+/* hands the arc list to the caller, or discards it */
+static void ring_return_arcs(struct placement_arc_list *list,
+    struct ch_placement_arc **arcs, unsigned long *n_arcs)
+{
+    if(arcs)
+    {
+        *arcs = list->arcs;
+        *n_arcs = list->n_arcs;
+    }
+    else
+        free(list->arcs);
+
+    return;
+}
+
+static int id_cmp(const void* a, const void *b)
+{
+    const uint64_t *id_a = a;
+    const uint64_t *id_b = b;
+
+    if(*id_a < *id_b)
+        return(-1);
+    else if(*id_a > *id_b)
+        return(1);
+    else
+        return(0);
+}
+
+static int placement_add_server_ring(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct ring_state *mod_state = mod->data;
+    struct placement_arc_list list = {NULL, 0, 0};
+    struct ring_state next;
+    uint64_t *new_ids;
+    uint64_t *ids;
+    uint32_t *svrs;
+    uint64_t idx = svr_idx;
+    unsigned long n = mod_state->n_vnodes + mod_state->virt_factor;
+    unsigned long i, j, k;
+    uint32_t h1, h2;
+    int ret;
+
+    if(svr_idx > UINT32_MAX || ring_is_member(mod_state, svr_idx))
+        return(-1);
+
+    if(mod_state->loads && svr_idx >= mod_state->n_loads)
+    {
+        unsigned long *loads;
+        double *load_weights;
+
+        loads = realloc(mod_state->loads, sizeof(*loads) * (svr_idx + 1));
+        if(!loads)
+            return(-1);
+        mod_state->loads = loads;
+        load_weights = realloc(mod_state->load_weights,
+            sizeof(*load_weights) * (svr_idx + 1));
+        if(!load_weights)
+            return(-1);
+        mod_state->load_weights = load_weights;
+        memset(&loads[mod_state->n_loads], 0,
+            sizeof(*loads) * (svr_idx + 1 - mod_state->n_loads));
+        memset(&load_weights[mod_state->n_loads], 0,
+            sizeof(*load_weights) * (svr_idx + 1 - mod_state->n_loads));
+        mod_state->n_loads = svr_idx + 1;
+    }
+
+    /* hash the new server's vnodes the same way the constructor does */
+    new_ids = malloc(sizeof(*new_ids)*mod_state->virt_factor);
+    if(!new_ids)
+        return(-1);
+    for(j=0; j<mod_state->virt_factor; j++)
+    {
+        h1 = j;
+        h2 = mod_state->seed;
+        ch_bj_hashlittle2(&idx, sizeof(idx), &h1, &h2);
+        new_ids[j] = h1 + (((uint64_t)h2)<<32);
+    }
+    qsort(new_ids, mod_state->virt_factor, sizeof(*new_ids), id_cmp);
+
+    ids = malloc(sizeof(*ids) * n);
+    svrs = malloc(sizeof(*svrs) * n);
+    if(!ids || !svrs)
+    {
+        free(new_ids);
+        free(ids);
+        free(svrs);
+        return(-1);
+    }
+
+    /* merge the current table with the new server's sorted run */
+    i = 0;
+    j = 0;
+    for(k=0; k<n; k++)
+    {
+        if(j == mod_state->virt_factor || (i < mod_state->n_vnodes &&
+            (mod_state->vnode_ids[i] < new_ids[j] ||
+            (mod_state->vnode_ids[i] == new_ids[j] &&
+            mod_state->vnode_svrs[i] < svr_idx))))
+        {
+            ids[k] = mod_state->vnode_ids[i];
+            svrs[k] = mod_state->vnode_svrs[i];
+            i++;
+        }
+        else
+        {
+            ids[k] = new_ids[j];
+            svrs[k] = svr_idx;
+            j++;
+        }
+    }
+    free(new_ids);
+
+    ret = ring_prepare(mod_state, &next, ids, svrs, n,
+        mod_state->n_members + 1);
+    if(ret == 0)
+    {
+        ret = ring_collect_arcs(&next, svr_idx, 1, &list);
+        if(ret < 0)
+        {
+            free(list.arcs);
+            ring_free_indexes(&next);
+        }
+    }
+    if(ret < 0)
+    {
+        free(ids);
+        free(svrs);
+        return(-1);
+    }
+
+    ring_commit(mod_state, &next);
+    mod_state->n_svrs++;
+    if(mod_state->loads)
+    {
+        mod_state->load_weights[svr_idx] = 1;
+        ring_sum_weights(mod_state);
+    }
+    ring_return_arcs(&list, arcs, n_arcs);
+
+    return(0);
+}
+
+static int placement_remove_server_ring(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct ring_state *mod_state = mod->data;
+    struct placement_arc_list list = {NULL, 0, 0};
+    struct ring_state next;
+    uint64_t *ids;
+    uint32_t *svrs;
+    unsigned long n = 0;
+    unsigned long i, k;
+    int ret;
+
+    if(mod_state->n_members < 2 || !ring_is_member(mod_state, svr_idx))
+        return(-1);
+
+    /* the arcs have to be found while the vnodes are still on the ring */
+    ret = ring_collect_arcs(mod_state, svr_idx, 0, &list);
+    if(ret < 0)
+    {
+        free(list.arcs);
+        return(-1);
+    }
+
+    for(i=0; i<mod_state->n_vnodes; i++)
+        if(mod_state->vnode_svrs[i] != svr_idx)
+            n++;
+    ids = malloc(sizeof(*ids) * n);
+    svrs = malloc(sizeof(*svrs) * n);
+    if(!ids || !svrs)
+    {
+        free(ids);
+        free(svrs);
+        free(list.arcs);
+        return(-1);
+    }
+
+    for(i=0, k=0; i<mod_state->n_vnodes; i++)
+    {
+        if(mod_state->vnode_svrs[i] == svr_idx)
+            continue;
+        ids[k] = mod_state->vnode_ids[i];
+        svrs[k] = mod_state->vnode_svrs[i];
+        k++;
+    }
+
+    ret = ring_prepare(mod_state, &next, ids, svrs, n,
+        mod_state->n_members - 1);
+    if(ret < 0)
+    {
+        free(ids);
+        free(svrs);
+        free(list.arcs);
+        return(-1);
+    }
+
+    ring_commit(mod_state, &next);
+    mod_state->n_svrs--;
+    if(mod_state->loads)
+    {
+        mod_state->total_load -= mod_state->loads[svr_idx];
+        mod_state->loads[svr_idx] = 0;
+        mod_state->load_weights[svr_idx] = 0;
+        ring_sum_weights(mod_state);
+    }
+    ring_return_arcs(&list, arcs, n_arcs);
+
+    return(0);
 }
 
 static int vnode_cmp(const void* a, const void *b)
@@ -109,79 +999,257 @@ static int vnode_cmp(const void* a, const void *b)
     const struct vnode *v_a = a;
     const struct vnode *v_b = b;
 
+    /* equal ids are ordered by server, so that the order does not depend
+     * on the sort algorithm
+     */
     if(v_a->svr_id < v_b->svr_id)
         return(-1);
     else if(v_a->svr_id > v_b->svr_id)
         return(1);
+    else if(v_a->svr_idx < v_b->svr_idx)
+        return(-1);
+    else if(v_a->svr_idx > v_b->svr_idx)
+        return(1);
     else
         return(0);
 }
 
-static void placement_find_closest_ring(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
-    unsigned long* server_idxs)
+/* returns the position in vnode_ids of the vnode with the greatest id that
+ * is less than or equal to the oid, using the eytzinger copy of the table
+ */
+static inline unsigned long ring_search_eytzinger(struct ring_state *mod_state,
+    uint64_t obj)
 {
-    struct ring_state *mod_state = mod->data;
-    struct vnode* svr;
-    int current_index;
-    int dup;
-    int i,j;
+    const uint64_t *eytz_ids = mod_state->eytz_ids;
+    unsigned long n = mod_state->n_vnodes;
+    unsigned long k = 1;
+
+    /* descend without branching on the comparison; each level moves to
+     * the right child if the oid is at or past the current id
+     */
+    while(k <= n)
+    {
+        __builtin_prefetch(&eytz_ids[8*k]);
+        k = 2*k + (eytz_ids[k] <= obj);
+    }
+    /* strip the trailing right turns (and the final left turn) to recover
+     * the last node where we went left; that is the first id > oid
+     */
+    k >>= __builtin_ffsl(~k);
+
+    /* no id greater than the oid: belongs to the last vnode */
+    if(k == 0)
+        return(n-1);
+    /* first id is already greater than the oid: wrap around */
+    if(mod_state->eytz_ranks[k] == 0)
+        return(n-1);
+    return(mod_state->eytz_ranks[k] - 1);
+}
+
+/* same as ring_search_eytzinger(), but using the prefix index to narrow
+ * the search to the vnodes in the oid's bucket, which are then scanned
+ */
+static inline unsigned long ring_search_prefix(struct ring_state *mod_state,
+    uint64_t obj)
+{
+    uint64_t bucket = obj >> (64 - mod_state->prefix_bits);
+    unsigned long i = mod_state->prefix_index[bucket];
+    unsigned long end = mod_state->prefix_index[bucket+1];
+
+    /* every id before the bucket is <= oid and every id after it is > oid,
+     * so the first id > oid is within [i, end]
+     */
+    while(i < end && mod_state->vnode_ids[i] <= obj)
+        i++;
+
+    if(i == 0)
+        return(mod_state->n_vnodes-1);
+    return(i-1);
+}
+
+/* same as ring_search_eytzinger(), but using the selected search kernel
+ * (or bsearch()) over vnode_ids
+ */
+static inline unsigned long ring_search_sorted(struct ring_state *mod_state,
+    uint64_t obj)
+{
+    struct ring_key key;
+    const uint64_t *svr;
+    unsigned long upper;
+
+    if(mod_state->search)
+    {
+        upper = mod_state->search(mod_state->vnode_ids, mod_state->n_vnodes,
+            obj);
+        /* no id <= oid: wrap around to the last vnode */
+        if(upper == 0)
+            return(mod_state->n_vnodes-1);
+        return(upper-1);
+    }
+
+    key.obj = obj;
+    key.vnode_ids = mod_state->vnode_ids;
+    key.n_vnodes = mod_state->n_vnodes;
 
     /* binary search through ring to find the server with the greatest virtual ID less than 
      * the oid 
      */
-    svr = bsearch(&obj, mod_state->virt_table, mod_state->n_svrs*mod_state->virt_factor, 
-        sizeof(*mod_state->virt_table), vnode_nearest_cmp);
+    svr = bsearch(&key, mod_state->vnode_ids, mod_state->n_vnodes,
+        sizeof(*mod_state->vnode_ids), vnode_nearest_cmp);
 
     /* if bsearch didn't find a match, then the object belongs to the last
      * server partition
      */
     if(!svr)
-        svr = &mod_state->virt_table[(mod_state->n_svrs*mod_state->virt_factor)-1];
+        return(mod_state->n_vnodes-1);
+    return(svr - mod_state->vnode_ids);
+}
 
-    /* walk through ring, clockwise, to find N closest servers. */
-    current_index = svr->array_idx;
-    for(i=0; i<replication; i++)
+/* returns the position of the vnode that owns the oid, using whichever
+ * index the ring has
+ */
+static inline unsigned long ring_search(struct ring_state *mod_state,
+    uint64_t obj)
+{
+    if(mod_state->prefix_index)
+        return(ring_search_prefix(mod_state, obj));
+    else if(mod_state->layout == RING_LAYOUT_EYTZINGER)
+        return(ring_search_eytzinger(mod_state, obj));
+    else
+        return(ring_search_sorted(mod_state, obj));
+}
+
+/* consistent hashing with bounded loads: walks clockwise from the owning
+ * vnode like ring_find_closest(), but skips servers whose load has reached
+ * their capacity, load_factor times their weighted share of the total load
+ * (counting the object being placed) rounded up.  If fewer servers than
+ * replicas are below their capacity, the rest are the closest of the
+ * others.
+ */
+static void ring_find_closest_bounded(struct ring_state *mod_state,
+    uint64_t obj, unsigned int replication, unsigned long* server_idxs)
+{
+    unsigned long n = mod_state->n_vnodes;
+    unsigned long start = ring_search(mod_state, obj);
+    double scale;
+    unsigned long pos, steps, svr;
+    unsigned int found = 0;
+    unsigned int i;
+    int bounded;
+
+    /* a server's capacity is its weight times this, rounded up */
+    scale = mod_state->load_factor * (mod_state->total_load + 1) /
+        mod_state->total_weight;
+
+    for(bounded=1; bounded>=0 && found<replication; bounded--)
     {
-        if(current_index == mod_state->n_svrs*mod_state->virt_factor)
-            current_index = 0;
-        /* we have to skip duplicates */
-        do
+        for(steps=0, pos=start; steps<n && found<replication; steps++)
         {
-            dup = 0;
-            for(j=0; j<i; j++)
-            {
-                if(mod_state->virt_table[current_index].svr_idx == server_idxs[j])
-                {
-                    dup = 1;
-                    current_index++;
-                    if(current_index == mod_state->n_svrs*mod_state->virt_factor)
-                        current_index = 0;
-                    break;
-                }
-            }
-        }while(dup);
-
-        server_idxs[i] = mod_state->virt_table[current_index].svr_idx;
-        current_index++;
+            svr = mod_state->vnode_svrs[pos];
+            if(++pos == n)
+                pos = 0;
+            if(bounded && mod_state->loads[svr] >=
+                ceil(scale * mod_state->load_weights[svr]))
+                continue;
+            for(i=0; i<found && server_idxs[i] != svr; i++);
+            if(i == found)
+                server_idxs[found++] = svr;
+        }
     }
 
+    /* fewer members than replicas */
+    for(; found<replication; found++)
+        server_idxs[found] = UINT64_MAX;
+
+    return;
+}
+
+static inline void ring_find_closest(struct ring_state *mod_state, uint64_t obj,
+    unsigned int replication, unsigned long* server_idxs)
+{
+    unsigned long n = mod_state->n_vnodes;
+    unsigned long current_index, steps;
+    uint32_t svr;
+    unsigned int i, j;
+
+    if(mod_state->loads)
+    {
+        ring_find_closest_bounded(mod_state, obj, replication, server_idxs);
+        return;
+    }
+
+    current_index = ring_search(mod_state, obj);
+
+    /* use the precomputed replica set if it is wide enough */
+    if(replication <= mod_state->succ_width)
+    {
+        const uint32_t *row = &mod_state->succ_table[current_index*mod_state->succ_width];
+
+        for(i=0; i<replication; i++)
+            server_idxs[i] = row[i];
+        return;
+    }
+
+    /* walk through ring, clockwise, to find N closest servers, skipping
+     * duplicates.  One lap visits every server on the ring.
+     */
+    for(i=0, steps=0; i<replication && steps<n; steps++)
+    {
+        svr = mod_state->vnode_svrs[current_index];
+        if(++current_index == n)
+            current_index = 0;
+        for(j=0; j<i && server_idxs[j] != svr; j++);
+        if(j == i)
+            server_idxs[i++] = svr;
+    }
+
+    /* fewer servers on the ring than replicas */
+    for(; i<replication; i++)
+        server_idxs[i] = UINT64_MAX;
+
+    return;
+}
+
+static void placement_find_closest_ring(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
+    unsigned long* server_idxs)
+{
+    ring_find_closest(mod->data, obj, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_ring(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct ring_state *mod_state = mod->data;
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        ring_find_closest(mod_state, objs[i], replication,
+            &server_idxs[i*replication]);
+
     return;
 }
 
 static int vnode_nearest_cmp(const void* key, const void *member)
 {
-    const uint64_t* obj = key;
-    const struct vnode *svr = member;
+    const struct ring_key* ring_key = key;
+    const uint64_t *svr_id = member;
+    unsigned long array_idx = svr_id - ring_key->vnode_ids;
 
-    if(*obj < svr->svr_id)
+    if(ring_key->obj < *svr_id)
         return(-1);
-    if(*obj > svr->svr_id)
+    if(ring_key->obj > *svr_id)
     {
         /* are we on the last server already? */
-        if(svr->array_idx == (svr->mod_state->n_svrs*svr->mod_state->virt_factor-1))
+        if(array_idx == (ring_key->n_vnodes-1))
             return(0);
-        /* is the oid also larger than the next server's id? */
-        if(svr->mod_state->virt_table[svr->array_idx+1].svr_id < *obj)
+        /* is the oid also at or past the next server's id?  (matching the
+         * next id exactly belongs to the next server, so that exactly one
+         * entry compares equal)
+         */
+        if(ring_key->vnode_ids[array_idx+1] <= ring_key->obj)
             return(1);
     }
 
@@ -193,13 +1261,195 @@ static void placement_finalize_ring(struct placement_mod *mod)
 {
     struct ring_state *mod_state = mod->data;
 
-    free(mod_state->virt_table);
+    if(!mod_state->mapped)
+    {
+        free(mod_state->vnode_ids);
+        free(mod_state->vnode_svrs);
+        ring_free_indexes(mod_state);
+    }
+    free(mod_state->loads);
+    free(mod_state->load_weights);
     free(mod_state);
     free(mod);
 
     return;
 }
 
+static int placement_get_stats_ring(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct ring_state *mod_state = mod->data;
+
+    stats->table_bytes = mod_state->n_vnodes *
+        (sizeof(*mod_state->vnode_ids) + sizeof(*mod_state->vnode_svrs));
+    stats->index_bytes = 0;
+    if(mod_state->eytz_ids)
+        stats->index_bytes += (mod_state->n_vnodes+1) *
+            (sizeof(*mod_state->eytz_ids) + sizeof(*mod_state->eytz_ranks));
+    if(mod_state->prefix_index)
+        stats->index_bytes += (((unsigned long)1 << mod_state->prefix_bits) + 1) *
+            sizeof(*mod_state->prefix_index);
+    if(mod_state->succ_table)
+        stats->index_bytes += mod_state->n_vnodes * mod_state->succ_width *
+            sizeof(*mod_state->succ_table);
+    stats->index_bytes += mod_state->n_loads *
+        (sizeof(*mod_state->loads) + sizeof(*mod_state->load_weights));
+    stats->build_seconds = mod_state->build_seconds;
+    stats->index_build_seconds = mod_state->index_build_seconds;
+
+    return(0);
+}
+
+static int placement_set_load_ring(struct placement_mod *mod,
+    unsigned long svr_idx, unsigned long load)
+{
+    struct ring_state *mod_state = mod->data;
+
+    /* only servers on the ring count towards the capacities */
+    if(svr_idx >= mod_state->n_loads || mod_state->load_weights[svr_idx] == 0)
+        return(-1);
+
+    mod_state->total_load -= mod_state->loads[svr_idx];
+    mod_state->loads[svr_idx] = load;
+    mod_state->total_load += load;
+
+    return(0);
+}
+
+static int placement_get_load_ring(struct placement_mod *mod,
+    unsigned long svr_idx, unsigned long *load)
+{
+    struct ring_state *mod_state = mod->data;
+
+    if(svr_idx >= mod_state->n_loads)
+        return(-1);
+
+    *load = mod_state->loads[svr_idx];
+
+    return(0);
+}
+
+static void placement_save_ring(struct placement_mod *mod,
+    struct placement_snapshot *snap)
+{
+    struct ring_state *mod_state = mod->data;
+    struct ring_snapshot header;
+    unsigned long n = mod_state->n_vnodes;
+
+    memset(&header, 0, sizeof(header));
+    header.n_svrs = mod_state->n_svrs;
+    header.virt_factor = mod_state->virt_factor;
+    header.seed = mod_state->seed;
+    header.layout = mod_state->layout;
+    header.n_vnodes = n;
+    header.prefix_bits = mod_state->prefix_index ? mod_state->prefix_bits : 0;
+    header.succ_request = mod_state->succ_request;
+    header.succ_width = mod_state->succ_table ? mod_state->succ_width : 0;
+    header.search = (mod_state->search != NULL);
+
+    placement_snapshot_write(snap, &header, sizeof(header));
+    placement_snapshot_write(snap, mod_state->vnode_ids,
+        n * sizeof(*mod_state->vnode_ids));
+    placement_snapshot_write(snap, mod_state->vnode_svrs,
+        n * sizeof(*mod_state->vnode_svrs));
+    if(mod_state->eytz_ids)
+    {
+        placement_snapshot_write(snap, mod_state->eytz_ids,
+            (n+1) * sizeof(*mod_state->eytz_ids));
+        placement_snapshot_write(snap, mod_state->eytz_ranks,
+            (n+1) * sizeof(*mod_state->eytz_ranks));
+    }
+    if(header.prefix_bits)
+        placement_snapshot_write(snap, mod_state->prefix_index,
+            (((unsigned long)1 << header.prefix_bits) + 1) *
+            sizeof(*mod_state->prefix_index));
+    if(header.succ_width)
+        placement_snapshot_write(snap, mod_state->succ_table,
+            n * header.succ_width * sizeof(*mod_state->succ_table));
+
+    return;
+}
+
+/* points a new ring at the tables in a mapped snapshot; nothing is copied,
+ * hashed or sorted
+ */
+static struct placement_mod* placement_load_ring(
+    struct placement_snapshot *snap)
+{
+    const struct ring_snapshot *header;
+    struct placement_mod *mod_ring;
+    struct ring_state *mod_state;
+    unsigned long n;
+    double start = placement_wtime();
+
+    header = placement_snapshot_read(snap, 1, sizeof(*header));
+    if(!header || header->n_vnodes == 0 ||
+        header->layout > RING_LAYOUT_EYTZINGER ||
+        header->prefix_bits < 0 || header->prefix_bits > RING_PREFIX_BITS_MAX ||
+        header->succ_width > header->n_svrs)
+        return(NULL);
+    n = header->n_vnodes;
+
+    mod_ring = calloc(1, sizeof(*mod_ring));
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_ring || !mod_state)
+    {
+        free(mod_ring);
+        free(mod_state);
+        return(NULL);
+    }
+    mod_ring->data = mod_state;
+
+    mod_state->mapped = 1;
+    mod_state->n_svrs = header->n_svrs;
+    mod_state->virt_factor = header->virt_factor;
+    mod_state->seed = header->seed;
+    mod_state->layout = header->layout;
+    mod_state->n_vnodes = n;
+    mod_state->prefix_bits = header->prefix_bits;
+    mod_state->succ_request = header->succ_request;
+    mod_state->succ_width = header->succ_width;
+    /* the kernel itself depends on the cpu loading the snapshot */
+    mod_state->search = header->search ? placement_search_select("auto") : NULL;
+
+    mod_state->vnode_ids = (uint64_t*)placement_snapshot_read(snap, n,
+        sizeof(*mod_state->vnode_ids));
+    mod_state->vnode_svrs = (uint32_t*)placement_snapshot_read(snap, n,
+        sizeof(*mod_state->vnode_svrs));
+    if(mod_state->layout == RING_LAYOUT_EYTZINGER)
+    {
+        mod_state->eytz_ids = (uint64_t*)placement_snapshot_read(snap, n+1,
+            sizeof(*mod_state->eytz_ids));
+        mod_state->eytz_ranks = (uint32_t*)placement_snapshot_read(snap, n+1,
+            sizeof(*mod_state->eytz_ranks));
+    }
+    if(mod_state->prefix_bits)
+        mod_state->prefix_index = (uint32_t*)placement_snapshot_read(snap,
+            ((unsigned long)1 << mod_state->prefix_bits) + 1,
+            sizeof(*mod_state->prefix_index));
+    if(mod_state->succ_width)
+        mod_state->succ_table = (uint32_t*)placement_snapshot_read(snap,
+            n * mod_state->succ_width, sizeof(*mod_state->succ_table));
+    if(snap->error)
+    {
+        free(mod_state);
+        free(mod_ring);
+        return(NULL);
+    }
+
+    mod_state->build_seconds = placement_wtime() - start;
+
+    /* the mapping is read-only, so membership changes are not offered */
+    mod_ring->find_closest = placement_find_closest_ring;
+    mod_ring->find_closest_batch = placement_find_closest_batch_ring;
+    mod_ring->create_striped = placement_create_striped_random;
+    mod_ring->finalize = placement_finalize_ring;
+    mod_ring->get_stats = placement_get_stats_ring;
+    mod_ring->save = placement_save_ring;
+
+    return(mod_ring);
+}
+
 /*
  * Local variables:
  *  c-indent-level: 4
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "src/modules/placement-search.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PLACEMENT_SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+/* the vector kernels finish by comparing the oid against a whole window of
+ * this many ids at once rather than continuing to halve the range
+ */
+#define PLACEMENT_SEARCH_WINDOW 16
+
+/* halves the range with conditional moves instead of branches until at most
+ * "window" candidates are left.  On return every id before *base is <= key
+ * and every id at or after *base+*len is > key.
+ */
+static inline void search_narrow(const uint64_t **base, unsigned long *len,
+    uint64_t key, unsigned long window)
+{
+    const uint64_t *b = *base;
+    unsigned long l = *len;
+    unsigned long half;
+
+    while(l > window)
+    {
+        half = l / 2;
+        /* fetch both possible midpoints of the next step while this
+         * comparison resolves
+         */
+        __builtin_prefetch(&b[half/2]);
+        __builtin_prefetch(&b[half + half/2]);
+        b = (b[half] <= key) ? b + half : b;
+        l -= half;
+    }
+
+    *base = b;
+    *len = l;
+    return;
+}
+
+/* picks a window of PLACEMENT_SEARCH_WINDOW ids that covers [base, base+len]
+ * without running off the end of the array
+ */
+static inline const uint64_t* search_window(const uint64_t *keys,
+    unsigned long n, const uint64_t *base)
+{
+    if(base + PLACEMENT_SEARCH_WINDOW > keys + n)
+        return(keys + n - PLACEMENT_SEARCH_WINDOW);
+    return(base);
+}
+
+static unsigned long search_scalar(const uint64_t *keys, unsigned long n,
+    uint64_t key)
+{
+    const uint64_t *base = keys;
+    unsigned long len = n;
+
+    if(n == 0)
+        return(0);
+
+    search_narrow(&base, &len, key, 1);
+
+    return((base - keys) + (*base <= key));
+}
+
+#ifdef PLACEMENT_SEARCH_X86
+__attribute__((target("avx2")))
+static unsigned long search_avx2(const uint64_t *keys, unsigned long n,
+    uint64_t key)
+{
+    const uint64_t *base = keys;
+    unsigned long len = n;
+    __m256i sign, k, v;
+    int gt = 0;
+    int i;
+
+    if(n < PLACEMENT_SEARCH_WINDOW)
+        return(search_scalar(keys, n, key));
+
+    search_narrow(&base, &len, key, PLACEMENT_SEARCH_WINDOW);
+    base = search_window(keys, n, base);
+
+    /* avx2 only has a signed 64 bit compare, so flip the sign bits to get
+     * an unsigned ordering
+     */
+    sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    k = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), sign);
+    for(i=0; i<PLACEMENT_SEARCH_WINDOW; i+=4)
+    {
+        v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)&base[i]), sign);
+        gt += __builtin_popcount(_mm256_movemask_pd(
+            _mm256_castsi256_pd(_mm256_cmpgt_epi64(v, k))));
+    }
+
+    /* the window is sorted, so the ids <= key are the ones before the
+     * first id > key
+     */
+    return((base - keys) + PLACEMENT_SEARCH_WINDOW - gt);
+}
+
+__attribute__((target("avx512f")))
+static unsigned long search_avx512(const uint64_t *keys, unsigned long n,
+    uint64_t key)
+{
+    const uint64_t *base = keys;
+    unsigned long len = n;
+    __m512i k;
+    int le = 0;
+    int i;
+
+    if(n < PLACEMENT_SEARCH_WINDOW)
+        return(search_scalar(keys, n, key));
+
+    search_narrow(&base, &len, key, PLACEMENT_SEARCH_WINDOW);
+    base = search_window(keys, n, base);
+
+    k = _mm512_set1_epi64((long long)key);
+    for(i=0; i<PLACEMENT_SEARCH_WINDOW; i+=8)
+        le += __builtin_popcount(_mm512_cmple_epu64_mask(
+            _mm512_loadu_si512((const void*)&base[i]), k));
+
+    return((base - keys) + le);
+}
+#endif
+
+placement_search_fn placement_search_select(const char *name)
+{
+    if(strcmp(name, "scalar") == 0)
+        return(search_scalar);
+
+#ifdef PLACEMENT_SEARCH_X86
+    __builtin_cpu_init();
+    if(strcmp(name, "avx512") == 0)
+        return(__builtin_cpu_supports("avx512f") ? search_avx512 : NULL);
+    if(strcmp(name, "avx2") == 0)
+        return(__builtin_cpu_supports("avx2") ? search_avx2 : NULL);
+    if(strcmp(name, "auto") == 0)
+    {
+        if(__builtin_cpu_supports("avx512f"))
+            return(search_avx512);
+        if(__builtin_cpu_supports("avx2"))
+            return(search_avx2);
+        return(search_scalar);
+    }
+#else
+    if(strcmp(name, "auto") == 0)
+        return(search_scalar);
+#endif
+
+    return(NULL);
+}
+
+int placement_search_parse(const char *name, placement_search_fn *fn)
+{
+    if(strcmp(name, "bsearch") == 0)
+    {
+        *fn = NULL;
+        return(0);
+    }
+
+    *fn = placement_search_select(name);
+    if(!*fn)
+    {
+        fprintf(stderr, "Error: search kernel \"%s\" is unknown or not supported by this cpu\n",
+            name);
+        return(-1);
+    }
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
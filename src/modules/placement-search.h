@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef PLACEMENT_SEARCH_H
+#define PLACEMENT_SEARCH_H
+
+#include <stdint.h>
+
+/* search kernels over a sorted array of 64 bit ring ids.  Each returns the
+ * number of entries in keys[0..n) that are less than or equal to key, which
+ * is also the position of the first entry greater than key (n if there is
+ * none).
+ */
+typedef unsigned long (*placement_search_fn)(const uint64_t *keys,
+    unsigned long n, uint64_t key);
+
+/* returns the kernel with the given name ("auto", "scalar", "avx2" or
+ * "avx512"), or NULL if the name is unknown or the kernel is not supported
+ * by this cpu.  "auto" picks the widest kernel the cpu supports.
+ */
+placement_search_fn placement_search_select(const char *name);
+
+/* handles a module's "search:<name>" parameter.  The name may also be
+ * "bsearch", in which case *fn is set to NULL and the module should fall
+ * back to bsearch().  Returns -1 if the kernel is unknown or unsupported.
+ */
+int placement_search_parse(const char *name, placement_search_fn *fn);
+
+#endif /* PLACEMENT_SEARCH_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
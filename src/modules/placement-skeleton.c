@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Skeleton based rendezvous hashing.  The servers are the leaves of a
+ * fixed virtual tree with a fanout of F: leaves are grouped into clusters
+ * of F consecutive servers, clusters into groups of F clusters, and so on
+ * up to a single root.  An object descends from the root by rendezvous
+ * hashing among the children of each node, so a lookup scores
+ * O(F * log_F(n)) nodes instead of every server.
+ *
+ * Replicas come from a depth first walk that visits the children of each
+ * node in rendezvous order, so each object ranks every server in a fixed
+ * order that does not depend on membership.  Removed servers (and
+ * subtrees with no servers left) are skipped, which means that removing a
+ * server only moves the objects it held, like flat rendezvous hashing.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "ch-placement.h"
+#include "src/modules/placement-mod.h"
+#include "src/modules/placement-hrw.h"
+#include "src/lookup3.h"
+
+static struct placement_mod* placement_mod_skeleton(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_skeleton_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
+static void placement_find_closest_skeleton(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_find_closest_batch_skeleton(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_finalize_skeleton(struct placement_mod *mod);
+static int placement_get_stats_skeleton(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+static int placement_add_server_skeleton(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static int placement_remove_server_skeleton(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+
+struct placement_mod_map skeleton_mod_map =
+{
+    .type = "skeleton",
+    .initiate = placement_mod_skeleton,
+    .initiate_params = placement_mod_skeleton_params,
+};
+
+#define SKELETON_FANOUT_DEFAULT 8
+#define SKELETON_FANOUT_MAX 64
+
+/* the nodes at one height of the tree; height 0 holds the servers.  The
+ * children of node k are nodes k*F through k*F+F-1 one level down.
+ */
+struct skeleton_level
+{
+    unsigned long count;
+    unsigned long span;     /* servers under a full node at this height */
+    uint64_t *ids;          /* rendezvous id of each node */
+    uint32_t *alive;        /* member servers under each node */
+};
+
+struct skeleton_state
+{
+    unsigned int n_svrs;
+    unsigned int fanout;
+    unsigned int n_levels;  /* the root is alone at height n_levels-1 */
+    struct skeleton_level *levels;
+    placement_hrw_fn kernel;
+};
+
+static int skeleton_parse_param(void *state, const char *param);
+
+struct placement_mod* placement_mod_skeleton(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_skeleton_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_skeleton_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
+{
+    struct placement_mod *mod_skeleton;
+    struct skeleton_state *mod_state;
+    struct skeleton_level *level;
+    unsigned long count, span;
+    uint64_t k;
+    uint32_t h1, h2;
+    unsigned int h;
+
+    (void)virt_factor;
+
+    if(n_svrs < 1)
+        return(NULL);
+
+    mod_skeleton = calloc(1, sizeof(*mod_skeleton));
+    if(!mod_skeleton)
+        return(NULL);
+
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_state)
+    {
+        free(mod_skeleton);
+        return(NULL);
+    }
+
+    mod_skeleton->data = mod_state;
+    mod_state->n_svrs = n_svrs;
+    mod_state->fanout = SKELETON_FANOUT_DEFAULT;
+
+    mod_state->kernel = placement_hrw_select(PLACEMENT_HRW_LOOKUP3, "auto");
+    if(placement_parse_params("skeleton", params, skeleton_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_skeleton);
+        return(NULL);
+    }
+
+    /* one level of servers, then fewer nodes at each height up to a root */
+    mod_state->n_levels = 1;
+    for(count=n_svrs; count>1; count=(count+mod_state->fanout-1)/mod_state->fanout)
+        mod_state->n_levels++;
+    mod_state->levels = calloc(mod_state->n_levels, sizeof(*mod_state->levels));
+    if(!mod_state->levels)
+    {
+        free(mod_state);
+        free(mod_skeleton);
+        return(NULL);
+    }
+
+    count = n_svrs;
+    span = 1;
+    for(h=0; h<mod_state->n_levels; h++)
+    {
+        level = &mod_state->levels[h];
+        level->count = count;
+        level->span = span;
+        level->ids = malloc(sizeof(*level->ids)*count);
+        level->alive = malloc(sizeof(*level->alive)*count);
+        if(!level->ids || !level->alive)
+        {
+            placement_finalize_skeleton(mod_skeleton);
+            return(NULL);
+        }
+
+        /* servers get the same id as their first vnode in the other
+         * modules; nodes higher up hash their height in as well
+         */
+        for(k=0; k<count; k++)
+        {
+            h1 = h;
+            h2 = seed;
+            ch_bj_hashlittle2(&k, sizeof(k), &h1, &h2);
+            level->ids[k] = h1 + (((uint64_t)h2)<<32);
+            level->alive[k] = (n_svrs - k*span < span) ?
+                n_svrs - k*span : span;
+        }
+
+        count = (count + mod_state->fanout - 1) / mod_state->fanout;
+        span *= mod_state->fanout;
+    }
+
+    mod_skeleton->find_closest = placement_find_closest_skeleton;
+    mod_skeleton->find_closest_batch = placement_find_closest_batch_skeleton;
+    mod_skeleton->create_striped = placement_create_striped_random;
+    mod_skeleton->finalize = placement_finalize_skeleton;
+    mod_skeleton->get_stats = placement_get_stats_skeleton;
+    mod_skeleton->add_server = placement_add_server_skeleton;
+    mod_skeleton->remove_server = placement_remove_server_skeleton;
+
+    return(mod_skeleton);
+}
+
+/* parses one module parameter; see the ring module for the format.
+ * fanout is the number of children of each node in the tree, and kernel
+ * picks the rendezvous scoring kernel (see placement-hrw.h).
+ */
+static int skeleton_parse_param(void *state, const char *param)
+{
+    struct skeleton_state *mod_state = state;
+
+    if(sscanf(param, "fanout:%u", &mod_state->fanout) == 1)
+    {
+        if(mod_state->fanout < 2 || mod_state->fanout > SKELETON_FANOUT_MAX)
+        {
+            fprintf(stderr, "Error: fanout must be between 2 and %d\n",
+                SKELETON_FANOUT_MAX);
+            return(-1);
+        }
+    }
+    else if(strncmp(param, "kernel:", strlen("kernel:")) == 0)
+    {
+        if(placement_hrw_parse(PLACEMENT_HRW_LOOKUP3,
+            param + strlen("kernel:"), &mod_state->kernel) < 0)
+            return(-1);
+        if(!mod_state->kernel)
+        {
+            fprintf(stderr, "Error: skeleton has no reference kernel\n");
+            return(-1);
+        }
+    }
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* visits the servers under node (at height h) in rendezvous order,
+ * appending the members to server_idxs until there are replication of them
+ */
+static void skeleton_walk(struct skeleton_state *mod_state, unsigned int h,
+    unsigned long node, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs, unsigned int *found)
+{
+    struct skeleton_level *below;
+    uint64_t dists[SKELETON_FANOUT_MAX];
+    double scores[SKELETON_FANOUT_MAX];
+    unsigned int order[SKELETON_FANOUT_MAX];
+    unsigned long first, size;
+    unsigned int n, i, j, c;
+    int weighted = 0;
+
+    if(h == 0)
+    {
+        server_idxs[(*found)++] = node;
+        return;
+    }
+
+    below = &mod_state->levels[h-1];
+    first = node * mod_state->fanout;
+    n = below->count - first < mod_state->fanout ?
+        below->count - first : mod_state->fanout;
+    mod_state->kernel(&below->ids[first], n, obj, dists);
+
+    /* only the last node at each height can have a partial subtree, and
+     * its children get a share of the objects proportional to the number
+     * of servers they were built with.  That takes the logarithmic form of
+     * weighted rendezvous hashing; everywhere else the children are equal
+     * and the raw distances are enough.
+     */
+    if((first + n) * below->span > mod_state->n_svrs)
+    {
+        weighted = 1;
+        for(i=0; i<n; i++)
+        {
+            size = mod_state->n_svrs - (first+i)*below->span;
+            if(size > below->span)
+                size = below->span;
+            scores[i] = -log1p(-(dists[i] + 0.5) / 18446744073709551616.0) /
+                size;
+        }
+    }
+
+    /* smallest first; ties go to the earlier child */
+    for(i=0; i<n; i++)
+    {
+        for(j=i; j>0 && (weighted ? scores[order[j-1]] > scores[i] :
+            dists[order[j-1]] > dists[i]); j--)
+            order[j] = order[j-1];
+        order[j] = i;
+    }
+
+    for(i=0; i<n && *found < replication; i++)
+    {
+        c = order[i];
+        if(below->alive[first+c])
+            skeleton_walk(mod_state, h-1, first+c, obj, replication,
+                server_idxs, found);
+    }
+
+    return;
+}
+
+static void placement_find_closest_skeleton(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    struct skeleton_state *mod_state = mod->data;
+    unsigned int found = 0;
+
+    skeleton_walk(mod_state, mod_state->n_levels-1, 0, obj, replication,
+        server_idxs, &found);
+
+    /* fewer members than replicas */
+    for(; found<replication; found++)
+        server_idxs[found] = UINT64_MAX;
+
+    return;
+}
+
+static void placement_find_closest_batch_skeleton(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        placement_find_closest_skeleton(mod, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
+/* adds delta to the member count of svr_idx and every node above it */
+static void skeleton_update(struct skeleton_state *mod_state,
+    unsigned long svr_idx, int delta)
+{
+    unsigned long node = svr_idx;
+    unsigned int h;
+
+    for(h=0; h<mod_state->n_levels; h++)
+    {
+        mod_state->levels[h].alive[node] += delta;
+        node /= mod_state->fanout;
+    }
+
+    return;
+}
+
+/* the tree is fixed when the instance is built, so only servers it was
+ * built with can come back
+ */
+static int placement_add_server_skeleton(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct skeleton_state *mod_state = mod->data;
+
+    if(svr_idx >= mod_state->n_svrs || mod_state->levels[0].alive[svr_idx])
+        return(-1);
+
+    skeleton_update(mod_state, svr_idx, 1);
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static int placement_remove_server_skeleton(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct skeleton_state *mod_state = mod->data;
+    struct skeleton_level *root = &mod_state->levels[mod_state->n_levels-1];
+
+    if(svr_idx >= mod_state->n_svrs ||
+        !mod_state->levels[0].alive[svr_idx] || root->alive[0] == 1)
+        return(-1);
+
+    skeleton_update(mod_state, svr_idx, -1);
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static void placement_finalize_skeleton(struct placement_mod *mod)
+{
+    struct skeleton_state *mod_state = mod->data;
+    unsigned int h;
+
+    for(h=0; h<mod_state->n_levels; h++)
+    {
+        free(mod_state->levels[h].ids);
+        free(mod_state->levels[h].alive);
+    }
+    free(mod_state->levels);
+    free(mod_state);
+    free(mod);
+
+    return;
+}
+
+static int placement_get_stats_skeleton(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct skeleton_state *mod_state = mod->data;
+    unsigned int h;
+
+    memset(stats, 0, sizeof(*stats));
+    for(h=0; h<mod_state->n_levels; h++)
+        stats->table_bytes += mod_state->levels[h].count *
+            (sizeof(*mod_state->levels[h].ids) +
+            sizeof(*mod_state->levels[h].alive));
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
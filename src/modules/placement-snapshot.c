@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "src/modules/placement-snapshot.h"
+#include "src/spooky.h"
+
+int placement_snapshot_create(struct placement_snapshot *snap,
+    const char *path)
+{
+    struct placement_snapshot_header header;
+    int fd;
+
+    memset(snap, 0, sizeof(*snap));
+
+    /* write next to the destination so that the final rename is atomic;
+     * processes that still map the old file keep their copy.  The name is
+     * unique, so that threads saving to the same path don't share it.
+     */
+    snap->tmp_path = malloc(strlen(path) + 32);
+    if(!snap->tmp_path)
+        return(-1);
+    sprintf(snap->tmp_path, "%s.tmp.XXXXXX", path);
+
+    fd = mkstemp(snap->tmp_path);
+    if(fd < 0)
+    {
+        perror(snap->tmp_path);
+        free(snap->tmp_path);
+        return(-1);
+    }
+    /* mkstemp() makes the file private; other processes map it too */
+    if(fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) != 0 ||
+        !(snap->file = fdopen(fd, "w+")))
+    {
+        perror(snap->tmp_path);
+        close(fd);
+        unlink(snap->tmp_path);
+        free(snap->tmp_path);
+        return(-1);
+    }
+
+    /* filled in by placement_snapshot_finish() */
+    memset(&header, 0, sizeof(header));
+    if(fwrite(&header, sizeof(header), 1, snap->file) != 1)
+        snap->error = 1;
+
+    return(0);
+}
+
+void placement_snapshot_write(struct placement_snapshot *snap,
+    const void *data, uint64_t len)
+{
+    static const char zeros[PLACEMENT_SNAPSHOT_ALIGN];
+    uint64_t pad = (PLACEMENT_SNAPSHOT_ALIGN - len % PLACEMENT_SNAPSHOT_ALIGN) %
+        PLACEMENT_SNAPSHOT_ALIGN;
+
+    if(snap->error)
+        return;
+
+    if((len && fwrite(data, len, 1, snap->file) != 1) ||
+        (pad && fwrite(zeros, pad, 1, snap->file) != 1))
+    {
+        snap->error = 1;
+        return;
+    }
+    snap->size += len + pad;
+
+    return;
+}
+
+int placement_snapshot_finish(struct placement_snapshot *snap,
+    const char *path, const char *type)
+{
+    struct placement_snapshot_header header;
+    void *map;
+    int ret = 0;
+
+    if(strlen(type) >= PLACEMENT_SNAPSHOT_TYPE_MAX || fflush(snap->file) != 0)
+        snap->error = 1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PLACEMENT_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = PLACEMENT_SNAPSHOT_VERSION;
+    header.byte_order = PLACEMENT_SNAPSHOT_BYTE_ORDER;
+    strncpy(header.type, type, sizeof(header.type)-1);
+    header.payload_size = snap->size;
+
+    /* checksum the payload as it landed in the file */
+    if(!snap->error && snap->size > 0)
+    {
+        map = mmap(NULL, sizeof(header) + snap->size, PROT_READ, MAP_SHARED,
+            fileno(snap->file), 0);
+        if(map == MAP_FAILED)
+            snap->error = 1;
+        else
+        {
+            header.checksum = spooky_hash64((char*)map + sizeof(header),
+                snap->size, 0);
+            munmap(map, sizeof(header) + snap->size);
+        }
+    }
+
+    if(!snap->error && (fseek(snap->file, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, snap->file) != 1))
+        snap->error = 1;
+    if(fclose(snap->file) != 0)
+        snap->error = 1;
+
+    if(!snap->error && rename(snap->tmp_path, path) != 0)
+    {
+        perror(path);
+        snap->error = 1;
+    }
+    if(snap->error)
+    {
+        unlink(snap->tmp_path);
+        ret = -1;
+    }
+    free(snap->tmp_path);
+
+    return(ret);
+}
+
+int placement_snapshot_map(const char *path, struct placement_snapshot *snap,
+    char *type, void **map, size_t *map_size)
+{
+    const struct placement_snapshot_header *header;
+    struct stat st;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        perror(path);
+        return(-1);
+    }
+    if(fstat(fd, &st) != 0 || st.st_size < 0 ||
+        (size_t)st.st_size < sizeof(*header))
+    {
+        fprintf(stderr, "Error: %s is not a placement snapshot\n", path);
+        close(fd);
+        return(-1);
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+    {
+        perror(path);
+        return(-1);
+    }
+
+    header = base;
+    if(memcmp(header->magic, PLACEMENT_SNAPSHOT_MAGIC,
+        sizeof(header->magic)) != 0 ||
+        header->byte_order != PLACEMENT_SNAPSHOT_BYTE_ORDER ||
+        header->type[sizeof(header->type)-1] != '\0')
+    {
+        fprintf(stderr, "Error: %s is not a placement snapshot for this architecture\n", path);
+        munmap(base, st.st_size);
+        return(-1);
+    }
+    if(header->version != PLACEMENT_SNAPSHOT_VERSION)
+    {
+        fprintf(stderr, "Error: %s is snapshot version %u, expected %u\n",
+            path, header->version, PLACEMENT_SNAPSHOT_VERSION);
+        munmap(base, st.st_size);
+        return(-1);
+    }
+    if(header->payload_size != st.st_size - sizeof(*header) ||
+        spooky_hash64((const char*)base + sizeof(*header),
+        header->payload_size, 0) != header->checksum)
+    {
+        fprintf(stderr, "Error: %s is truncated or corrupt\n", path);
+        munmap(base, st.st_size);
+        return(-1);
+    }
+
+    memset(snap, 0, sizeof(*snap));
+    snap->data = (const char*)base + sizeof(*header);
+    snap->size = header->payload_size;
+    strcpy(type, header->type);
+    *map = base;
+    *map_size = st.st_size;
+
+    return(0);
+}
+
+const void* placement_snapshot_read(struct placement_snapshot *snap,
+    uint64_t count, uint64_t elem_size)
+{
+    const void *section;
+    uint64_t len;
+
+    if(snap->error || (elem_size && count > (snap->size - snap->pos) / elem_size))
+    {
+        snap->error = 1;
+        return(NULL);
+    }
+
+    len = count * elem_size;
+    section = snap->data + snap->pos;
+    len += (PLACEMENT_SNAPSHOT_ALIGN - len % PLACEMENT_SNAPSHOT_ALIGN) %
+        PLACEMENT_SNAPSHOT_ALIGN;
+    snap->pos += len;
+    if(snap->pos > snap->size)
+        snap->pos = snap->size;
+
+    return(section);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
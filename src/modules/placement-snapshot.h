@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef PLACEMENT_SNAPSHOT_H
+#define PLACEMENT_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* On-disk snapshot of a built placement table, as written by
+ * ch_placement_save():
+ *
+ *   struct placement_snapshot_header   (64 bytes)
+ *   payload                            (payload_size bytes)
+ *
+ * The payload is a sequence of sections written by the module, each padded
+ * to PLACEMENT_SNAPSHOT_ALIGN bytes so that arrays in a mapped file are
+ * aligned to cache lines.  Everything is in host byte order; the
+ * byte_order field rejects files written on a different architecture.
+ */
+
+#define PLACEMENT_SNAPSHOT_MAGIC "CHPLSNAP"
+#define PLACEMENT_SNAPSHOT_VERSION 1
+#define PLACEMENT_SNAPSHOT_BYTE_ORDER 0x01020304
+#define PLACEMENT_SNAPSHOT_ALIGN 64
+#define PLACEMENT_SNAPSHOT_TYPE_MAX 32
+
+struct placement_snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    char type[PLACEMENT_SNAPSHOT_TYPE_MAX]; /* module name, NUL padded */
+    uint64_t payload_size;
+    uint64_t checksum;                      /* spooky hash of the payload */
+};
+
+/* a snapshot being written or read by a module */
+struct placement_snapshot
+{
+    FILE *file;          /* when saving */
+    char *tmp_path;      /* written here, then renamed into place */
+    const char *data;    /* payload, when loading */
+    uint64_t size;       /* payload bytes written, or available */
+    uint64_t pos;        /* read position in the payload */
+    int error;           /* set by a failed write or read */
+};
+
+/* starts writing a snapshot that will replace path */
+int placement_snapshot_create(struct placement_snapshot *snap,
+    const char *path);
+
+/* appends a section to the payload.  Errors are sticky and reported by
+ * placement_snapshot_finish().
+ */
+void placement_snapshot_write(struct placement_snapshot *snap,
+    const void *data, uint64_t len);
+
+/* fills in the header and atomically replaces path with the snapshot; if
+ * the snapshot is incomplete it is discarded instead.  Returns -1 on error.
+ */
+int placement_snapshot_finish(struct placement_snapshot *snap,
+    const char *path, const char *type);
+
+/* maps path read-only and checks its header and checksum.  On success
+ * fills in type and snap (ready to read the payload) and the mapping,
+ * which the caller must munmap() once the instance is done with it.
+ */
+int placement_snapshot_map(const char *path, struct placement_snapshot *snap,
+    char *type, void **map, size_t *map_size);
+
+/* returns a pointer to the next section of the payload, holding count
+ * elements of elem_size bytes, or NULL if the payload is too short
+ */
+const void* placement_snapshot_read(struct placement_snapshot *snap,
+    uint64_t count, uint64_t elem_size);
+
+#endif /* PLACEMENT_SNAPSHOT_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -23,6 +23,9 @@
 static struct placement_mod* placement_mod_static_modulo(int n_svrs, int virt_factor, int seed);
 static void placement_find_closest_static_modulo(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
     unsigned long *server_idxs);
+static void placement_find_closest_batch_static_modulo(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
 static void placement_finalize_static_modulo(struct placement_mod *mod);
 
 struct placement_mod_map static_modulo_mod_map = 
@@ -46,7 +49,7 @@ struct placement_mod* placement_mod_static_modulo(int n_svrs, int virt_factor, i
      */
     (void)virt_factor;
 
-    mod_static_modulo = malloc(sizeof(*mod_static_modulo));
+    mod_static_modulo = calloc(1, sizeof(*mod_static_modulo));
     if(!mod_static_modulo)
         return(NULL);
 
@@ -62,16 +65,17 @@ struct placement_mod* placement_mod_static_modulo(int n_svrs, int virt_factor, i
     mod_state->n_svrs = n_svrs;
 
     mod_static_modulo->find_closest = placement_find_closest_static_modulo;
+    mod_static_modulo->find_closest_batch = placement_find_closest_batch_static_modulo;
     mod_static_modulo->create_striped = placement_create_striped_random;
     mod_static_modulo->finalize = placement_finalize_static_modulo;
 
     return(mod_static_modulo);
 }
 
-static void placement_find_closest_static_modulo(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
-    unsigned long* server_idxs)
+static inline void static_modulo_find_closest(
+    struct static_modulo_state *mod_state, uint64_t obj,
+    unsigned int replication, unsigned long* server_idxs)
 {
-    struct static_modulo_state *mod_state = mod->data;
     uint32_t h1 = 0;
     uint32_t h2 = 0;
     uint64_t hashed_obj;
@@ -93,6 +97,28 @@ static void placement_find_closest_static_modulo(struct placement_mod *mod, uint
     return;
 }
 
+static void placement_find_closest_static_modulo(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
+    unsigned long* server_idxs)
+{
+    static_modulo_find_closest(mod->data, obj, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_static_modulo(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct static_modulo_state *mod_state = mod->data;
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        static_modulo_find_closest(mod_state, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
 static void placement_finalize_static_modulo(struct placement_mod *mod)
 {
     struct static_modulo_state *mod_state = mod->data;
@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2013 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Weighted rendezvous placement in the style of CRUSH's straw2 buckets,
+ * without any dependency on Ceph.  For each replica round, every server
+ * draws ln(u) / weight, where u is a hash of the object, the round and the
+ * server mapped into (0, 1], and the largest draw wins.  That makes each
+ * server win in proportion to its weight, and changing one server's
+ * weight only moves objects to or from that server.
+ *
+ * ln(u) comes from a fixed-point log2 table with linear interpolation,
+ * built with integer arithmetic only, so that every platform places
+ * objects identically.  Weights are integers in 16.16 fixed point, scaled
+ * so that a server of average weight gets 1.0.
+ *
+ * Replicas follow CRUSH's firstn selection: replica rep draws with round
+ * rep + retries, and retries while it collides with an earlier replica.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch-placement.h"
+#include "src/modules/placement-mod.h"
+#include "src/modules/placement-hrw.h"
+#include "src/lookup3.h"
+
+static struct placement_mod* placement_mod_straw2(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_straw2_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
+static struct placement_mod* placement_mod_straw2_weighted(int n_svrs,
+    int virt_factor, int seed, const double *weights, const char* params);
+static void placement_find_closest_straw2(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_find_closest_batch_straw2(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_finalize_straw2(struct placement_mod *mod);
+static int placement_get_stats_straw2(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+static int placement_add_server_straw2(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+static int placement_remove_server_straw2(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs);
+
+struct placement_mod_map straw2_mod_map =
+{
+    .type = "straw2",
+    .initiate = placement_mod_straw2,
+    .initiate_params = placement_mod_straw2_params,
+    .initiate_weighted = placement_mod_straw2_weighted,
+};
+
+/* bits of the hash used for u; straw2 uses 16, more bits mean fewer ties
+ * between servers
+ */
+#define STRAW2_U_BITS 24
+/* fractional bits of the log table */
+#define STRAW2_LOG_SHIFT 44
+/* log2 table entries, plus one for the end of the last interval */
+#define STRAW2_LOG_ENTRIES 256
+/* weight of a server of average weight */
+#define STRAW2_WEIGHT_ONE 0x10000
+/* rounds tried for one replica, like CRUSH's choose_total_tries */
+#define STRAW2_TRIES 50
+/* number of servers scored at a time */
+#define STRAW2_CHUNK 256
+
+struct straw2_state
+{
+    unsigned int n_svrs;
+    int seed;
+    int uniform;            /* every server was built with the same weight */
+    uint64_t *ids;          /* rendezvous id of each server */
+    uint64_t *weights;      /* current weight, 0 if removed */
+    uint64_t *base_weights; /* weight each server was built with */
+    uint64_t log_table[STRAW2_LOG_ENTRIES+1];
+    placement_hrw_fn kernel;
+};
+
+static int straw2_parse_param(void *state, const char *param);
+static void straw2_build_log_table(uint64_t *table);
+
+struct placement_mod* placement_mod_straw2(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_straw2_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_straw2_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
+{
+    return(placement_mod_straw2_weighted(n_svrs, virt_factor, seed, NULL,
+        params));
+}
+
+/* weights may be NULL, in which case every server gets the same weight */
+static struct placement_mod* placement_mod_straw2_weighted(int n_svrs,
+    int virt_factor, int seed, const double *weights, const char* params)
+{
+    struct placement_mod *mod_straw2;
+    struct straw2_state *mod_state;
+    double total = 0;
+    uint64_t k;
+    uint32_t h1, h2;
+
+    (void)virt_factor;
+
+    if(n_svrs < 1)
+        return(NULL);
+    if(weights)
+    {
+        for(k=0; k<(uint64_t)n_svrs; k++)
+        {
+            if(!(weights[k] >= 0))
+                return(NULL);
+            total += weights[k];
+        }
+        if(!(total > 0))
+            return(NULL);
+    }
+
+    mod_straw2 = calloc(1, sizeof(*mod_straw2));
+    if(!mod_straw2)
+        return(NULL);
+
+    mod_state = calloc(1, sizeof(*mod_state));
+    if(!mod_state)
+    {
+        free(mod_straw2);
+        return(NULL);
+    }
+
+    mod_straw2->data = mod_state;
+    mod_state->n_svrs = n_svrs;
+    mod_state->seed = seed;
+
+    mod_state->kernel = placement_hrw_select(PLACEMENT_HRW_LOOKUP3, "auto");
+    if(placement_parse_params("straw2", params, straw2_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_straw2);
+        return(NULL);
+    }
+
+    mod_state->ids = malloc(sizeof(*mod_state->ids)*n_svrs);
+    mod_state->weights = malloc(sizeof(*mod_state->weights)*n_svrs);
+    mod_state->base_weights = malloc(sizeof(*mod_state->base_weights)*n_svrs);
+    if(!mod_state->ids || !mod_state->weights || !mod_state->base_weights)
+    {
+        placement_finalize_straw2(mod_straw2);
+        return(NULL);
+    }
+
+    mod_state->uniform = 1;
+    for(k=0; k<(uint64_t)n_svrs; k++)
+    {
+        /* servers get the same id as their first vnode in the other
+         * modules
+         */
+        h1 = 0;
+        h2 = seed;
+        ch_bj_hashlittle2(&k, sizeof(k), &h1, &h2);
+        mod_state->ids[k] = h1 + (((uint64_t)h2)<<32);
+
+        /* a server with a positive weight always gets some */
+        if(!weights)
+            mod_state->base_weights[k] = STRAW2_WEIGHT_ONE;
+        else if(weights[k] > 0)
+        {
+            mod_state->base_weights[k] = weights[k] * n_svrs / total *
+                STRAW2_WEIGHT_ONE + 0.5;
+            if(mod_state->base_weights[k] == 0)
+                mod_state->base_weights[k] = 1;
+        }
+        else
+            mod_state->base_weights[k] = 0;
+        mod_state->weights[k] = mod_state->base_weights[k];
+        if(mod_state->base_weights[k] != mod_state->base_weights[0])
+            mod_state->uniform = 0;
+    }
+
+    straw2_build_log_table(mod_state->log_table);
+
+    mod_straw2->find_closest = placement_find_closest_straw2;
+    mod_straw2->find_closest_batch = placement_find_closest_batch_straw2;
+    mod_straw2->create_striped = placement_create_striped_random;
+    mod_straw2->finalize = placement_finalize_straw2;
+    mod_straw2->get_stats = placement_get_stats_straw2;
+    mod_straw2->add_server = placement_add_server_straw2;
+    mod_straw2->remove_server = placement_remove_server_straw2;
+
+    return(mod_straw2);
+}
+
+/* parses one module parameter; see the ring module for the format.
+ * kernel picks the hashing kernel (see placement-hrw.h).
+ */
+static int straw2_parse_param(void *state, const char *param)
+{
+    struct straw2_state *mod_state = state;
+
+    if(strncmp(param, "kernel:", strlen("kernel:")) == 0)
+    {
+        if(placement_hrw_parse(PLACEMENT_HRW_LOOKUP3,
+            param + strlen("kernel:"), &mod_state->kernel) < 0)
+            return(-1);
+        if(!mod_state->kernel)
+        {
+            fprintf(stderr, "Error: straw2 has no reference kernel\n");
+            return(-1);
+        }
+    }
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* fills table[j] with 2^44 * log2(1 + j/256) for j in [0, 256], rounded
+ * down.  Each bit comes from squaring the mantissa in 2.62 fixed point.
+ */
+static void straw2_build_log_table(uint64_t *table)
+{
+    uint64_t m, r;
+    unsigned int j;
+    int bit;
+
+    for(j=0; j<STRAW2_LOG_ENTRIES; j++)
+    {
+        m = (uint64_t)(STRAW2_LOG_ENTRIES + j) << 54;
+        r = 0;
+        for(bit=STRAW2_LOG_SHIFT-1; bit>=0; bit--)
+        {
+            m = (uint64_t)(((unsigned __int128)m * m) >> 62);
+            if(m >= (uint64_t)1 << 63)
+            {
+                m >>= 1;
+                r |= (uint64_t)1 << bit;
+            }
+        }
+        table[j] = r;
+    }
+    table[STRAW2_LOG_ENTRIES] = (uint64_t)1 << STRAW2_LOG_SHIFT;
+
+    return;
+}
+
+/* returns -2^44 * log2(u), with u = (x+1) / 2^24 in (0, 1].  The top 8
+ * bits of the mantissa pick the table entry and the rest interpolate.
+ */
+static inline uint64_t straw2_neg_log(const uint64_t *table, uint64_t x)
+{
+    uint64_t f, lo, hi, rem;
+    unsigned int k;
+
+    x++;
+    k = 63 - __builtin_clzll(x);
+    f = x << (63 - k);
+    lo = table[(f >> 55) & 0xff];
+    hi = table[((f >> 55) & 0xff) + 1];
+    rem = (f >> 31) & 0xffffff;
+
+    return(((uint64_t)STRAW2_U_BITS << STRAW2_LOG_SHIFT) -
+        (((uint64_t)k << STRAW2_LOG_SHIFT) + lo + (((hi - lo) * rem) >> 24)));
+}
+
+/* returns the server with the largest draw for the key, skipping the
+ * first n_skip servers in skip
+ */
+static unsigned long straw2_choose(struct straw2_state *mod_state,
+    uint64_t key, const unsigned long *skip, unsigned int n_skip)
+{
+    uint64_t dists[STRAW2_CHUNK];
+    uint64_t cost, best_cost = UINT64_MAX;
+    uint64_t best_weight = 1;
+    unsigned long best = UINT64_MAX;
+    unsigned long base, i, m;
+    unsigned int j;
+
+    for(base=0; base<mod_state->n_svrs; base+=m)
+    {
+        m = mod_state->n_svrs - base < STRAW2_CHUNK ?
+            mod_state->n_svrs - base : STRAW2_CHUNK;
+        mod_state->kernel(&mod_state->ids[base], m, key, dists);
+
+        /* the largest ln(u) / weight is the smallest -ln(u) / weight.
+         * With equal weights that is just the largest u, so the log is
+         * skipped; otherwise the quotients are compared exactly by cross
+         * multiplying.  Ties go to the earlier server.
+         */
+        for(i=0; i<m; i++)
+        {
+            if(!mod_state->weights[base+i])
+                continue;
+            if(mod_state->uniform)
+            {
+                cost = ~dists[i] >> (64 - STRAW2_U_BITS);
+                if(cost >= best_cost)
+                    continue;
+            }
+            else
+            {
+                cost = straw2_neg_log(mod_state->log_table,
+                    dists[i] >> (64 - STRAW2_U_BITS));
+                if((unsigned __int128)cost * best_weight >=
+                    (unsigned __int128)best_cost * mod_state->weights[base+i])
+                    continue;
+            }
+            for(j=0; j<n_skip && skip[j] != base+i; j++);
+            if(j < n_skip)
+                continue;
+            best_cost = cost;
+            best_weight = mod_state->weights[base+i];
+            best = base+i;
+        }
+    }
+
+    return(best);
+}
+
+/* the key for a replica round */
+static inline uint64_t straw2_round_key(struct straw2_state *mod_state,
+    uint64_t obj, unsigned int round)
+{
+    uint32_t h1 = round;
+    uint32_t h2 = mod_state->seed;
+
+    ch_bj_hashlittle2(&obj, sizeof(obj), &h1, &h2);
+
+    return(h1 + (((uint64_t)h2)<<32));
+}
+
+static void placement_find_closest_straw2(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    struct straw2_state *mod_state = mod->data;
+    unsigned long svr;
+    unsigned int rep, tries, j;
+
+    for(rep=0; rep<replication; rep++)
+    {
+        for(tries=0; tries<STRAW2_TRIES; tries++)
+        {
+            svr = straw2_choose(mod_state,
+                straw2_round_key(mod_state, obj, rep + tries), NULL, 0);
+            for(j=0; j<rep && server_idxs[j] != svr; j++);
+            if(j == rep)
+                break;
+        }
+        /* out of tries: take the best server not chosen yet, if any */
+        if(tries == STRAW2_TRIES)
+            svr = straw2_choose(mod_state,
+                straw2_round_key(mod_state, obj, rep + tries), server_idxs,
+                rep);
+        server_idxs[rep] = svr;
+    }
+
+    return;
+}
+
+static void placement_find_closest_batch_straw2(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    unsigned long i;
+
+    for(i=0; i<n_objs; i++)
+        placement_find_closest_straw2(mod, objs[i], replication,
+            &server_idxs[i*replication]);
+
+    return;
+}
+
+/* only servers the instance was built with (with a positive weight) can
+ * come back, with their original weight
+ */
+static int placement_add_server_straw2(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct straw2_state *mod_state = mod->data;
+
+    if(svr_idx >= mod_state->n_svrs ||
+        mod_state->weights[svr_idx] || !mod_state->base_weights[svr_idx])
+        return(-1);
+
+    mod_state->weights[svr_idx] = mod_state->base_weights[svr_idx];
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static int placement_remove_server_straw2(struct placement_mod *mod,
+    unsigned long svr_idx, struct ch_placement_arc **arcs,
+    unsigned long *n_arcs)
+{
+    struct straw2_state *mod_state = mod->data;
+    unsigned long i;
+
+    if(svr_idx >= mod_state->n_svrs || !mod_state->weights[svr_idx])
+        return(-1);
+
+    /* keep at least one member */
+    for(i=0; i<mod_state->n_svrs && (i == svr_idx || !mod_state->weights[i]);
+        i++);
+    if(i == mod_state->n_svrs)
+        return(-1);
+
+    mod_state->weights[svr_idx] = 0;
+
+    return(placement_no_arcs(arcs, n_arcs));
+}
+
+static void placement_finalize_straw2(struct placement_mod *mod)
+{
+    struct straw2_state *mod_state = mod->data;
+
+    free(mod_state->ids);
+    free(mod_state->weights);
+    free(mod_state->base_weights);
+    free(mod_state);
+    free(mod);
+
+    return;
+}
+
+static int placement_get_stats_straw2(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct straw2_state *mod_state = mod->data;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->table_bytes = mod_state->n_svrs * (sizeof(*mod_state->ids) +
+        sizeof(*mod_state->weights) + sizeof(*mod_state->base_weights)) +
+        sizeof(mod_state->log_table);
+
+    return(0);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
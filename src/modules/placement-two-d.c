@@ -4,25 +4,37 @@
  *
  */
 
-#include <assert.h>
-#include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <stdlib.h>
 
 #include "ch-placement.h"
 #include "src/modules/placement-mod.h"
+#include "src/modules/placement-build.h"
 #include "src/lookup3.h"
 
 static struct placement_mod* placement_mod_two_d(int n_svrs, int virt_factor, int seed);
-static void placement_find_closest_two_d(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
+static struct placement_mod* placement_mod_two_d_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
+static void placement_find_closest_two_d(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long *server_idxs);
+static void placement_find_closest_batch_two_d(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
     unsigned long *server_idxs);
 static void placement_finalize_two_d(struct placement_mod *mod);
+static int placement_get_stats_two_d(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
+
+/* squared distances between points in a 2^32 x 2^32 plane need 65 bits */
+typedef unsigned __int128 two_d_dist_t;
 
-static uint64_t placement_distance_two_d(uint64_t a, uint64_t b);
+static two_d_dist_t placement_distance_two_d(uint64_t a, uint64_t b);
 
-struct placement_mod_map two_d_mod_map = 
+struct placement_mod_map two_d_mod_map =
 {
     .type = "two_d",
     .initiate = placement_mod_two_d,
+    .initiate_params = placement_mod_two_d_params,
 };
 
 struct vnode
@@ -31,25 +43,58 @@ struct vnode
     uint64_t svr_id;
 };
 
+enum two_d_search
+{
+    TWO_D_SEARCH_KDTREE = 0,    /* search a k-d tree over the vnodes */
+    TWO_D_SEARCH_SCAN           /* score every vnode */
+};
+
+/* a vnode in the k-d tree.  pos is its position in the vnode table, which
+ * breaks ties between vnodes at the same distance like the scan does.
+ */
+struct kd_point
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t pos;
+};
+
 struct two_d_state
 {
     unsigned int n_svrs;
     unsigned int virt_factor;
-    struct vnode *virt_table;
+    enum two_d_search search;
+    struct vnode *virt_table;   /* only kept for the scan */
+    struct kd_point *kd_tree;   /* implicit tree; see kd_build() */
+    double build_seconds;
+    double index_build_seconds;
 };
 
+/* number of objects scored together in each pass over the vnode table */
+#define TWO_D_TILE 16
+
+static int two_d_parse_param(void *state, const char *param);
+static int two_d_build_kd_tree(struct two_d_state *mod_state);
+
 struct placement_mod* placement_mod_two_d(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_two_d_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_two_d_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
 {
     struct placement_mod *mod_two_d;
     struct two_d_state *mod_state;
     uint32_t h1, h2;
     uint64_t i, j;
+    double start;
 
-    mod_two_d = malloc(sizeof(*mod_two_d));
+    mod_two_d = calloc(1, sizeof(*mod_two_d));
     if(!mod_two_d)
         return(NULL);
 
-    mod_state = malloc(sizeof(*mod_state));
+    mod_state = calloc(1, sizeof(*mod_state));
     if(!mod_state)
     {
         free(mod_two_d);
@@ -58,6 +103,16 @@ struct placement_mod* placement_mod_two_d(int n_svrs, int virt_factor, int seed)
 
     mod_two_d->data = mod_state;
 
+    if(placement_parse_params("two_d", params, two_d_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_two_d);
+        return(NULL);
+    }
+
+    start = placement_wtime();
+
     mod_state->virt_table = malloc(sizeof(*mod_state->virt_table)*n_svrs*virt_factor);
     if(!mod_state->virt_table)
     {
@@ -70,8 +125,9 @@ struct placement_mod* placement_mod_two_d(int n_svrs, int virt_factor, int seed)
     mod_state->virt_factor = virt_factor;
 
     /* create virt_factor virtual nodes for each server index by jenkins
-     * hashing server index
+     * hashing server index; large tables are hashed by several threads
      */
+#pragma omp parallel for private(j, h1, h2) if((unsigned long)n_svrs*virt_factor >= PLACEMENT_BUILD_MIN)
     for(i=0; i<n_svrs; i++)
     {
         for(j=0; j<virt_factor; j++)
@@ -83,43 +139,369 @@ struct placement_mod* placement_mod_two_d(int n_svrs, int virt_factor, int seed)
             mod_state->virt_table[j*n_svrs+i].svr_id = h1 + (((uint64_t)h2)<<32);
         }
     }
+    mod_state->build_seconds = placement_wtime() - start;
+
+    if(mod_state->search == TWO_D_SEARCH_KDTREE)
+    {
+        start = placement_wtime();
+        if(two_d_build_kd_tree(mod_state) < 0)
+        {
+            placement_finalize_two_d(mod_two_d);
+            return(NULL);
+        }
+        mod_state->index_build_seconds = placement_wtime() - start;
+
+        /* the tree has everything lookups need */
+        free(mod_state->virt_table);
+        mod_state->virt_table = NULL;
+    }
 
     mod_two_d->find_closest = placement_find_closest_two_d;
+    mod_two_d->find_closest_batch = placement_find_closest_batch_two_d;
     mod_two_d->create_striped = placement_create_striped_random;
     mod_two_d->finalize = placement_finalize_two_d;
+    mod_two_d->get_stats = placement_get_stats_two_d;
 
     return(mod_two_d);
 }
 
-/* TODO: this could be done faster than O(n), maybe with kd tree */
-static void placement_find_closest_two_d(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
+/* parses one module parameter; see the ring module for the format.
+ * search is "kdtree" (the default) or "scan", which scores every vnode and
+ * is kept as a reference.
+ */
+static int two_d_parse_param(void *state, const char *param)
+{
+    struct two_d_state *mod_state = state;
+
+    if(strcmp(param, "search:kdtree") == 0)
+        mod_state->search = TWO_D_SEARCH_KDTREE;
+    else if(strcmp(param, "search:scan") == 0)
+        mod_state->search = TWO_D_SEARCH_SCAN;
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+static inline uint32_t kd_coord(const struct kd_point *p, int axis)
+{
+    return(axis ? p->y : p->x);
+}
+
+static inline uint32_t kd_median3(uint32_t a, uint32_t b, uint32_t c)
+{
+    if((a <= b) == (b <= c))
+        return(b);
+    if((b <= a) == (a <= c))
+        return(a);
+    return(c);
+}
+
+/* rearranges pts[lo..hi-1] so that pts[k] holds the point that would be
+ * there if the range were sorted on axis, with no larger coordinate before
+ * it and no smaller one after it
+ */
+static void kd_select(struct kd_point *pts, unsigned long lo,
+    unsigned long hi, unsigned long k, int axis)
+{
+    struct kd_point tmp;
+    uint32_t pivot, c;
+    unsigned long lt, i, gt;
+
+    while(hi - lo > 1)
+    {
+        pivot = kd_median3(kd_coord(&pts[lo], axis),
+            kd_coord(&pts[lo + (hi - lo)/2], axis),
+            kd_coord(&pts[hi-1], axis));
+
+        /* three way partition: [lo, lt) < pivot, [lt, gt) == pivot,
+         * [gt, hi) > pivot
+         */
+        lt = lo;
+        i = lo;
+        gt = hi;
+        while(i < gt)
+        {
+            c = kd_coord(&pts[i], axis);
+            if(c < pivot)
+            {
+                tmp = pts[lt];
+                pts[lt++] = pts[i];
+                pts[i++] = tmp;
+            }
+            else if(c > pivot)
+            {
+                tmp = pts[--gt];
+                pts[gt] = pts[i];
+                pts[i] = tmp;
+            }
+            else
+                i++;
+        }
+
+        if(k < lt)
+            hi = lt;
+        else if(k >= gt)
+            lo = gt;
+        else
+            break;
+    }
+
+    return;
+}
+
+/* lays out pts[lo..hi-1] as an implicit k-d tree: the median on axis sits
+ * in the middle, with the points below and above it laid out the same way
+ * on the other axis on either side
+ */
+static void kd_build(struct kd_point *pts, unsigned long lo,
+    unsigned long hi, int axis)
+{
+    unsigned long mid;
+
+    if(hi - lo <= 1)
+        return;
+
+    mid = lo + (hi - lo)/2;
+    kd_select(pts, lo, hi, mid, axis);
+    kd_build(pts, lo, mid, !axis);
+    kd_build(pts, mid+1, hi, !axis);
+
+    return;
+}
+
+static int two_d_build_kd_tree(struct two_d_state *mod_state)
+{
+    unsigned long n = (unsigned long)mod_state->n_svrs*mod_state->virt_factor;
+    unsigned long i;
+
+    mod_state->kd_tree = malloc(sizeof(*mod_state->kd_tree)*n);
+    if(!mod_state->kd_tree)
+        return(-1);
+
+    for(i=0; i<n; i++)
+    {
+        mod_state->kd_tree[i].x = mod_state->virt_table[i].svr_id & 0xFFFFFFFF;
+        mod_state->kd_tree[i].y = mod_state->virt_table[i].svr_id >> 32;
+        mod_state->kd_tree[i].pos = i;
+    }
+    kd_build(mod_state->kd_tree, 0, n, 0);
+
+    return(0);
+}
+
+/* the best candidates found so far during a k-d tree search, nearest
+ * first
+ */
+struct kd_best
+{
+    two_d_dist_t *dist;
+    uint32_t *pos;
+    unsigned int found;
+    unsigned int replication;
+};
+
+static inline void kd_consider(struct kd_best *best, two_d_dist_t dist,
+    uint32_t pos)
+{
+    unsigned int j;
+
+    if(best->found == best->replication)
+    {
+        j = best->found - 1;
+        if(dist > best->dist[j] || (dist == best->dist[j] && pos > best->pos[j]))
+            return;
+    }
+    else
+        j = best->found++;
+
+    /* shift larger candidates down to make room */
+    for(; j > 0 && (best->dist[j-1] > dist ||
+        (best->dist[j-1] == dist && best->pos[j-1] > pos)); j--)
+    {
+        best->dist[j] = best->dist[j-1];
+        best->pos[j] = best->pos[j-1];
+    }
+    best->dist[j] = dist;
+    best->pos[j] = pos;
+
+    return;
+}
+
+static void kd_search(const struct kd_point *pts, unsigned long lo,
+    unsigned long hi, int axis, uint32_t x, uint32_t y,
+    struct kd_best *best)
+{
+    const struct kd_point *p;
+    unsigned long mid;
+    int64_t diff;
+    two_d_dist_t dx, dy, plane;
+
+    if(lo >= hi)
+        return;
+
+    mid = lo + (hi - lo)/2;
+    p = &pts[mid];
+    dx = p->x > x ? p->x - x : x - p->x;
+    dy = p->y > y ? p->y - y : y - p->y;
+    kd_consider(best, dx*dx + dy*dy, p->pos);
+
+    diff = axis ? (int64_t)y - p->y : (int64_t)x - p->x;
+    plane = axis ? dy : dx;
+    if(diff < 0)
+        kd_search(pts, lo, mid, !axis, x, y, best);
+    else
+        kd_search(pts, mid+1, hi, !axis, x, y, best);
+
+    /* points on the far side are at least |diff| away; one at exactly
+     * that distance may still win a tie on table position
+     */
+    if(best->found < best->replication ||
+        plane*plane <= best->dist[best->found-1])
+    {
+        if(diff < 0)
+            kd_search(pts, mid+1, hi, !axis, x, y, best);
+        else
+            kd_search(pts, lo, mid, !axis, x, y, best);
+    }
+
+    return;
+}
+
+static void two_d_find_closest_kd(struct two_d_state *mod_state,
+    uint64_t obj, unsigned int replication, unsigned long* server_idxs)
+{
+    two_d_dist_t dist_stack[CH_STACK_REPLICATION];
+    uint32_t pos_stack[CH_STACK_REPLICATION];
+    struct kd_best best;
+    unsigned int j;
+
+    best.dist = dist_stack;
+    best.pos = pos_stack;
+    best.found = 0;
+    best.replication = replication;
+
+    /* wide layouts don't fit in the stack arrays */
+    if(replication > CH_STACK_REPLICATION)
+    {
+        best.dist = placement_scratch(replication*
+            (sizeof(*best.dist) + sizeof(*best.pos)));
+        best.pos = (void*)&best.dist[replication];
+    }
+
+    kd_search(mod_state->kd_tree, 0,
+        (unsigned long)mod_state->n_svrs*mod_state->virt_factor, 0,
+        obj & 0xFFFFFFFF, obj >> 32, &best);
+
+    for(j=0; j<best.found; j++)
+        server_idxs[j] = best.pos[j] % mod_state->n_svrs;
+    /* like the scan, slots past the number of vnodes get UINT64_MAX */
+    for(; j<replication; j++)
+        server_idxs[j] = UINT64_MAX;
+
+    return;
+}
+
+/* scores a tile of up to TWO_D_TILE objects against every vnode in a
+ * single pass over the table, caching the distance of each candidate kept
+ * so far.  This is the "scan" search, which is O(n) per object; the k-d
+ * tree places objects identically.
+ */
+static void two_d_find_closest_tile(struct two_d_state *mod_state,
+    const uint64_t *objs, unsigned int n_objs, unsigned int replication,
     unsigned long* server_idxs)
 {
-    struct two_d_state *mod_state = mod->data;
-    struct vnode closest[CH_MAX_REPLICATION];
+    struct vnode closest_stack[TWO_D_TILE*CH_STACK_REPLICATION];
+    two_d_dist_t dist_stack[TWO_D_TILE*CH_STACK_REPLICATION];
+    struct vnode *closest = closest_stack;
+    two_d_dist_t *dist = dist_stack;
     struct vnode svr, tmp_svr;
-    unsigned int i,j;
+    two_d_dist_t svr_dist, tmp_dist;
+    unsigned int i,j,k;
 
-    for(i=0; i<replication; i++)
-        closest[i].svr_idx = UINT64_MAX;
+    /* wide layouts don't fit in the stack arrays */
+    if(replication > CH_STACK_REPLICATION)
+    {
+        closest = placement_scratch((unsigned long)n_objs*replication*
+            (sizeof(*closest) + sizeof(*dist)));
+        dist = (void*)&closest[n_objs*replication];
+    }
+
+    for(k=0; k<n_objs; k++)
+        for(j=0; j<replication; j++)
+            closest[k*replication+j].svr_idx = UINT64_MAX;
 
     for(i=0; i<(mod_state->n_svrs*mod_state->virt_factor); i++)
     {
-        svr = mod_state->virt_table[i];
-        for(j=0; j<replication; j++)
+        for(k=0; k<n_objs; k++)
         {
-            if(closest[j].svr_idx == UINT64_MAX || placement_distance_two_d(obj, svr.svr_id) < placement_distance_two_d(obj, closest[j].svr_id))
+            struct vnode *obj_closest = &closest[k*replication];
+            two_d_dist_t *obj_dist = &dist[k*replication];
+
+            svr = mod_state->virt_table[i];
+            svr_dist = placement_distance_two_d(objs[k], svr.svr_id);
+            for(j=0; j<replication; j++)
             {
-                tmp_svr = closest[j];
-                closest[j] = svr;
-                svr = tmp_svr;
+                if(obj_closest[j].svr_idx == UINT64_MAX || svr_dist < obj_dist[j])
+                {
+                    tmp_svr = obj_closest[j];
+                    tmp_dist = obj_dist[j];
+                    obj_closest[j] = svr;
+                    obj_dist[j] = svr_dist;
+                    svr = tmp_svr;
+                    svr_dist = tmp_dist;
+                }
             }
         }
     }
 
-    for(i=0; i<replication; i++)
+    for(k=0; k<n_objs; k++)
     {
-        server_idxs[i] = closest[i].svr_idx;
+        for(j=0; j<replication; j++)
+        {
+            server_idxs[k*replication+j] = closest[k*replication+j].svr_idx;
+        }
+    }
+
+    return;
+}
+
+static void placement_find_closest_two_d(struct placement_mod *mod, uint64_t obj, unsigned int replication,
+    unsigned long* server_idxs)
+{
+    struct two_d_state *mod_state = mod->data;
+
+    if(mod_state->search == TWO_D_SEARCH_KDTREE)
+        two_d_find_closest_kd(mod_state, obj, replication, server_idxs);
+    else
+        two_d_find_closest_tile(mod_state, &obj, 1, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_two_d(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct two_d_state *mod_state = mod->data;
+    unsigned long i;
+    unsigned int n_tile;
+
+    if(mod_state->search == TWO_D_SEARCH_KDTREE)
+    {
+        for(i=0; i<n_objs; i++)
+            two_d_find_closest_kd(mod_state, objs[i], replication,
+                &server_idxs[i*replication]);
+        return;
+    }
+
+    for(i=0; i<n_objs; i+=n_tile)
+    {
+        n_tile = TWO_D_TILE;
+        if(n_objs - i < n_tile)
+            n_tile = n_objs - i;
+        two_d_find_closest_tile(mod_state, &objs[i], n_tile, replication,
+            &server_idxs[i*replication]);
     }
 
     return;
@@ -130,24 +512,48 @@ static void placement_finalize_two_d(struct placement_mod *mod)
     struct two_d_state *mod_state = mod->data;
 
     free(mod_state->virt_table);
+    free(mod_state->kd_tree);
     free(mod_state);
     free(mod);
 
     return;
 }
 
-static uint64_t placement_distance_two_d(uint64_t a, uint64_t b)
+static int placement_get_stats_two_d(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct two_d_state *mod_state = mod->data;
+    unsigned long n = (unsigned long)mod_state->n_svrs*mod_state->virt_factor;
+
+    if(mod_state->search == TWO_D_SEARCH_KDTREE)
+        stats->table_bytes = n * sizeof(*mod_state->kd_tree);
+    else
+        stats->table_bytes = n * sizeof(*mod_state->virt_table);
+    stats->index_bytes = 0;
+    stats->build_seconds = mod_state->build_seconds;
+    stats->index_build_seconds = mod_state->index_build_seconds;
+
+    return(0);
+}
+
+/* exact squared euclidean distance between the points that a and b name,
+ * using the low and high 32 bits as coordinates.  Only the order of
+ * distances matters, so there is no need for the square root.
+ */
+static two_d_dist_t placement_distance_two_d(uint64_t a, uint64_t b)
 {
-    double x1, x2, y1, y2, dist;
+    two_d_dist_t dx, dy;
+    uint32_t x1, x2, y1, y2;
 
     x1 = a & 0xFFFFFFFF;
     x2 = b & 0xFFFFFFFF;
     y1 = (a >> 32) & 0xFFFFFFFF;
     y2 = (b >> 32) & 0xFFFFFFFF;
 
-    dist = sqrt(pow(x1-x2, 2.0) + pow(y1-y2, 2.0));
+    dx = x1 > x2 ? x1 - x2 : x2 - x1;
+    dy = y1 > y2 ? y1 - y2 : y2 - y1;
 
-    return(dist);
+    return(dx*dx + dy*dy);
 }
 
 /*
@@ -4,23 +4,32 @@
  *
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <assert.h>
 
 #include "ch-placement.h"
 #include "src/modules/placement-mod.h"
+#include "src/modules/placement-build.h"
 #include "src/lookup3.h"
 
 static struct placement_mod* placement_mod_xor(int n_svrs, int virt_factor, int seed);
+static struct placement_mod* placement_mod_xor_params(int n_svrs,
+    int virt_factor, int seed, const char* params);
 static void placement_find_closest_xor(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
     unsigned long *server_idxs);
+static void placement_find_closest_batch_xor(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs);
 static void placement_finalize_xor(struct placement_mod *mod);
+static int placement_get_stats_xor(struct placement_mod *mod,
+    struct ch_placement_stats *stats);
 
 struct placement_mod_map xor_mod_map = 
 {
     .type = "xor",
     .initiate = placement_mod_xor,
+    .initiate_params = placement_mod_xor_params,
 };
 
 struct vnode
@@ -29,25 +38,66 @@ struct vnode
     uint64_t svr_id;
 };
 
+enum xor_search
+{
+    XOR_SEARCH_TRIE = 0,    /* walk a crit-bit trie over the sorted ids */
+    XOR_SEARCH_SCAN         /* score every vnode */
+};
+
+/* a node of the crit-bit (Patricia) trie over the sorted vnode ids.  It
+ * covers the sorted vnodes lo through hi-1, which agree on every bit above
+ * bit; child[0] holds those with bit clear and child[1] those with it set.
+ * Leaves cover a run of identical ids and have bit set to XOR_TRIE_LEAF.
+ */
+struct xor_trie_node
+{
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t child[2];
+    uint32_t bit;
+};
+
+#define XOR_TRIE_LEAF 64
+
 struct xor_state
 {
     unsigned int n_svrs;
     unsigned int virt_factor;
-    struct vnode *virt_table;
+    enum xor_search search;
+    struct vnode *virt_table;       /* only kept for the scan */
+    uint64_t *trie_ids;             /* vnode ids in ascending order */
+    uint32_t *trie_svrs;            /* server of each sorted vnode */
+    struct xor_trie_node *trie;     /* node 0 is the root */
+    uint32_t n_trie;
+    double build_seconds;
+    double index_build_seconds;
 };
 
+/* number of objects scored together in each pass over the vnode table */
+#define XOR_TILE 16
+
+static int xor_parse_param(void *state, const char *param);
+static int xor_build_trie(struct xor_state *mod_state);
+
 struct placement_mod* placement_mod_xor(int n_svrs, int virt_factor, int seed)
+{
+    return(placement_mod_xor_params(n_svrs, virt_factor, seed, NULL));
+}
+
+static struct placement_mod* placement_mod_xor_params(int n_svrs,
+    int virt_factor, int seed, const char* params)
 {
     struct placement_mod *mod_xor;
     struct xor_state *mod_state;
     uint32_t h1, h2;
     uint64_t i, j;
+    double start;
 
-    mod_xor = malloc(sizeof(*mod_xor));
+    mod_xor = calloc(1, sizeof(*mod_xor));
     if(!mod_xor)
         return(NULL);
 
-    mod_state = malloc(sizeof(*mod_state));
+    mod_state = calloc(1, sizeof(*mod_state));
     if(!mod_state)
     {
         free(mod_xor);
@@ -56,6 +106,16 @@ struct placement_mod* placement_mod_xor(int n_svrs, int virt_factor, int seed)
 
     mod_xor->data = mod_state;
 
+    if(placement_parse_params("xor", params, xor_parse_param,
+        mod_state) < 0)
+    {
+        free(mod_state);
+        free(mod_xor);
+        return(NULL);
+    }
+
+    start = placement_wtime();
+
     mod_state->virt_table = malloc(sizeof(*mod_state->virt_table)*n_svrs*virt_factor);
     if(!mod_state->virt_table)
     {
@@ -68,8 +128,9 @@ struct placement_mod* placement_mod_xor(int n_svrs, int virt_factor, int seed)
     mod_state->virt_factor = virt_factor;
 
     /* create virt_factor virtual nodes for each server index by jenkins
-     * hashing server index
+     * hashing server index; large tables are hashed by several threads
      */
+#pragma omp parallel for private(j, h1, h2) if((unsigned long)n_svrs*virt_factor >= PLACEMENT_BUILD_MIN)
     for(i=0; i<n_svrs; i++)
     {
         for(j=0; j<virt_factor; j++)
@@ -81,43 +142,271 @@ struct placement_mod* placement_mod_xor(int n_svrs, int virt_factor, int seed)
             mod_state->virt_table[j*n_svrs+i].svr_id = h1 + (((uint64_t)h2)<<32);
         }
     }
+    mod_state->build_seconds = placement_wtime() - start;
+
+    if(mod_state->search == XOR_SEARCH_TRIE)
+    {
+        start = placement_wtime();
+        if(xor_build_trie(mod_state) < 0)
+        {
+            placement_finalize_xor(mod_xor);
+            return(NULL);
+        }
+        mod_state->index_build_seconds = placement_wtime() - start;
+
+        /* the trie has everything lookups need */
+        free(mod_state->virt_table);
+        mod_state->virt_table = NULL;
+    }
 
     mod_xor->find_closest = placement_find_closest_xor;
+    mod_xor->find_closest_batch = placement_find_closest_batch_xor;
     mod_xor->create_striped = placement_create_striped_random;
     mod_xor->finalize = placement_finalize_xor;
+    mod_xor->get_stats = placement_get_stats_xor;
 
     return(mod_xor);
 }
 
-/* TODO: implement a faster version of this; should not be O(n) */
-static void placement_find_closest_xor(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
+/* parses one module parameter; see the ring module for the format.
+ * search is "trie" (the default) or "scan", which scores every vnode and
+ * is kept as a reference.
+ */
+static int xor_parse_param(void *state, const char *param)
+{
+    struct xor_state *mod_state = state;
+
+    if(strcmp(param, "search:trie") == 0)
+        mod_state->search = XOR_SEARCH_TRIE;
+    else if(strcmp(param, "search:scan") == 0)
+        mod_state->search = XOR_SEARCH_SCAN;
+    else
+        return(PLACEMENT_PARAM_UNKNOWN);
+
+    return(0);
+}
+
+/* builds the trie nodes for sorted vnodes lo through hi-1, which all agree
+ * above bit; returns the index of the new node
+ */
+static uint32_t xor_build_node(struct xor_state *mod_state, uint32_t lo,
+    uint32_t hi)
+{
+    struct xor_trie_node *node;
+    uint64_t *ids = mod_state->trie_ids;
+    uint32_t idx = mod_state->n_trie++;
+    uint32_t split, left, right, mid;
+    int bit;
+
+    node = &mod_state->trie[idx];
+    node->lo = lo;
+    node->hi = hi;
+    if(ids[lo] == ids[hi-1])
+    {
+        node->bit = XOR_TRIE_LEAF;
+        return(idx);
+    }
+
+    /* the highest bit on which the range differs; the ids with it clear
+     * come first since the range is sorted
+     */
+    bit = 63 - __builtin_clzll(ids[lo] ^ ids[hi-1]);
+    left = lo;
+    right = hi-1;
+    while(left < right)
+    {
+        mid = left + (right - left)/2;
+        if(ids[mid] & ((uint64_t)1 << bit))
+            right = mid;
+        else
+            left = mid + 1;
+    }
+    split = left;
+    node->bit = bit;
+
+    node->child[0] = xor_build_node(mod_state, lo, split);
+    node->child[1] = xor_build_node(mod_state, split, hi);
+
+    return(idx);
+}
+
+/* sorts the vnodes and builds a crit-bit trie over them.  Equal ids are
+ * kept in vnode table order, which is the order the scan reports them in.
+ */
+static int xor_build_trie(struct xor_state *mod_state)
+{
+    unsigned long n = (unsigned long)mod_state->n_svrs*mod_state->virt_factor;
+    int threads = 1;
+    unsigned long i;
+
+    mod_state->trie_ids = malloc(sizeof(*mod_state->trie_ids)*n);
+    mod_state->trie_svrs = malloc(sizeof(*mod_state->trie_svrs)*n);
+    /* a trie over n leaves has fewer than 2n nodes */
+    mod_state->trie = malloc(sizeof(*mod_state->trie)*2*n);
+    if(!mod_state->trie_ids || !mod_state->trie_svrs || !mod_state->trie)
+        return(-1);
+
+    /* sort table positions along with the ids so that ties stay in table
+     * order, then turn them into servers
+     */
+    for(i=0; i<n; i++)
+    {
+        mod_state->trie_ids[i] = mod_state->virt_table[i].svr_id;
+        mod_state->trie_svrs[i] = i;
+    }
+    if(placement_build_parallel(PLACEMENT_BUILD_AUTO, n))
+        threads = placement_build_threads(0);
+    if(placement_radix_sort(mod_state->trie_ids, mod_state->trie_svrs, n,
+        threads) < 0)
+        return(-1);
+    for(i=0; i<n; i++)
+        mod_state->trie_svrs[i] =
+            mod_state->virt_table[mod_state->trie_svrs[i]].svr_idx;
+
+    mod_state->n_trie = 0;
+    xor_build_node(mod_state, 0, n);
+
+    return(0);
+}
+
+/* reports the replication closest vnodes to obj by walking the trie,
+ * always descending into the child that agrees with obj on the node's bit
+ * first: every vnode in that child is closer than every vnode in the other.
+ * Each leaf reached adds at least one vnode, so this visits O(64 +
+ * replication) nodes.
+ */
+static void xor_find_closest_trie(struct xor_state *mod_state, uint64_t obj,
+    unsigned int replication, unsigned long* server_idxs)
+{
+    /* each level pushes one sibling, and there are at most 64 levels */
+    uint32_t stack[XOR_TRIE_LEAF+1];
+    struct xor_trie_node *node;
+    unsigned int depth = 0;
+    unsigned int found = 0;
+    unsigned int near;
+    uint32_t k;
+
+    stack[depth++] = 0;
+    while(depth > 0 && found < replication)
+    {
+        node = &mod_state->trie[stack[--depth]];
+        while(node->bit != XOR_TRIE_LEAF)
+        {
+            near = (obj >> node->bit) & 1;
+            stack[depth++] = node->child[!near];
+            node = &mod_state->trie[node->child[near]];
+        }
+        for(k=node->lo; k<node->hi && found < replication; k++)
+            server_idxs[found++] = mod_state->trie_svrs[k];
+    }
+
+    /* like the scan, slots past the number of vnodes get UINT64_MAX */
+    for(; found<replication; found++)
+        server_idxs[found] = UINT64_MAX;
+
+    return;
+}
+
+/* scores a tile of up to XOR_TILE objects against every vnode in a
+ * single pass over the table, caching the distance of each candidate kept
+ * so far.  This is the "scan" search, which is O(n) per object; the trie
+ * places objects identically.
+ */
+static void xor_find_closest_tile(struct xor_state *mod_state,
+    const uint64_t *objs, unsigned int n_objs, unsigned int replication,
     unsigned long* server_idxs)
 {
-    struct xor_state *mod_state = mod->data;
-    struct vnode closest[CH_MAX_REPLICATION];
+    struct vnode closest_stack[XOR_TILE*CH_STACK_REPLICATION];
+    uint64_t dist_stack[XOR_TILE*CH_STACK_REPLICATION];
+    struct vnode *closest = closest_stack;
+    uint64_t *dist = dist_stack;
     struct vnode svr, tmp_svr;
-    unsigned int i,j;
+    uint64_t svr_dist, tmp_dist;
+    unsigned int i,j,k;
 
-    for(i=0; i<replication; i++)
-        closest[i].svr_idx = UINT64_MAX;
+    /* wide layouts don't fit in the stack arrays */
+    if(replication > CH_STACK_REPLICATION)
+    {
+        closest = placement_scratch((unsigned long)n_objs*replication*
+            (sizeof(*closest) + sizeof(*dist)));
+        dist = (void*)&closest[n_objs*replication];
+    }
+
+    for(k=0; k<n_objs; k++)
+        for(j=0; j<replication; j++)
+            closest[k*replication+j].svr_idx = UINT64_MAX;
 
     for(i=0; i<(mod_state->n_svrs*mod_state->virt_factor); i++)
     {
-        svr = mod_state->virt_table[i];
-        for(j=0; j<replication; j++)
+        for(k=0; k<n_objs; k++)
         {
-            if(closest[j].svr_idx == UINT64_MAX || (obj ^ svr.svr_id) < (obj ^ closest[j].svr_id))
+            struct vnode *obj_closest = &closest[k*replication];
+            uint64_t *obj_dist = &dist[k*replication];
+
+            svr = mod_state->virt_table[i];
+            svr_dist = objs[k] ^ svr.svr_id;
+            for(j=0; j<replication; j++)
             {
-                tmp_svr = closest[j];
-                closest[j] = svr;
-                svr = tmp_svr;
+                if(obj_closest[j].svr_idx == UINT64_MAX || svr_dist < obj_dist[j])
+                {
+                    tmp_svr = obj_closest[j];
+                    tmp_dist = obj_dist[j];
+                    obj_closest[j] = svr;
+                    obj_dist[j] = svr_dist;
+                    svr = tmp_svr;
+                    svr_dist = tmp_dist;
+                }
             }
         }
     }
 
-    for(i=0; i<replication; i++)
+    for(k=0; k<n_objs; k++)
+    {
+        for(j=0; j<replication; j++)
+        {
+            server_idxs[k*replication+j] = closest[k*replication+j].svr_idx;
+        }
+    }
+
+    return;
+}
+
+static void placement_find_closest_xor(struct placement_mod *mod, uint64_t obj, unsigned int replication, 
+    unsigned long* server_idxs)
+{
+    struct xor_state *mod_state = mod->data;
+
+    if(mod_state->search == XOR_SEARCH_TRIE)
+        xor_find_closest_trie(mod_state, obj, replication, server_idxs);
+    else
+        xor_find_closest_tile(mod_state, &obj, 1, replication, server_idxs);
+
+    return;
+}
+
+static void placement_find_closest_batch_xor(struct placement_mod *mod,
+    const uint64_t *objs, unsigned long n_objs, unsigned int replication,
+    unsigned long *server_idxs)
+{
+    struct xor_state *mod_state = mod->data;
+    unsigned long i;
+    unsigned int n_tile;
+
+    if(mod_state->search == XOR_SEARCH_TRIE)
+    {
+        for(i=0; i<n_objs; i++)
+            xor_find_closest_trie(mod_state, objs[i], replication,
+                &server_idxs[i*replication]);
+        return;
+    }
+
+    for(i=0; i<n_objs; i+=n_tile)
     {
-        server_idxs[i] = closest[i].svr_idx;
+        n_tile = XOR_TILE;
+        if(n_objs - i < n_tile)
+            n_tile = n_objs - i;
+        xor_find_closest_tile(mod->data, &objs[i], n_tile, replication,
+            &server_idxs[i*replication]);
     }
 
     return;
@@ -128,12 +417,38 @@ static void placement_finalize_xor(struct placement_mod *mod)
     struct xor_state *mod_state = mod->data;
 
     free(mod_state->virt_table);
+    free(mod_state->trie_ids);
+    free(mod_state->trie_svrs);
+    free(mod_state->trie);
     free(mod_state);
     free(mod);
 
     return;
 }
 
+static int placement_get_stats_xor(struct placement_mod *mod,
+    struct ch_placement_stats *stats)
+{
+    struct xor_state *mod_state = mod->data;
+    unsigned long n = (unsigned long)mod_state->n_svrs*mod_state->virt_factor;
+
+    if(mod_state->search == XOR_SEARCH_TRIE)
+    {
+        stats->table_bytes = n *
+            (sizeof(*mod_state->trie_ids) + sizeof(*mod_state->trie_svrs));
+        stats->index_bytes = mod_state->n_trie * sizeof(*mod_state->trie);
+    }
+    else
+    {
+        stats->table_bytes = n * sizeof(*mod_state->virt_table);
+        stats->index_bytes = 0;
+    }
+    stats->build_seconds = mod_state->build_seconds;
+    stats->index_build_seconds = mod_state->index_build_seconds;
+
+    return(0);
+}
+
 
 /*
  * Local variables:
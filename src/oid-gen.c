@@ -65,6 +65,7 @@ static void oid_gen_basic(
     unsigned long* total_objs_count,
     struct obj** total_objs);
 static int obj_cmp(const void* a, const void *b);
+static struct obj* oid_alloc(unsigned int max_objs, unsigned int replication);
 
 void oid_sort(struct obj* objs, unsigned int objs_count)
 {
@@ -94,6 +95,33 @@ void oid_randomize(struct obj* objs, unsigned int objs_count, unsigned int seed)
 }
 
 
+/* allocates an array of objects.  Placements wider than the cache inside
+ * struct obj get room after the array, in the same block, so that the
+ * caller can release everything with free().  The array is never
+ * reallocated, since that would invalidate the wide cache pointers.
+ */
+static struct obj* oid_alloc(unsigned int max_objs, unsigned int replication)
+{
+    struct obj *objs;
+    unsigned long *wide_server_idxs = NULL;
+    unsigned long wide = 0;
+    unsigned int i;
+
+    if(replication > CH_STACK_REPLICATION)
+        wide = replication;
+    objs = malloc(max_objs*sizeof(*objs) +
+        (unsigned long)max_objs*wide*sizeof(*wide_server_idxs));
+    assert(objs);
+
+    if(wide)
+        wide_server_idxs = (unsigned long*)&objs[max_objs];
+    for(i=0; i<max_objs; i++)
+        objs[i].wide_server_idxs = wide ?
+            &wide_server_idxs[(unsigned long)i*wide] : NULL;
+
+    return(objs);
+}
+
 /* generates an array of objects to populate the system */
 void oid_gen(char* gen_name, 
     struct ch_placement_instance *instance,
@@ -155,11 +183,10 @@ static void oid_gen_random(
      * (not counting replicas)
      */
 
-    /* allocate an array large enough to hold every object id; after we are
-     * done then we can realloc it down to a smaller size.
+    /* allocate an array large enough to hold every object id; it is not
+     * shrunk afterwards
      */
-    *total_objs = malloc(max_objs*sizeof(**total_objs));
-    assert(*total_objs);
+    *total_objs = oid_alloc(max_objs, replication);
     *total_objs_count = 0;
 
     srand(random_seed);
@@ -278,8 +305,7 @@ static void oid_gen_hist_stripe(
     int percentage = 0;
 #endif
 
-    *total_objs = malloc(max_objs*sizeof(**total_objs));
-    assert(*total_objs);
+    *total_objs = oid_alloc(max_objs, replication);
     *total_objs_count = 0;
     *total_byte_count = 0;
 
@@ -504,8 +530,7 @@ static void oid_gen_hist_hadoop(
     int percentage = 0;
 #endif
 
-    *total_objs = malloc(max_objs*sizeof(**total_objs));
-    assert(*total_objs);
+    *total_objs = oid_alloc(max_objs, replication);
     *total_objs_count = 0;
     *total_byte_count = 0;
 
@@ -700,8 +725,7 @@ static void oid_gen_basic(
     /* Simple case for testing.  Three objs with replication level 2, total
      * volume of data (not counting replication) slightly over 400 GIB */
 
-    *total_objs = malloc(max_objs*sizeof(**total_objs));
-    assert(*total_objs);
+    *total_objs = oid_alloc(max_objs, replication);
     *total_objs_count = max_objs;
     *total_byte_count = 0;
 
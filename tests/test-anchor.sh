@@ -0,0 +1,31 @@
+#!/bin/bash
+
+src/ch-placement-lookup anchor 256 1 100 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify anchor 100 1 10000 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# removing a server only moves the objects it held; other replicas may
+# change order, but no other primary moves
+src/ch-placement-disruption-check anchor 1000 1 100000 1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-disruption-check anchor 1000 1 100000 3 capacity:1000 0
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# most of the anchor is removed to begin with
+src/ch-placement-disruption-check anchor 37 1 20000 4 capacity:1024 0
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+exit 0
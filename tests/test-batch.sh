@@ -0,0 +1,18 @@
+#!/bin/bash
+
+for module in xor ring multiring hash_lookup3 hash_spooky two_d static_modulo
+do
+    src/ch-placement-verify $module 64 4 1000 3
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+done
+
+# replication wider than the stack fast path
+for module in xor ring multiring hash_lookup3 hash_spooky two_d static_modulo
+do
+    src/ch-placement-verify $module 64 4 1000 12
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+done
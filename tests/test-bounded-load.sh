@@ -0,0 +1,41 @@
+#!/bin/bash
+
+for factor in 1.25 1.1 2
+do
+    src/ch-placement-load-check ring 100 16 100000 3 $factor
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+done
+
+src/ch-placement-load-check ring 37 8 20000 1 1.05 layout:eytzinger,prefix_bits:auto
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# capacities follow the weights, and servers without weight get nothing
+src/ch-placement-load-check ring 100 16 100000 3 1.25 "" 4:1:1:1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-load-check ring 50 16 50000 2 1.1 successors:2 1:2:0:3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# with no load anywhere the ring places objects as usual
+src/ch-placement-verify ring 100 16 10000 3 bounded_load:1.25
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# bounded rings depend on live loads and cannot be saved
+src/ch-placement-snapshot-check ring 100 16 1000 3 test-bounded-load.$$.chp bounded_load:1.25 2>/dev/null
+if [ $? -eq 0 ]; then
+    rm -f test-bounded-load.$$.chp
+    exit 1
+fi
+rm -f test-bounded-load.$$.chp
+
+exit 0
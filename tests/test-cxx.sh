@@ -0,0 +1,11 @@
+#!/bin/bash
+
+src/ch-placement-verify-cxx 64 4 10000
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify-cxx 1000 7 10000
+if [ $? -ne 0 ]; then
+    exit 1
+fi
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+src/ch-placement-handle-check ring 100 16 2000 3 50
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-handle-check ring 200 8 2000 3 20 layout:eytzinger,prefix_bits:auto
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-handle-check multiring 64 16 2000 3 20
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-handle-check hash_lookup3 64 4 2000 3 20
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+exit 0
@@ -9,3 +9,17 @@ src/ch-placement-lookup hash_lookup3 256 16 100 3
 if [ $? -ne 0 ]; then
     exit 1
 fi
+
+# every scoring kernel places objects exactly like the original scan
+for kernel in reference scalar
+do
+    src/ch-placement-verify hash_lookup3 256 16 2000 3 kernel:$kernel
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+done
+
+src/ch-placement-verify hash_lookup3 1000 1 2000 8 kernel:reference
+if [ $? -ne 0 ]; then
+    exit 1
+fi
@@ -0,0 +1,36 @@
+#!/bin/bash
+
+src/ch-placement-lookup jump 256 1 100 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify jump 100 1 10000 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# every replica is distinct even when they cover all of the servers
+src/ch-placement-verify jump 4 1 10000 4
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# adding server 100 only moves primaries onto it
+for oid in $(seq 1 7919 1000000)
+do
+    before=$(src/ch-placement-lookup jump 100 1 $oid 1 | tail -n 1 | cut -f 2)
+    after=$(src/ch-placement-lookup jump 101 1 $oid 1 | tail -n 1 | cut -f 2)
+    if [ "$before" != "$after" -a "$after" != "100" ]; then
+        echo "Error: oid $oid moved from $before to $after"
+        exit 1
+    fi
+done
+
+# jump places the devices within each server
+src/ch-placement-benchmark -p ring -D jump -s 16 -d 8 -o 10000 -r 3 -v 16 -b 4 -e 8 -t 1 -a 4 > /dev/null
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+exit 0
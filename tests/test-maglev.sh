@@ -0,0 +1,31 @@
+#!/bin/bash
+
+src/ch-placement-lookup maglev 256 1 100 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify maglev 100 1 10000 3 table_size:10007
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# removing a server moves the objects it held, plus a few others whose
+# table slots changed hands
+src/ch-placement-disruption-check maglev 1000 1 100000 3 table_size:100000 0.02
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-disruption-check maglev 37 1 20000 4 table_size:65537 0.02
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# times lookups against the ring
+src/ch-placement-benchmark -l -p maglev -s 1000 -v 1 -o 10000 -r 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+exit 0
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+for module in ring multiring
+do
+    src/ch-placement-membership-check $module 64 16 10000 3
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+done
+
+src/ch-placement-membership-check ring 100 8 10000 3 layout:eytzinger,prefix_bits:auto,successors:3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-membership-check multiring 100 8 10000 3 prefix_bits:auto
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-membership-check multiring 100 8 10000 3 search:bsearch
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# modules without incremental membership changes refuse them
+src/ch-placement-membership-check hash_lookup3 64 4 100 3
+if [ $? -eq 0 ]; then
+    exit 1
+fi
+
+exit 0
@@ -0,0 +1,33 @@
+#!/bin/bash
+
+src/ch-placement-lookup multiprobe 256 1 100 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify multiprobe 100 1 10000 3 prefix_bits:0,search:scalar
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify multiprobe 1000 1 10000 3 probes:21,prefix_bits:4
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# removing a server only moves the objects it held; other replicas may
+# change order, but no other primary moves
+src/ch-placement-disruption-check multiprobe 1000 1 100000 1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+for params in probes:1 probes:21 probes:64,prefix_bits:0
+do
+    src/ch-placement-disruption-check multiprobe 1000 1 100000 3 $params 0
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+done
+
+exit 0
@@ -9,3 +9,46 @@ src/ch-placement-lookup multiring 256 16 100 3
 if [ $? -ne 0 ]; then
     exit 1
 fi
+
+src/ch-placement-verify multiring 1000 7 10000 3 prefix_bits:auto
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify multiring 256 16 10000 3 prefix_bits:2
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify multiring 1000 7 10000 3 search:bsearch
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify multiring 256 16 10000 3 search:scalar
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# parallel builds must match the (serial) default build exactly
+src/ch-placement-verify multiring 256 16 10000 3 build:parallel
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify multiring 5000 4 10000 3 build:parallel,build_threads:2
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# rings this large are placed in batches grouped by ring, which must match
+# single lookups
+src/ch-placement-verify multiring 4096 64 20000 3 prefix_bits:auto
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify multiring 4096 64 20000 3 search:bsearch
+if [ $? -ne 0 ]; then
+    exit 1
+fi
@@ -0,0 +1,53 @@
+#!/bin/bash
+
+src/ch-placement-lookup partition 256 1 100 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify partition 100 1 10000 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# lookups wider than the table continue into the next partitions
+src/ch-placement-verify partition 100 1 10000 5
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# a table built from the ring places almost every object like the ring
+src/ch-placement-migration-check partition 100 16 100000 3 0.05 from:ring,partition_bits:20
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-migration-check partition 100 16 100000 3 1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# removing a server only rewrites its slots, and adding it back restores
+# them; other replicas stay in their slots, so the order may change
+src/ch-placement-disruption-check partition 100 1 100000 1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+for params in replicas:3 from:ring,replicas:4
+do
+    src/ch-placement-disruption-check partition 100 16 100000 3 $params 0
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+done
+
+snapshot=test-partition.$$.chp
+src/ch-placement-snapshot-check partition 1000 1 10000 3 $snapshot
+if [ $? -ne 0 ]; then
+    rm -f $snapshot
+    exit 1
+fi
+rm -f $snapshot
+
+exit 0
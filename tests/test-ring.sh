@@ -9,3 +9,69 @@ src/ch-placement-lookup ring 256 16 100 3
 if [ $? -ne 0 ]; then
     exit 1
 fi
+
+src/ch-placement-verify ring 256 16 10000 3 layout:eytzinger
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 1000 7 10000 3 layout:eytzinger
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 1000 7 10000 3 prefix_bits:auto
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 256 16 10000 3 prefix_bits:4
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 1000 7 10000 3 successors:5
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 256 16 10000 4 successors:3,prefix_bits:auto
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 3 4 1000 3 successors:5
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 1000 7 10000 3 search:bsearch
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 256 16 10000 3 search:scalar
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# parallel builds must match the (serial) default build exactly
+src/ch-placement-verify ring 256 16 10000 3 build:parallel,build_threads:3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify ring 1000 100 10000 3 build:serial
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-weight-check ring 100 64 100000 3 0.1 build:parallel
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-benchmark -c -s 1000 -v 100 -o 10000 -r 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
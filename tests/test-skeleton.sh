@@ -0,0 +1,38 @@
+#!/bin/bash
+
+src/ch-placement-lookup skeleton 256 1 100 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify skeleton 100 1 10000 3 kernel:scalar
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify skeleton 1000 1 10000 3 fanout:8
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# removing a server only moves the objects it held
+for params in fanout:2 fanout:8 fanout:64
+do
+    src/ch-placement-disruption-check skeleton 1000 1 100000 3 $params
+    if [ $? -ne 0 ]; then
+        exit 1
+    fi
+done
+
+src/ch-placement-disruption-check skeleton 37 1 20000 4 fanout:4
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# the ring keeps the same property for primary replicas
+src/ch-placement-disruption-check ring 100 16 20000 1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+exit 0
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+snapshot=test-snapshot.$$.chp
+
+for params in layout:sorted layout:eytzinger,prefix_bits:auto,successors:3 search:bsearch
+do
+    src/ch-placement-snapshot-check ring 1000 7 10000 3 $snapshot $params
+    if [ $? -ne 0 ]; then
+        rm -f $snapshot
+        exit 1
+    fi
+done
+
+for params in search:scalar prefix_bits:auto search:bsearch
+do
+    src/ch-placement-snapshot-check multiring 256 16 10000 3 $snapshot $params
+    if [ $? -ne 0 ]; then
+        rm -f $snapshot
+        exit 1
+    fi
+done
+
+rm -f $snapshot
+
+# modules without snapshot support refuse to save
+src/ch-placement-snapshot-check hash_lookup3 64 4 100 3 $snapshot
+if [ $? -eq 0 ]; then
+    exit 1
+fi
+
+exit 0
@@ -0,0 +1,30 @@
+#!/bin/bash
+
+src/ch-placement-lookup straw2 256 1 100 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify straw2 100 1 10000 3 kernel:scalar
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-weight-check straw2 100 1 100000 3 0.1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# removing a server only moves the objects it held; other replicas may
+# change order, but no other primary moves
+src/ch-placement-disruption-check straw2 100 1 100000 1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-disruption-check straw2 100 1 100000 3 "" 0
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+exit 0
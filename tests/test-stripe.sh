@@ -0,0 +1,23 @@
+#!/bin/bash
+
+src/ch-placement-stripe-check multiring 100 16 20000 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-stripe-check multiring 1000 8 5000 2 prefix_bits:auto
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-stripe-check ring 100 16 20000 3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-stripe-check hash_lookup3 64 4 20000 2
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+exit 0
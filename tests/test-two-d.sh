@@ -9,3 +9,19 @@ src/ch-placement-lookup two_d 256 16 100 3
 if [ $? -ne 0 ]; then
     exit 1
 fi
+
+# the k-d tree places objects exactly like a scan of every vnode
+src/ch-placement-verify two_d 256 16 10000 3 search:scan
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify two_d 1000 1 10000 8 search:scan
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-verify two_d 10000 4 2000 3 search:scan
+if [ $? -ne 0 ]; then
+    exit 1
+fi
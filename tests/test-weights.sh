@@ -0,0 +1,19 @@
+#!/bin/bash
+
+src/ch-placement-weight-check ring 100 64 100000 3 0.1
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+src/ch-placement-weight-check ring 1000 16 100000 3 0.1 layout:eytzinger,prefix_bits:auto,successors:3
+if [ $? -ne 0 ]; then
+    exit 1
+fi
+
+# modules without weights refuse them
+src/ch-placement-weight-check multiring 100 16 1000 3 0.1
+if [ $? -eq 0 ]; then
+    exit 1
+fi
+
+exit 0